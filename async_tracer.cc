@@ -0,0 +1,442 @@
+#include "log.hpp"
+
+#include <charconv>
+
+namespace
+{
+  //! The writer coalesces a whole drained batch even when the user asked for per-message flushing.
+  FlushPolicy batched(FlushPolicy flush)
+  {
+    if (flush.max_buffered_bytes == 0)
+      flush.max_buffered_bytes = 64 * 1024;
+    return flush;
+  }
+
+  //! The idle writer wakes up to honour FlushPolicy::max_delay.
+  std::chrono::milliseconds idle_wait(const FlushPolicy &flush)
+  {
+    const std::chrono::milliseconds wait{100};
+    return flush.max_delay.count() > 0 ? std::min(flush.max_delay, wait) : wait;
+  }
+
+  AsyncRecord make_record(const char *header, TraceSeverity severity, std::string_view message)
+  {
+    AsyncRecord record;
+    record.when = timestamp_now();
+    record.header = header;
+    record.urgent = severity == TraceSeverity::error || severity == TraceSeverity::critical;
+    record.message = message;
+    record.severity = severity;
+    return record;
+  }
+
+  void append_count(std::string &out, std::uint64_t value)
+  {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+  }
+
+  //! Names of the severity slots, in bit order of TraceSeverity.
+  constexpr const char *slot_names[] = {"info", "warning", "error", "debug", "verbose", "critical", "", ""};
+}
+
+void append_drop_notice(std::string &out, const DropCounts &counts)
+{
+  std::uint64_t total = 0;
+  for (const std::uint64_t count : counts)
+    total += count;
+  append_count(out, total);
+  out += total == 1 ? " message dropped (" : " messages dropped (";
+  bool first = true;
+  for (std::size_t slot = 0; slot < counts.size(); ++slot)
+  {
+    if (counts[slot] == 0)
+      continue;
+    if (!first)
+      out += ", ";
+    first = false;
+    out += slot_names[slot];
+    out += ": ";
+    append_count(out, counts[slot]);
+  }
+  out += ")\n";
+}
+
+// ---------------------------------------------------------------------------
+// AsyncTracer – construction / destruction
+// ---------------------------------------------------------------------------
+
+AsyncTracer::AsyncTracer(const AsyncConfig &config, std::chrono::milliseconds idle_wait)
+    : queue_(config), idle_wait_(idle_wait)
+{
+}
+
+AsyncTracer::~AsyncTracer()
+{
+  stop_writer();
+}
+
+void AsyncTracer::start_writer()
+{
+  writer_ = std::thread(&AsyncTracer::writer_loop, this);
+}
+
+void AsyncTracer::stop_writer()
+{
+  stop_.store(true);
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_cv_.notify_one();
+  }
+  if (writer_.joinable())
+    writer_.join();
+}
+
+// ---------------------------------------------------------------------------
+// AsyncTracer – producer side
+// ---------------------------------------------------------------------------
+
+void AsyncTracer::enqueue(AsyncRecord &&record)
+{
+  // Count before pushing so that flush() never waits on a record it cannot see,
+  // and never returns before a record counted in its target is written.
+  enqueued_.fetch_add(1, std::memory_order_acq_rel);
+  if (record.fatal)
+    queue_.push_wait(std::move(record), [this]
+                     { wake_writer(); });
+  else if (const std::size_t dropped = queue_.push(std::move(record), [this]
+                                                   { wake_writer(); }))
+    retire(dropped);
+  wake_writer();
+}
+
+void AsyncTracer::retire(std::size_t count)
+{
+  // Pairs with drain(): either it sees the new count or we see it waiting.
+  written_.fetch_add(count, std::memory_order_seq_cst);
+  if (flush_waiters_.load(std::memory_order_seq_cst) > 0)
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    drained_cv_.notify_all();
+  }
+}
+
+void AsyncTracer::wake_writer()
+{
+  // Pairs with the fence in writer_loop(): either the writer sees the new record
+  // or we see it announced itself idle.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writer_idle_.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake_cv_.notify_one();
+  }
+}
+
+void AsyncTracer::Info(const std::string &message)
+{
+  enqueue(make_record("", TraceSeverity::info, message));
+}
+
+void AsyncTracer::Debug(const std::string &message)
+{
+  enqueue(make_record("Debug: ", TraceSeverity::debug, message));
+}
+
+void AsyncTracer::Warning(const std::string &message)
+{
+  enqueue(make_record("Warning: ", TraceSeverity::warning, message));
+}
+
+void AsyncTracer::Error(const std::string &message)
+{
+  enqueue(make_record("ERROR: ", TraceSeverity::error, message));
+}
+
+void AsyncTracer::Critical(const std::string &message)
+{
+  enqueue(make_record("CRITICAL: ", TraceSeverity::critical, message));
+}
+
+void AsyncTracer::Fatal(const std::string &message)
+{
+  AsyncRecord record = make_record("*** FATAL ***: ", TraceSeverity::critical, message);
+  record.fatal = true;
+  enqueue(std::move(record));
+  flush();
+}
+
+void AsyncTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  enqueue(make_record(severity_header(severity), severity, message));
+}
+
+bool AsyncTracer::Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args)
+{
+  AsyncRecord record;
+  record.when = timestamp_now();
+  record.header = severity_header(severity);
+  record.urgent = severity == TraceSeverity::error || severity == TraceSeverity::critical;
+  record.format = format;
+  record.args = args;
+  record.severity = severity;
+  enqueue(std::move(record));
+  return true;
+}
+
+void AsyncTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields,
+                             std::size_t count)
+{
+  AsyncRecord record = make_record(severity_header(severity), severity, message);
+  if (count > 0)
+  {
+    record.fields_offset = record.message.size();
+    pack_fields(record.message, fields, count);
+  }
+  enqueue(std::move(record));
+}
+
+void AsyncTracer::drain()
+{
+  const std::uint64_t target = enqueued_.load(std::memory_order_acquire);
+  flush_waiters_.fetch_add(1, std::memory_order_seq_cst);
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  drained_cv_.wait(lock, [&]
+                   { return written_.load(std::memory_order_seq_cst) >= target; });
+  lock.unlock();
+  flush_waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AsyncTracer::add_queue_stats(SinkStats &stats) const
+{
+  stats.write_errors += write_errors_.get();
+  stats.queued = true;
+  stats.queue_depth = queue_.size_approx();
+  stats.queue_high_water = high_water_.get();
+  stats.dropped = queue_.dropped_counts();
+}
+
+// ---------------------------------------------------------------------------
+// AsyncTracer – writer side
+// ---------------------------------------------------------------------------
+
+std::string_view AsyncTracer::text(const AsyncRecord &record)
+{
+  if (record.fields_offset != std::string::npos)
+  {
+    std::string_view message;
+    const std::vector<Field> &pairs = fields(record, message);
+    formatted_.clear();
+    render_fields(formatted_, message, pairs.data(), pairs.size());
+    return formatted_;
+  }
+  if (record.format.empty())
+    return record.message;
+  formatted_.clear();
+  try
+  {
+    format_packed(formatted_, record.format, record.args);
+  }
+  catch (const std::format_error &e)
+  {
+    formatted_ = std::string("<format error: ") + e.what() + "> " + std::string(record.format);
+  }
+  return formatted_;
+}
+
+const std::vector<Field> &AsyncTracer::fields(const AsyncRecord &record, std::string_view &message)
+{
+  const std::string_view packed(record.message);
+  message = packed.substr(0, record.fields_offset);
+  fields_.clear();
+  if (record.fields_offset < packed.size())
+    unpack_fields(packed.substr(record.fields_offset), fields_);
+  return fields_;
+}
+
+template <typename Hook>
+void AsyncTracer::guarded(Hook &&hook)
+{
+  // Nobody could catch an exception on this thread; the record is lost, the sink stays.
+  try
+  {
+    hook();
+  }
+  catch (...)
+  {
+    write_errors_.add();
+  }
+}
+
+void AsyncTracer::writer_loop()
+{
+  AsyncRecord record;
+  DropCounts dropped{};
+  for (;;)
+  {
+    std::uint64_t batch = 0;
+    bool begun = false;
+    const auto write = [&](const AsyncRecord &next)
+    {
+      if (!begun)
+        guarded([this]
+                { begin_batch(); });
+      begun = true;
+      guarded([&]
+              { write_record(next); });
+    };
+
+    high_water_.raise(queue_.size_approx());
+    while (queue_.pop(record))
+    {
+      write(record);
+      queue_.release(record);
+      ++batch;
+    }
+
+    // Reported once there is room again, i.e. here rather than by the producer that dropped.
+    if (queue_.take_unreported(dropped))
+    {
+      AsyncRecord notice;
+      notice.when = timestamp_now();
+      notice.header = "Warning: ";
+      notice.severity = TraceSeverity::warning;
+      append_drop_notice(notice.message, dropped);
+      write(notice);
+    }
+
+    if (begun)
+      guarded([this]
+              { end_batch(); });
+    if (batch > 0)
+    {
+      retire(batch);
+      continue;
+    }
+
+    if (stop_.load())
+      break;
+
+    guarded([this]
+            { idle(); });
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    writer_idle_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (queue_.size_approx() == 0 && !stop_.load())
+    {
+      if (idle_wait_.count() > 0)
+        wake_cv_.wait_for(lock, idle_wait_);
+      else
+        wake_cv_.wait(lock);
+    }
+    writer_idle_.store(false, std::memory_order_relaxed);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFileTracer
+// ---------------------------------------------------------------------------
+
+AsyncFileTracer::AsyncFileTracer(const std::string &filepath,
+                                 const RotationConfig &rotation,
+                                 const AsyncConfig &async,
+                                 const FlushPolicy &flush)
+    : AsyncTracer(async, idle_wait(flush)), sink_(filepath, rotation, batched(flush), FileIo::stdio, false),
+      flush_per_batch_(flush.max_buffered_bytes == 0)
+{
+  start_writer();
+}
+
+AsyncFileTracer::~AsyncFileTracer()
+{
+  stop_writer();
+}
+
+void AsyncFileTracer::flush()
+{
+  drain();
+  sink_.flush();
+}
+
+void AsyncFileTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  sink_.collect_stats(out);
+  add_queue_stats(out.back());
+}
+
+void AsyncFileTracer::begin_batch()
+{
+  if (sink_ok_)
+    return;
+  try
+  {
+    sink_.reopen();
+    sink_ok_ = true;
+  }
+  catch (const std::exception &)
+  {
+    // Still failing; the records of this batch are counted as lost.
+  }
+}
+
+void AsyncFileTracer::write_record(const AsyncRecord &record)
+{
+  if (!sink_ok_)
+  {
+    write_errors_.add();
+    return;
+  }
+  try
+  {
+    if (record.fields_offset == std::string::npos)
+    {
+      sink_.write_record(record.when, record.header, text(record), record.urgent);
+    }
+    else
+    {
+      std::string_view message;
+      const std::vector<Field> &pairs = fields(record, message);
+      sink_.write_structured(record.when, record.severity, message, pairs.data(), pairs.size());
+    }
+  }
+  catch (...)
+  {
+    // E.g. the file could not be reopened on rotation; the next batch tries again.
+    sink_ok_ = false;
+    throw;
+  }
+}
+
+void AsyncFileTracer::end_batch()
+{
+  if (!sink_ok_)
+    return;
+  try
+  {
+    if (flush_per_batch_)
+      sink_.flush();
+    else
+      sink_.flush_if_stale();
+  }
+  catch (...)
+  {
+    sink_ok_ = false;
+    throw;
+  }
+}
+
+void AsyncFileTracer::idle()
+{
+  if (!sink_ok_)
+    return;
+  try
+  {
+    sink_.flush_if_stale();
+  }
+  catch (...)
+  {
+    sink_ok_ = false;
+    throw;
+  }
+}
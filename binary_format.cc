@@ -0,0 +1,110 @@
+#include "binary_format.hpp"
+
+#include <atomic>
+#include <cstring>
+
+namespace binlog
+{
+  const char *severity_header(Severity severity)
+  {
+    switch (severity)
+    {
+    case Severity::debug:
+      return "Debug: ";
+    case Severity::warning:
+      return "Warning: ";
+    case Severity::error:
+      return "ERROR: ";
+    case Severity::critical:
+      return "CRITICAL: ";
+    case Severity::fatal:
+      return "*** FATAL ***: ";
+    default:
+      return "";
+    }
+  }
+
+  Severity header_severity(const char *header)
+  {
+    switch (header[0])
+    {
+    case 'D':
+      return Severity::debug;
+    case 'W':
+      return Severity::warning;
+    case 'E':
+      return Severity::error;
+    case 'C':
+      return Severity::critical;
+    case '*':
+      return Severity::fatal;
+    default:
+      return Severity::info;
+    }
+  }
+
+  std::uint32_t thread_number()
+  {
+    static std::atomic<std::uint32_t> next{1};
+    thread_local const std::uint32_t number = next.fetch_add(1, std::memory_order_relaxed);
+    return number;
+  }
+
+  bool expand_args(std::string &out, const unsigned char *compact, std::size_t size)
+  {
+    const unsigned char *cursor = compact;
+    const unsigned char *end = compact + size;
+    while (cursor < end)
+    {
+      const auto type = static_cast<PackedType>(*cursor++);
+      out.push_back(static_cast<char>(type));
+      std::uint64_t value = 0;
+      switch (type)
+      {
+      case PackedType::boolean:
+      case PackedType::character:
+        if (cursor == end)
+          return false;
+        out.push_back(static_cast<char>(*cursor++));
+        break;
+      case PackedType::signed_integer:
+        if (!get_varint(cursor, end, value))
+          return false;
+        detail::put(out, unzigzag(value));
+        break;
+      case PackedType::unsigned_integer:
+        if (!get_varint(cursor, end, value))
+          return false;
+        detail::put(out, value);
+        break;
+      case PackedType::single_float:
+        if (static_cast<std::size_t>(end - cursor) < sizeof(float))
+          return false;
+        out.append(reinterpret_cast<const char *>(cursor), sizeof(float));
+        cursor += sizeof(float);
+        break;
+      case PackedType::double_float:
+        if (static_cast<std::size_t>(end - cursor) < sizeof(double))
+          return false;
+        out.append(reinterpret_cast<const char *>(cursor), sizeof(double));
+        cursor += sizeof(double);
+        break;
+      case PackedType::pointer:
+        if (!get_varint(cursor, end, value))
+          return false;
+        detail::put(out, reinterpret_cast<const void *>(static_cast<std::uintptr_t>(value)));
+        break;
+      case PackedType::string:
+        if (!get_varint(cursor, end, value) || static_cast<std::uint64_t>(end - cursor) < value)
+          return false;
+        detail::put(out, static_cast<std::uint32_t>(value));
+        out.append(reinterpret_cast<const char *>(cursor), static_cast<std::size_t>(value));
+        cursor += value;
+        break;
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+}
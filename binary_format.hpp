@@ -0,0 +1,220 @@
+#pragma once
+
+/*! \file On-disk layout of binary log files, shared by BinaryFileTracer and tinylog-decode.
+ *
+ * A file is a sequence of entries. Every time the writer opens a file it starts with a
+ * header, which also resets the format dictionary and the time base, so files stay
+ * self-contained when appended to or rotated:
+ *
+ *   header:     magic[8] version:u8 byte_order:u16
+ *   definition: 0x01 id:varint length:varint bytes[length]
+ *   record:     0x10+severity delta_ns:zigzag-varint thread:varint format_id:varint
+ *               args_length:varint args[args_length]
+ *
+ * Arguments use the PackedType tags, with integers and string lengths as varints.
+ * Fixed-width values are stored in host byte order.
+ *
+ * The encoders write to any Out with push_back(char) and append(const char *, size_t),
+ * such as std::string or the fixed buffer of the signal-safe flight recorder dump.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "packed_args.hpp"
+
+namespace binlog
+{
+  //! First bytes of every header.
+  inline constexpr char magic[8] = {'\x89', 'T', 'L', 'O', 'G', 'B', '\r', '\n'};
+  //! Layout version written into the header.
+  inline constexpr std::uint8_t version = 1;
+  //! Written in host byte order; a reader on another byte order sees 0x0201.
+  inline constexpr std::uint16_t byte_order_mark = 0x0102;
+  //! Size of magic + version + byte order mark.
+  inline constexpr std::size_t header_size = sizeof(magic) + 1 + sizeof(byte_order_mark);
+
+  //! Entry tags.
+  inline constexpr unsigned char definition_tag = 0x01;
+  inline constexpr unsigned char record_tag = 0x10;
+
+  //! Severity codes stored in the low bits of a record tag.
+  enum class Severity : std::uint8_t
+  {
+    info = 0,
+    debug = 1,
+    warning = 2,
+    error = 3,
+    critical = 4,
+    fatal = 5,
+  };
+
+  //! Text header of a severity, as written by the text tracers.
+  const char *severity_header(Severity severity);
+  //! Severity of a text header, the reverse of severity_header().
+  Severity header_severity(const char *header);
+
+  //! Small per-process number of the calling thread, assigned on first use.
+  std::uint32_t thread_number();
+
+  template <typename Out>
+  void put_varint(Out &out, std::uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      out.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  //! Read a varint; returns false if the input ends first.
+  inline bool get_varint(const unsigned char *&cursor, const unsigned char *end, std::uint64_t &value)
+  {
+    value = 0;
+    for (unsigned shift = 0; cursor < end && shift < 64; shift += 7)
+    {
+      const unsigned char byte = *cursor++;
+      value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  inline std::uint64_t zigzag(std::int64_t value)
+  {
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+  }
+
+  inline std::int64_t unzigzag(std::uint64_t value)
+  {
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+  }
+
+  namespace detail
+  {
+    template <typename T>
+    bool take(const unsigned char *&cursor, const unsigned char *end, T &value)
+    {
+      if (static_cast<std::size_t>(end - cursor) < sizeof(T))
+        return false;
+      std::memcpy(&value, cursor, sizeof(T));
+      cursor += sizeof(T);
+      return true;
+    }
+
+    template <typename Out, typename T>
+    void put(Out &out, const T &value)
+    {
+      out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+  }
+
+  //! Append the header that starts a file.
+  template <typename Out>
+  void put_header(Out &out)
+  {
+    out.append(magic, sizeof(magic));
+    out.push_back(static_cast<char>(version));
+    detail::put(out, byte_order_mark);
+  }
+
+  /**
+   * @brief Re-encode a PackedArgs buffer in the compact on-disk form, appending to out.
+   *
+   * @return false on a malformed buffer.
+   */
+  template <typename Out>
+  bool compact_args(Out &out, const unsigned char *packed, std::size_t size)
+  {
+    const unsigned char *cursor = packed;
+    const unsigned char *end = packed + size;
+    while (cursor < end)
+    {
+      const auto type = static_cast<PackedType>(*cursor++);
+      out.push_back(static_cast<char>(type));
+      switch (type)
+      {
+      case PackedType::boolean:
+      case PackedType::character:
+        if (cursor == end)
+          return false;
+        out.push_back(static_cast<char>(*cursor++));
+        break;
+      case PackedType::signed_integer:
+      {
+        std::int64_t value;
+        if (!detail::take(cursor, end, value))
+          return false;
+        put_varint(out, zigzag(value));
+        break;
+      }
+      case PackedType::unsigned_integer:
+      {
+        std::uint64_t value;
+        if (!detail::take(cursor, end, value))
+          return false;
+        put_varint(out, value);
+        break;
+      }
+      case PackedType::single_float:
+      {
+        float value;
+        if (!detail::take(cursor, end, value))
+          return false;
+        detail::put(out, value);
+        break;
+      }
+      case PackedType::double_float:
+      {
+        double value;
+        if (!detail::take(cursor, end, value))
+          return false;
+        detail::put(out, value);
+        break;
+      }
+      case PackedType::pointer:
+      {
+        const void *value;
+        if (!detail::take(cursor, end, value))
+          return false;
+        put_varint(out, reinterpret_cast<std::uintptr_t>(value));
+        break;
+      }
+      case PackedType::string:
+      {
+        std::uint32_t length;
+        if (!detail::take(cursor, end, length) || static_cast<std::size_t>(end - cursor) < length)
+          return false;
+        put_varint(out, length);
+        out.append(reinterpret_cast<const char *>(cursor), length);
+        cursor += length;
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //! Append a single string argument in compact form.
+  template <typename Out>
+  void compact_string(Out &out, std::string_view text)
+  {
+    out.push_back(static_cast<char>(PackedType::string));
+    put_varint(out, text.size());
+    out.append(text.data(), text.size());
+  }
+
+  /**
+   * @brief Expand compact arguments back into the PackedArgs layout for format_packed().
+   *
+   * @return false on malformed input.
+   */
+  bool expand_args(std::string &out, const unsigned char *compact, std::size_t size);
+}
@@ -0,0 +1,137 @@
+#include "log.hpp"
+
+binlog::Severity binary_severity(TraceSeverity severity)
+{
+  switch (severity)
+  {
+  case TraceSeverity::debug:
+    return binlog::Severity::debug;
+  case TraceSeverity::warning:
+    return binlog::Severity::warning;
+  case TraceSeverity::error:
+    return binlog::Severity::error;
+  case TraceSeverity::critical:
+    return binlog::Severity::critical;
+  default:
+    return binlog::Severity::info;
+  }
+}
+
+namespace
+{
+  //! Format of records that were formatted by the caller.
+  constexpr std::string_view preformatted = "{}";
+
+  //! The time index describes text lines; binary files are read with tinylog-decode.
+  RotationConfig without_time_index(RotationConfig rotation)
+  {
+    rotation.time_index = false;
+    return rotation;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// BinaryFileTracer – construction
+// ---------------------------------------------------------------------------
+
+BinaryFileTracer::BinaryFileTracer(const std::string &filepath, const RotationConfig &rotation,
+                                   const FlushPolicy &flush)
+    : sink_(filepath, without_time_index(rotation), flush)
+{
+}
+
+// ---------------------------------------------------------------------------
+// BinaryFileTracer – encoding
+// ---------------------------------------------------------------------------
+
+void BinaryFileTracer::write(binlog::Severity severity, std::string_view format, const PackedArgs *args,
+                             std::string_view message)
+{
+  const std::int64_t when = timestamp_now();
+  const std::uint32_t thread = binlog::thread_number();
+  std::lock_guard<std::mutex> lock(mutex_);
+  entry_.clear();
+  args_.clear();
+  if (args)
+    binlog::compact_args(args_, args->data(), args->size());
+  else
+    binlog::compact_string(args_, message);
+
+  // A new file needs its own header and dictionary.
+  if (sink_.files_opened() != file_generation_)
+  {
+    file_generation_ = sink_.files_opened();
+    formats_.clear();
+    last_when_ = 0;
+    binlog::put_header(entry_);
+  }
+
+  const auto [it, inserted] = formats_.try_emplace(format.data(), static_cast<std::uint32_t>(formats_.size()));
+  if (inserted)
+  {
+    entry_.push_back(static_cast<char>(binlog::definition_tag));
+    binlog::put_varint(entry_, it->second);
+    binlog::put_varint(entry_, format.size());
+    entry_.append(format);
+  }
+
+  entry_.push_back(static_cast<char>(binlog::record_tag + static_cast<std::uint8_t>(severity)));
+  binlog::put_varint(entry_, binlog::zigzag(when - last_when_));
+  last_when_ = when;
+  binlog::put_varint(entry_, thread);
+  binlog::put_varint(entry_, it->second);
+  binlog::put_varint(entry_, args_.size());
+  entry_.append(args_);
+  sink_.write_raw(entry_, severity >= binlog::Severity::error);
+}
+
+// ---------------------------------------------------------------------------
+// BinaryFileTracer – severity methods
+// ---------------------------------------------------------------------------
+
+void BinaryFileTracer::Info(const std::string &message)
+{
+  write(binlog::Severity::info, preformatted, nullptr, message);
+}
+
+void BinaryFileTracer::Debug(const std::string &message)
+{
+  write(binlog::Severity::debug, preformatted, nullptr, message);
+}
+
+void BinaryFileTracer::Warning(const std::string &message)
+{
+  write(binlog::Severity::warning, preformatted, nullptr, message);
+}
+
+void BinaryFileTracer::Error(const std::string &message)
+{
+  write(binlog::Severity::error, preformatted, nullptr, message);
+}
+
+void BinaryFileTracer::Critical(const std::string &message)
+{
+  write(binlog::Severity::critical, preformatted, nullptr, message);
+}
+
+void BinaryFileTracer::Fatal(const std::string &message)
+{
+  write(binlog::Severity::fatal, preformatted, nullptr, message);
+  flush();
+}
+
+void BinaryFileTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  write(binary_severity(severity), preformatted, nullptr, message);
+}
+
+void BinaryFileTracer::flush()
+{
+  sink_.flush();
+}
+
+bool BinaryFileTracer::Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args)
+{
+  write(binary_severity(severity), format, &args, {});
+  return true;
+}
@@ -0,0 +1,206 @@
+#include "callsite.hpp"
+
+#include "log.hpp"
+
+#include <mutex>
+
+namespace
+{
+  //! A set_callsite_mode() call, kept for callsites that register later.
+  struct Rule
+  {
+    CallsiteFilter filter;
+    CallsiteMode mode;
+  };
+
+  //! Newest registered callsite.
+  std::atomic<Callsite *> callsites{nullptr};
+  //! Bumped by every configuration change, so a registering callsite can tell it raced one.
+  std::atomic<std::uint64_t> generation{0};
+
+  //! Guards rules(). Taken by registering callsites too, so that changes may replace and free rules.
+  std::mutex &rules_mutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  //! At most one rule per filter, newest last. Never destroyed: statements may run during exit.
+  std::vector<Rule> &rules()
+  {
+    static auto *list = new std::vector<Rule>;
+    return *list;
+  }
+
+  //! Glob match with '*' and '?'.
+  bool glob_match(std::string_view pattern, std::string_view text)
+  {
+    std::size_t p = 0, t = 0;
+    std::size_t star = std::string_view::npos, resume = 0;
+    while (t < text.size())
+    {
+      if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+      {
+        ++p;
+        ++t;
+      }
+      else if (p < pattern.size() && pattern[p] == '*')
+      {
+        star = p++;
+        resume = t;
+      }
+      else if (star != std::string_view::npos)
+      {
+        p = star + 1;
+        t = ++resume;
+      }
+      else
+        return false;
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+      ++p;
+    return p == pattern.size();
+  }
+
+  //! Caller holds rules_mutex().
+  CallsiteMode mode_for(const Callsite &site)
+  {
+    // The newest matching rule wins.
+    const std::vector<Rule> &list = rules();
+    for (auto rule = list.rbegin(); rule != list.rend(); ++rule)
+    {
+      if (rule->filter.matches(site))
+        return rule->mode;
+    }
+    return CallsiteMode::follow;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// CallsiteFilter
+// ---------------------------------------------------------------------------
+
+bool CallsiteFilter::matches(const Callsite &site) const
+{
+  if (line != 0 && line != site.line())
+    return false;
+  if (!file.empty())
+  {
+    const std::string_view path = site.file();
+    const std::size_t slash = path.find_last_of("/\\");
+    const std::string_view base = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    if (!glob_match(file, path) && !glob_match(file, base))
+      return false;
+  }
+  if (!function.empty() && !glob_match(function, site.function()))
+    return false;
+  return format.empty() || glob_match(format, site.format());
+}
+
+// ---------------------------------------------------------------------------
+// Callsite – registration
+// ---------------------------------------------------------------------------
+
+bool Callsite::first_use()
+{
+  Logger &logger = Log::get(logger_name_ ? logger_name_ : "");
+  if (claimed_.exchange(true, std::memory_order_acq_rel))
+  {
+    // Another thread is registering the callsite; decide without publishing anything.
+    const std::uint8_t state = state_.load(std::memory_order_acquire);
+    if (state != state_unregistered)
+      return state == state_on;
+    std::lock_guard<std::mutex> lock(rules_mutex());
+    return decide(mode_for(*this), logger);
+  }
+
+  logger_ = &logger;
+  Callsite *head = callsites.load(std::memory_order_relaxed);
+  do
+    next_ = head;
+  while (!callsites.compare_exchange_weak(head, this, std::memory_order_seq_cst, std::memory_order_relaxed));
+
+  // A change that bumped the generation before the push might not have seen this callsite.
+  for (;;)
+  {
+    const std::uint64_t seen = generation.load(std::memory_order_seq_cst);
+    std::unique_lock<std::mutex> lock(rules_mutex());
+    const CallsiteMode mode = mode_for(*this);
+    lock.unlock();
+    mode_.store(mode, std::memory_order_relaxed);
+    state_.store(decide(mode, logger) ? state_on : state_off, std::memory_order_seq_cst);
+    if (generation.load(std::memory_order_seq_cst) == seen)
+      break;
+  }
+  return state_.load(std::memory_order_relaxed) == state_on;
+}
+
+bool Callsite::decide(CallsiteMode mode, const Logger &logger) const
+{
+  switch (mode)
+  {
+  case CallsiteMode::on:
+    return true;
+  case CallsiteMode::off:
+    return false;
+  default:
+    return logger.is_severity_enabled(severity_);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Registry
+// ---------------------------------------------------------------------------
+
+void refresh_callsites()
+{
+  std::lock_guard<std::mutex> lock(rules_mutex());
+  generation.fetch_add(1, std::memory_order_seq_cst);
+  for (Callsite *site = callsites.load(std::memory_order_seq_cst); site; site = site->next_)
+  {
+    // From the rules rather than mode_, which a callsite still registering may not have set yet.
+    const CallsiteMode mode = mode_for(*site);
+    site->mode_.store(mode, std::memory_order_relaxed);
+    site->state_.store(site->decide(mode, *site->logger_) ? Callsite::state_on : Callsite::state_off,
+                       std::memory_order_relaxed);
+  }
+}
+
+std::size_t set_callsite_mode(const CallsiteFilter &filter, CallsiteMode mode)
+{
+  std::lock_guard<std::mutex> lock(rules_mutex());
+  // Setting the same filter again replaces its rule, so toggling a statement does not add up.
+  std::vector<Rule> &list = rules();
+  std::erase_if(list, [&filter](const Rule &rule)
+                { return rule.filter == filter; });
+  list.push_back({filter, mode});
+  generation.fetch_add(1, std::memory_order_seq_cst);
+  std::size_t matched = 0;
+  for (Callsite *site = callsites.load(std::memory_order_seq_cst); site; site = site->next_)
+  {
+    if (!filter.matches(*site))
+      continue;
+    ++matched;
+    site->mode_.store(mode, std::memory_order_relaxed);
+    site->state_.store(site->decide(mode, *site->logger_) ? Callsite::state_on : Callsite::state_off,
+                       std::memory_order_relaxed);
+  }
+  return matched;
+}
+
+void clear_callsite_modes()
+{
+  {
+    std::lock_guard<std::mutex> lock(rules_mutex());
+    std::vector<Rule>().swap(rules());
+  }
+  refresh_callsites();
+}
+
+std::vector<const Callsite *> registered_callsites()
+{
+  std::vector<const Callsite *> sites;
+  for (const Callsite *site = callsites.load(std::memory_order_acquire); site; site = site->next_)
+    sites.push_back(site);
+  return sites;
+}
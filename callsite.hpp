@@ -0,0 +1,131 @@
+#pragma once
+
+/*! \file Registry of LOG_* statements, so single statements can be switched on or off at runtime. */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class TraceSeverity;
+class Logger;
+struct CallsiteFilter;
+
+//! How a callsite decides whether to log.
+enum class CallsiteMode : std::uint8_t
+{
+  //! Log if the severity is enabled on the callsite's logger.
+  follow,
+  //! Always log, whatever the enabled severities.
+  on,
+  //! Never log.
+  off,
+};
+
+/**
+ * @brief One LOG_* statement: where it is and whether it currently logs.
+ *
+ * Every expansion of the logging macros holds one in static storage, constant-initialized.
+ * It joins a lock-free list the first time it runs; from then on the check is one load
+ * of its state byte, which configuration changes rewrite for every registered callsite.
+ */
+class Callsite
+{
+public:
+  /**
+   * @param format the statement's format string literal, or message for key-value statements
+   * @param logger name of the statement's named logger; nullptr for the root
+   */
+  constexpr Callsite(const char *file, int line, const char *function, std::string_view format,
+                     TraceSeverity severity, const char *logger = nullptr)
+      : file_(file), line_(line), function_(function), format_(format), severity_(severity), logger_name_(logger)
+  {
+  }
+
+  Callsite(const Callsite &) = delete;
+  Callsite &operator=(const Callsite &) = delete;
+
+  //! Whether the statement logs; registers the callsite on first use.
+  bool enabled()
+  {
+    const std::uint8_t state = state_.load(std::memory_order_relaxed);
+    if (state == state_off)
+      return false;
+    return state == state_on || first_use();
+  }
+
+  const char *file() const { return file_; }
+  int line() const { return line_; }
+  const char *function() const { return function_; }
+  std::string_view format() const { return format_; }
+  TraceSeverity severity() const { return severity_; }
+  //! Name of the statement's logger; empty for the root.
+  std::string_view logger() const { return logger_name_ ? logger_name_ : ""; }
+  CallsiteMode mode() const { return mode_.load(std::memory_order_relaxed); }
+
+private:
+  friend void refresh_callsites();
+  friend std::size_t set_callsite_mode(const CallsiteFilter &filter, CallsiteMode mode);
+  friend std::vector<const Callsite *> registered_callsites();
+
+  static constexpr std::uint8_t state_off = 0;
+  static constexpr std::uint8_t state_on = 1;
+  static constexpr std::uint8_t state_unregistered = 2;
+
+  //! Join the registry, apply matching rules and decide; returns whether to log this call.
+  bool first_use();
+  //! Whether to log under a mode and the logger's enabled severities.
+  bool decide(CallsiteMode mode, const Logger &logger) const;
+
+  const char *file_;
+  int line_;
+  const char *function_;
+  std::string_view format_;
+  TraceSeverity severity_;
+  const char *logger_name_;
+  //! Resolved by the thread that registers the callsite.
+  Logger *logger_ = nullptr;
+  std::atomic<CallsiteMode> mode_{CallsiteMode::follow};
+  std::atomic<std::uint8_t> state_{state_unregistered};
+  //! Claimed by the thread that registers the callsite.
+  std::atomic<bool> claimed_{false};
+  //! Next older registered callsite.
+  Callsite *next_ = nullptr;
+};
+
+/**
+ * @brief Selects callsites for Log::set_callsites().
+ *
+ * Patterns may use '*' for any run of characters and '?' for one; empty ones match everything.
+ */
+struct CallsiteFilter
+{
+  //! Source path, or just its file name, e.g. "http.cc" or "*/net/*".
+  std::string file;
+  //! Function name, e.g. "send_request".
+  std::string function;
+  //! Format string, e.g. "*retry*".
+  std::string format;
+  //! Source line; 0 for any.
+  int line = 0;
+
+  bool matches(const Callsite &site) const;
+  bool operator==(const CallsiteFilter &) const = default;
+};
+
+//! Recompute the state of every registered callsite after the enabled severities changed.
+//! Callers serialize configuration changes.
+void refresh_callsites();
+
+//! Set the mode of matching callsites, including ones registered later; replaces an earlier rule of an equal filter.
+//! Callers serialize configuration changes. Returns the number of registered callsites that matched.
+std::size_t set_callsite_mode(const CallsiteFilter &filter, CallsiteMode mode);
+
+//! Drop every set_callsite_mode() rule; all callsites follow their severities again.
+//! Callers serialize configuration changes.
+void clear_callsite_modes();
+
+//! Every registered callsite, newest first. Callsites live in static storage.
+std::vector<const Callsite *> registered_callsites();
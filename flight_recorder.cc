@@ -0,0 +1,440 @@
+#include "flight_recorder.hpp"
+#include "timestamp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  struct RecordHeader
+  {
+    //! Position in the ring's sequence of records, used to detect overwritten slots.
+    std::uint64_t index;
+    std::int64_t when;
+    const char *format;
+    std::uint32_t format_length;
+    std::uint32_t thread;
+    std::uint16_t size;
+    binlog::Severity severity;
+  };
+
+  struct alignas(64) Slot
+  {
+    //! Odd while the owning thread writes the slot.
+    std::atomic<std::uint32_t> sequence{0};
+    RecordHeader header;
+    unsigned char data[PackedArgs::capacity];
+  };
+
+  //! A slot copied out of a ring.
+  struct Record
+  {
+    RecordHeader header;
+    unsigned char data[PackedArgs::capacity];
+  };
+
+  //! Records of one thread. Rings are never freed; exited threads leave theirs for reuse.
+  struct Ring
+  {
+    explicit Ring(std::size_t capacity)
+        : slots(new Slot[capacity]), mask(capacity - 1)
+    {
+    }
+
+    Slot *const slots;
+    const std::size_t mask;
+    //! Number of records written; stored by the owning thread only.
+    std::atomic<std::uint64_t> head{0};
+    //! Claimed by a live thread.
+    std::atomic<bool> owned{false};
+    Ring *next = nullptr;
+  };
+
+  std::atomic<Ring *> rings{nullptr};
+  std::atomic<std::size_t> ring_capacity{512};
+
+  //! Configured dump path, kept in static storage for the signal handler.
+  char dump_path[4096] = "flight_recorder.bin";
+
+  Ring &claim_ring()
+  {
+    for (Ring *ring = rings.load(std::memory_order_acquire); ring; ring = ring->next)
+    {
+      if (!ring->owned.load(std::memory_order_relaxed) && !ring->owned.exchange(true, std::memory_order_acquire))
+        return *ring;
+    }
+    auto *ring = new Ring(ring_capacity.load(std::memory_order_relaxed));
+    ring->owned.store(true, std::memory_order_relaxed);
+    ring->next = rings.load(std::memory_order_relaxed);
+    while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+      ;
+    return *ring;
+  }
+
+  struct RingOwner
+  {
+    Ring &ring = claim_ring();
+    const std::uint32_t thread = binlog::thread_number();
+    ~RingOwner()
+    {
+      ring.owned.store(false, std::memory_order_release);
+    }
+  };
+
+  RingOwner &this_thread_ring()
+  {
+    thread_local RingOwner owner;
+    return owner;
+  }
+
+  // -------------------------------------------------------------------------
+  // Dump – everything below runs in signal handlers and uses static storage only
+  // -------------------------------------------------------------------------
+
+  //! Buffered output over a file descriptor with the push_back/append interface of the binlog encoders.
+  class DumpWriter
+  {
+  public:
+    void reset(int fd)
+    {
+      fd_ = fd;
+      used_ = 0;
+      ok_ = true;
+    }
+
+    void push_back(char c)
+    {
+      if (used_ == sizeof(buffer_))
+        flush();
+      buffer_[used_++] = c;
+    }
+
+    void append(const char *data, std::size_t size)
+    {
+      while (size > 0)
+      {
+        if (used_ == sizeof(buffer_))
+          flush();
+        const std::size_t chunk = size < sizeof(buffer_) - used_ ? size : sizeof(buffer_) - used_;
+        std::memcpy(buffer_ + used_, data, chunk);
+        used_ += chunk;
+        data += chunk;
+        size -= chunk;
+      }
+    }
+
+    bool flush()
+    {
+      const char *data = buffer_;
+      std::size_t size = used_;
+      used_ = 0;
+      while (ok_ && size > 0)
+      {
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+        const int written = _write(fd_, data, static_cast<unsigned>(size));
+#else
+        const ssize_t written = ::write(fd_, data, size);
+        if (written < 0 && errno == EINTR)
+          continue;
+#endif
+        if (written <= 0)
+        {
+          ok_ = false;
+          break;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+      }
+      return ok_;
+    }
+
+  private:
+    int fd_ = -1;
+    char buffer_[8192];
+    std::size_t used_ = 0;
+    bool ok_ = true;
+  };
+
+  //! Compact arguments of one record; varints can grow a value by up to two bytes.
+  struct ArgsBuffer
+  {
+    void push_back(char c) { data[size++] = c; }
+    void append(const char *bytes, std::size_t length)
+    {
+      std::memcpy(data + size, bytes, length);
+      size += length;
+    }
+
+    char data[PackedArgs::capacity * 2];
+    std::size_t size = 0;
+  };
+
+  //! Position of a dump in one ring.
+  struct Cursor
+  {
+    const Ring *ring;
+    std::uint64_t next;
+    std::uint64_t end;
+    Record record;
+  };
+
+  //! Rings beyond this many are left out of a dump.
+  constexpr std::size_t max_dump_rings = 1024;
+  //! Format ids of a dump, keyed by address; open addressing, power of two.
+  constexpr std::size_t format_table_size = 4096;
+
+  struct FormatId
+  {
+    const char *format;
+    std::uint32_t id;
+  };
+
+  std::atomic<bool> dumping{false};
+  DumpWriter writer;
+  Cursor cursors[max_dump_rings];
+  FormatId format_ids[format_table_size];
+  std::uint32_t next_format_id = 0;
+
+  //! Copy a record out of a ring; false if it is being written or was overwritten.
+  bool read_slot(const Ring &ring, std::uint64_t index, Record &out)
+  {
+    const Slot &slot = ring.slots[index & ring.mask];
+    const std::uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1)
+      return false;
+    out.header = slot.header;
+    if (out.header.index != index || out.header.size > sizeof(out.data))
+      return false;
+    std::memcpy(out.data, slot.data, out.header.size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == before;
+  }
+
+  //! Load the next readable record of a ring into the cursor; false at the end.
+  bool advance(Cursor &cursor)
+  {
+    while (cursor.next < cursor.end)
+    {
+      if (read_slot(*cursor.ring, cursor.next++, cursor.record))
+        return true;
+    }
+    return false;
+  }
+
+  //! Id of a format string; true if it has not been defined in this dump yet.
+  bool format_id(const char *format, std::uint32_t &id)
+  {
+    std::size_t i = static_cast<std::size_t>((reinterpret_cast<std::uintptr_t>(format) * 0x9e3779b97f4a7c15ull) >> 52);
+    for (std::size_t probe = 0; probe < format_table_size; ++probe, ++i)
+    {
+      FormatId &entry = format_ids[i & (format_table_size - 1)];
+      if (entry.format == format)
+      {
+        id = entry.id;
+        return false;
+      }
+      if (!entry.format)
+      {
+        entry = {format, next_format_id++};
+        id = entry.id;
+        return true;
+      }
+    }
+    // Table full: define the format again under a new id.
+    id = next_format_id++;
+    return true;
+  }
+
+  void write_record(const Record &record, std::int64_t &last_when)
+  {
+    std::uint32_t id;
+    if (format_id(record.header.format, id))
+    {
+      writer.push_back(static_cast<char>(binlog::definition_tag));
+      binlog::put_varint(writer, id);
+      binlog::put_varint(writer, record.header.format_length);
+      writer.append(record.header.format, record.header.format_length);
+    }
+    ArgsBuffer args;
+    if (!binlog::compact_args(args, record.data, record.header.size))
+      return;
+    writer.push_back(static_cast<char>(binlog::record_tag + static_cast<std::uint8_t>(record.header.severity)));
+    binlog::put_varint(writer, binlog::zigzag(record.header.when - last_when));
+    last_when = record.header.when;
+    binlog::put_varint(writer, record.header.thread);
+    binlog::put_varint(writer, id);
+    binlog::put_varint(writer, args.size);
+    writer.append(args.data, args.size);
+  }
+
+  int open_dump(const char *path)
+  {
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+  }
+
+  void close_dump(int fd)
+  {
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+  }
+
+  // -------------------------------------------------------------------------
+  // Fatal signals
+  // -------------------------------------------------------------------------
+
+  constexpr int fatal_signals[] = {
+      SIGSEGV, SIGFPE, SIGILL, SIGABRT,
+#ifdef SIGBUS
+      SIGBUS,
+#endif
+  };
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  void (*previous_handlers[NSIG])(int);
+
+  void on_fatal_signal(int signal)
+  {
+    dump_flight_recorder();
+    std::signal(signal, previous_handlers[signal] ? previous_handlers[signal] : SIG_DFL);
+    std::raise(signal);
+  }
+
+  void install_signal_handlers()
+  {
+    for (const int signal : fatal_signals)
+    {
+      previous_handlers[signal] = std::signal(signal, on_fatal_signal);
+      if (previous_handlers[signal] == SIG_ERR)
+        previous_handlers[signal] = SIG_DFL;
+    }
+  }
+#else
+  struct sigaction previous_actions[NSIG];
+
+  void on_fatal_signal(int signal)
+  {
+    dump_flight_recorder();
+    // The signal stays blocked until we return, then the previous disposition handles it.
+    sigaction(signal, &previous_actions[signal], nullptr);
+    raise(signal);
+  }
+
+  void install_signal_handlers()
+  {
+    struct sigaction action = {};
+    action.sa_handler = on_fatal_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_ONSTACK;
+    for (const int signal : fatal_signals)
+      sigaction(signal, &action, &previous_actions[signal]);
+  }
+#endif
+}
+
+void set_flight_recorder_config(const FlightRecorderConfig &config)
+{
+  std::size_t capacity = 2;
+  while (capacity < config.records_per_thread)
+    capacity *= 2;
+  ring_capacity.store(capacity, std::memory_order_relaxed);
+
+  const std::size_t length = std::min(config.path.size(), sizeof(dump_path) - 1);
+  std::memcpy(dump_path, config.path.data(), length);
+  dump_path[length] = '\0';
+
+  if (config.dump_on_signal)
+  {
+    static std::once_flag installed;
+    std::call_once(installed, install_signal_handlers);
+  }
+}
+
+void flight_record(binlog::Severity severity, std::string_view format, const PackedArgs &args)
+{
+  RingOwner &owner = this_thread_ring();
+  Ring &ring = owner.ring;
+  const std::int64_t when = timestamp_now();
+  const std::uint64_t index = ring.head.load(std::memory_order_relaxed);
+  Slot &slot = ring.slots[index & ring.mask];
+  const std::uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.header = {index,
+                 when,
+                 format.data(),
+                 static_cast<std::uint32_t>(format.size()),
+                 owner.thread,
+                 static_cast<std::uint16_t>(args.size()),
+                 severity};
+  std::memcpy(slot.data, args.data(), args.size());
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  ring.head.store(index + 1, std::memory_order_release);
+}
+
+bool dump_flight_recorder(const char *path)
+{
+  if (dumping.exchange(true, std::memory_order_acquire))
+    return false;
+  const int fd = open_dump(path ? path : dump_path);
+  if (fd < 0)
+  {
+    dumping.store(false, std::memory_order_release);
+    return false;
+  }
+  writer.reset(fd);
+  binlog::put_header(writer);
+  std::memset(format_ids, 0, sizeof(format_ids));
+  next_format_id = 0;
+
+  // Snapshot every ring's range; records written from now on are not part of the dump.
+  std::size_t count = 0;
+  for (const Ring *ring = rings.load(std::memory_order_acquire); ring && count < max_dump_rings; ring = ring->next)
+  {
+    Cursor &cursor = cursors[count];
+    cursor.ring = ring;
+    cursor.end = ring->head.load(std::memory_order_acquire);
+    cursor.next = cursor.end > ring->mask + 1 ? cursor.end - (ring->mask + 1) : 0;
+    if (advance(cursor))
+      ++count;
+  }
+
+  // Merge the per-thread rings into one timeline.
+  std::int64_t last_when = 0;
+  while (count > 0)
+  {
+    std::size_t oldest = 0;
+    for (std::size_t i = 1; i < count; ++i)
+    {
+      if (cursors[i].record.header.when < cursors[oldest].record.header.when)
+        oldest = i;
+    }
+    write_record(cursors[oldest].record, last_when);
+    if (!advance(cursors[oldest]))
+      cursors[oldest] = cursors[--count];
+  }
+
+  const bool ok = writer.flush();
+  close_dump(fd);
+  dumping.store(false, std::memory_order_release);
+  return ok;
+}
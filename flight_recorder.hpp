@@ -0,0 +1,50 @@
+#pragma once
+
+/*! \file Always-on per-thread ring of recent log calls, dumped in the binary log format.
+ *
+ * Every thread records into its own ring, so recording takes no lock and shares no cache
+ * line with other threads. Records hold the format string address and the packed
+ * arguments; nothing is formatted until tinylog-decode reads a dump.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "binary_format.hpp"
+#include "packed_args.hpp"
+
+//! Flight recorder settings.
+struct FlightRecorderConfig
+{
+  //! Records kept per thread, rounded up to a power of two. Applies to rings created afterwards.
+  std::size_t records_per_thread = 512;
+  //! File written by a dump, replaced every time.
+  std::string path = "flight_recorder.bin";
+  //! Dump on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT, then hand the signal to the previous handler.
+  bool dump_on_signal = true;
+};
+
+//! Apply a configuration and install the signal handlers if asked to; does not start recording by itself.
+void set_flight_recorder_config(const FlightRecorderConfig &config);
+
+/**
+ * @brief Record one call in the calling thread's ring.
+ *
+ * @param format a format string with static storage duration
+ * @param args the packed arguments
+ */
+void flight_record(binlog::Severity severity, std::string_view format, const PackedArgs &args);
+
+/**
+ * @brief Write the records of all threads, oldest first, as a binary log file.
+ *
+ * Async-signal-safe: uses only static buffers and open/write/close. Records being
+ * overwritten while the dump runs are skipped. A dump started while another one is
+ * running returns false.
+ *
+ * @param path output file; nullptr for the configured path
+ * @return false if the file could not be written.
+ */
+bool dump_flight_recorder(const char *path = nullptr);
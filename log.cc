@@ -1,439 +1,1434 @@
-#include "log.hpp"
-#include <chrono>
-#include <ctime>
-#include <sstream>
-#include <vector>
-#include <algorithm>
-#include <stdexcept>
-
-#include <zstd.h>
-
-namespace
-{
-  std::string current_timestamp()
-  {
-    std::time_t now = std::time(nullptr);
-    std::tm tm_snapshot{};
-#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
-    localtime_s(&tm_snapshot, &now);
-#else
-    localtime_r(&now, &tm_snapshot);
-#endif
-    std::ostringstream oss;
-    oss << std::put_time(&tm_snapshot, "[%Y-%m-%d %H:%M:%S] ");
-    return oss.str();
-  }
-}
-
-void VoidTracer::Info(const std::string &message) {}
-void VoidTracer::Debug(const std::string &message) {}
-void VoidTracer::Warning(const std::string &message) {}
-void VoidTracer::Critical(const std::string &message) {}
-void VoidTracer::Error(const std::string &message) {}
-void VoidTracer::Fatal(const std::string &message) {}
-
-// ---------------------------------------------------------------------------
-// FileTracer – construction / destruction
-// ---------------------------------------------------------------------------
-
-FileTracer::FileTracer(const std::string &filepath, const RotationConfig &rotation)
-    : filepath_(filepath), rotation_(rotation)
-{
-  open_log_file();
-}
-
-FileTracer::~FileTracer()
-{
-  if (file_handle_.is_open())
-    file_handle_.close();
-}
-
-void FileTracer::open_log_file()
-{
-  file_handle_ = std::ofstream(filepath_, std::ios::app | std::ios::binary);
-  if (!file_handle_.is_open())
-  {
-    throw std::runtime_error("Failed to open log file: " + filepath_.string());
-  }
-  // Track existing file size so rotation triggers correctly on an append.
-  if (std::filesystem::exists(filepath_))
-  {
-    current_size_ = static_cast<std::size_t>(std::filesystem::file_size(filepath_));
-  }
-  else
-  {
-    current_size_ = 0;
-  }
-}
-
-// ---------------------------------------------------------------------------
-// FileTracer – rotation helpers
-// ---------------------------------------------------------------------------
-
-void FileTracer::maybe_rotate()
-{
-  if (rotation_.max_file_size == 0)
-    return; // rotation disabled
-  if (current_size_ >= rotation_.max_file_size)
-    rotate();
-}
-
-void FileTracer::rotate()
-{
-  // Close the current file before renaming.
-  if (file_handle_.is_open())
-    file_handle_.close();
-
-  // Shift existing backups:  log.N -> log.N+1  (highest first to avoid collisions).
-  // We look for both plain and .zst variants.
-  const auto stem = filepath_.stem().string();
-  const auto ext  = filepath_.extension().string();
-  const auto dir  = filepath_.parent_path().empty() ? std::filesystem::current_path() : filepath_.parent_path();
-
-  // Shift existing backups upward.
-  // Start from max_backup_count-1 down to 1 so nothing is overwritten.
-  if (rotation_.max_backup_count > 0)
-  {
-    for (std::size_t i = rotation_.max_backup_count - 1; i >= 1; --i)
-    {
-      auto src_plain = dir / (stem + "." + std::to_string(i) + ext);
-      auto src_zst   = dir / (stem + "." + std::to_string(i) + ext + ".zst");
-      auto dst_plain = dir / (stem + "." + std::to_string(i + 1) + ext);
-      auto dst_zst   = dir / (stem + "." + std::to_string(i + 1) + ext + ".zst");
-
-      std::error_code ec;
-      if (std::filesystem::exists(src_zst, ec))
-        std::filesystem::rename(src_zst, dst_zst, ec);
-      else if (std::filesystem::exists(src_plain, ec))
-        std::filesystem::rename(src_plain, dst_plain, ec);
-    }
-  }
-
-  // Rename the current active file to .1
-  {
-    auto dst = dir / (stem + ".1" + ext);
-    std::error_code ec;
-    std::filesystem::rename(filepath_, dst, ec);
-
-    // Compress the freshly-rotated file if requested.
-    if (!ec && rotation_.compress)
-    {
-      compress_file_zstd(dst);
-    }
-  }
-
-  prune_old_backups();
-
-  // Re-open a fresh active log file.
-  open_log_file();
-}
-
-bool FileTracer::compress_file_zstd(const std::filesystem::path &src)
-{
-  // Read the entire source file into memory.
-  std::ifstream ifs(src, std::ios::binary | std::ios::ate);
-  if (!ifs.is_open())
-    return false;
-
-  const auto src_size = static_cast<std::size_t>(ifs.tellg());
-  ifs.seekg(0, std::ios::beg);
-
-  std::vector<char> src_buf(src_size);
-  if (!ifs.read(src_buf.data(), static_cast<std::streamsize>(src_size)))
-    return false;
-  ifs.close();
-
-  // Allocate destination buffer.
-  const std::size_t dst_capacity = ZSTD_compressBound(src_size);
-  std::vector<char> dst_buf(dst_capacity);
-
-  // Compress at maximum level.
-  const int max_level = ZSTD_maxCLevel();
-  const std::size_t compressed_size =
-      ZSTD_compress(dst_buf.data(), dst_capacity,
-                    src_buf.data(), src_size,
-                    max_level);
-
-  if (ZSTD_isError(compressed_size))
-    return false;
-
-  // Write compressed data alongside the original name with .zst suffix.
-  const auto dst_path = std::filesystem::path(src.string() + ".zst");
-  std::ofstream ofs(dst_path, std::ios::binary | std::ios::trunc);
-  if (!ofs.is_open())
-    return false;
-
-  ofs.write(dst_buf.data(), static_cast<std::streamsize>(compressed_size));
-  ofs.close();
-
-  // Remove the uncompressed source.
-  std::error_code ec;
-  std::filesystem::remove(src, ec);
-  return true;
-}
-
-void FileTracer::prune_old_backups()
-{
-  if (rotation_.max_backup_count == 0)
-    return; // unlimited
-
-  const auto stem = filepath_.stem().string();
-  const auto ext  = filepath_.extension().string();
-  const auto dir  = filepath_.parent_path().empty() ? std::filesystem::current_path() : filepath_.parent_path();
-
-  for (std::size_t i = rotation_.max_backup_count + 1; ; ++i)
-  {
-    auto plain = dir / (stem + "." + std::to_string(i) + ext);
-    auto zst   = dir / (stem + "." + std::to_string(i) + ext + ".zst");
-    std::error_code ec;
-    bool removed = false;
-    if (std::filesystem::exists(plain, ec)) { std::filesystem::remove(plain, ec); removed = true; }
-    if (std::filesystem::exists(zst, ec))   { std::filesystem::remove(zst, ec);   removed = true; }
-    if (!removed)
-      break; // no more old backups to prune
-  }
-}
-
-// ---------------------------------------------------------------------------
-// FileTracer – severity methods
-// ---------------------------------------------------------------------------
-
-void FileTracer::Info(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  const std::string line = current_timestamp() + message;
-  file_handle_ << line;
-  file_handle_.flush();
-  current_size_ += line.size();
-  maybe_rotate();
-}
-
-void FileTracer::Debug(const std::string &message)
-{  
-  std::string header("Debug: ");
-  Info(header + message);
-}
-
-void FileTracer::Warning(const std::string &message)
-{ 
-  std::string header("Warning: ");
-  Info(header + message);
-}
-
-void FileTracer::Critical(const std::string &message)
-{ 
-  std::string header("CRITICAL: ");
-  Info(header + message);
-}
-
-void FileTracer::Error(const std::string &message)
-{
-  std::string header("ERROR: ");
-  Info(header + message);
-}
-
-void FileTracer::Fatal(const std::string &message)
-{
-  std::string header("*** FATAL ***: ");
-  Info(header + message);
-}
-
-#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
-
-void ConsoleTracer::write_impl(const std::string &formatted)
-{
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  DWORD dwBytesWritten;
-  WriteConsoleA(std_out_, formatted.c_str(), static_cast<DWORD>(formatted.length()), &dwBytesWritten, NULL);
-}
-
-void ConsoleTracer::Info(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  SetConsoleTextAttribute(std_out_, FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE);
-  write_impl(current_timestamp() + message);
-}
-
-void ConsoleTracer::Debug(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  SetConsoleTextAttribute(std_out_, FOREGROUND_INTENSITY | FOREGROUND_GREEN);
-  write_impl(current_timestamp() + "Debug: " + message);
-}
-
-void ConsoleTracer::Warning(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  SetConsoleTextAttribute(std_out_, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
-  write_impl(current_timestamp() + "Warning: " + message);
-}
-
-void ConsoleTracer::Error(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  SetConsoleTextAttribute(std_out_, FOREGROUND_INTENSITY | FOREGROUND_RED);
-  write_impl(current_timestamp() + "ERROR: " + message);
-}
-
-void ConsoleTracer::Critical(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  SetConsoleTextAttribute(std_out_, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE);
-  write_impl(current_timestamp() + "CRITICAL: " + message);
-}
-
-void ConsoleTracer::Fatal(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  if (std_out_ == INVALID_HANDLE_VALUE)
-    return;
-  SetConsoleTextAttribute(std_out_, BACKGROUND_RED | FOREGROUND_INTENSITY | FOREGROUND_RED);
-  write_impl(current_timestamp() + "*** FATAL ***: " + message);
-  SetConsoleTextAttribute(std_out_, FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
-}
-
-#else
-
-void ConsoleTracer::write_impl(const std::string &formatted)
-{
-  std::cout << formatted;
-}
-
-void ConsoleTracer::Info(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  write_impl(current_timestamp() + message);
-}
-
-void ConsoleTracer::Debug(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  write_impl(current_timestamp() + "Debug: " + message);
-}
-
-void ConsoleTracer::Warning(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  write_impl(current_timestamp() + "Warning: " + message);
-}
-
-void ConsoleTracer::Error(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  write_impl(current_timestamp() + "ERROR: " + message);
-}
-
-void ConsoleTracer::Critical(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  write_impl(current_timestamp() + "CRITICAL: " + message);
-}
-
-void ConsoleTracer::Fatal(const std::string &message)
-{
-  std::lock_guard<std::mutex> lock(mutex_);
-  write_impl(current_timestamp() + "*** FATAL ***: " + message);
-}
-#endif
-
-Log::Log()
-{
-  set_level(TraceSeverity::info);
-#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
-  HMODULE isFromDll = GetModuleHandle(NULL);
-  if (!isFromDll)
-  {
-    configure_impl(TraceType::file);
-  }
-  else
-#endif
-    configure_impl(TraceType::console);
-}
-
-Log& Log::set_level(TraceSeverity level)
-{
-  logging_level_.fetch_or(static_cast<uint32_t>(level));
-  return *this;
-}
-
-Log& Log::clear_level(TraceSeverity level)
-{
-  logging_level_.fetch_and(~static_cast<uint32_t>(level));
-  return *this;
-}
-
-bool Log::is_severity_enabled(TraceSeverity level)
-{
-  return (logging_level_.load(std::memory_order_relaxed) & static_cast<uint32_t>(level)) != 0;
-}
-
-Log& Log::reset_levels()
-{
-  logging_level_.store(0);
-  return *this;
-}
-
-void Log::configure_impl(TraceType lt)
-{
-  switch (lt)
-  {
-  case TraceType::devnull:
-    instance_ = std::make_unique<VoidTracer>();
-    break;
-  case TraceType::console:
-    instance_ = std::make_unique<ConsoleTracer>();
-    break;
-  case TraceType::file:
-    instance_ = std::make_unique<FileTracer>();
-    break;
-  default:
-    // not implemented yet
-    break;
-  }
-}
-
-Log& Log::configure(TraceType lt)
-{
-  std::unique_lock<std::shared_mutex> lock(instance_mutex_);
-  configure_impl(lt);
-  return *this;
-}
-
-Log& Log::configure(TraceType lt, const std::string &filepath)
-{
-  std::unique_lock<std::shared_mutex> lock(instance_mutex_);
-  if (lt == TraceType::file && !filepath.empty())
-  {
-    instance_ = std::make_unique<FileTracer>(filepath);
-  }
-  else
-  {
-    configure_impl(lt);
-  }
-  return *this;
-}
-
-Log& Log::configure(TraceType lt, const std::string &filepath, const RotationConfig &rotation)
-{
-  std::unique_lock<std::shared_mutex> lock(instance_mutex_);
-  if (lt == TraceType::file && !filepath.empty())
-  {
-    instance_ = std::make_unique<FileTracer>(filepath, rotation);
-  }
-  else
-  {
-    configure_impl(lt);
-  }
-  return *this;
-}
+#include "log.hpp"
+#include <chrono>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cerrno>
+#include <cstring>
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include "uring_writer.hpp"
+#endif
+
+namespace
+{
+  std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point since)
+  {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+  }
+
+  //! Push written data to stable storage.
+  void sync_file(std::FILE *file)
+  {
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    _commit(_fileno(file));
+#elif defined(__linux__)
+    fdatasync(fileno(file));
+#else
+    fsync(fileno(file));
+#endif
+  }
+
+  //! Names the tracer a thread is calling into, so configure() does not destroy it underneath.
+  struct alignas(64) HazardSlot
+  {
+    std::atomic<Tracer *> tracer{nullptr};
+    //! Claimed by a live thread.
+    std::atomic<bool> owned{false};
+    //! Slots are never freed; exited threads leave theirs for reuse.
+    HazardSlot *next = nullptr;
+  };
+
+  std::atomic<HazardSlot *> hazard_slots{nullptr};
+
+  HazardSlot &claim_slot()
+  {
+    for (HazardSlot *slot = hazard_slots.load(std::memory_order_acquire); slot; slot = slot->next)
+    {
+      if (!slot->owned.load(std::memory_order_relaxed) && !slot->owned.exchange(true, std::memory_order_acquire))
+        return *slot;
+    }
+    auto *slot = new HazardSlot;
+    slot->owned.store(true, std::memory_order_relaxed);
+    slot->next = hazard_slots.load(std::memory_order_relaxed);
+    while (!hazard_slots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+      ;
+    return *slot;
+  }
+
+  struct SlotOwner
+  {
+    HazardSlot &slot = claim_slot();
+    ~SlotOwner()
+    {
+      slot.tracer.store(nullptr, std::memory_order_relaxed);
+      slot.owned.store(false, std::memory_order_release);
+    }
+  };
+
+  HazardSlot &this_thread_slot()
+  {
+    thread_local SlotOwner owner;
+    return owner.slot;
+  }
+
+  //! Backing store of MessageBuffer.
+  struct MessageBuffers
+  {
+    std::string text[4];
+    //! Number of buffers handed out, innermost last.
+    std::size_t used = 0;
+  };
+
+  thread_local MessageBuffers message_buffers;
+
+  //! Guards the named loggers' tree and configuration; usable while Log itself is being constructed.
+  std::mutex &logger_tree_mutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+}
+
+const char *severity_header(TraceSeverity severity)
+{
+  switch (severity)
+  {
+  case TraceSeverity::debug:
+    return "Debug: ";
+  case TraceSeverity::warning:
+    return "Warning: ";
+  case TraceSeverity::error:
+    return "ERROR: ";
+  case TraceSeverity::critical:
+    return "CRITICAL: ";
+  default:
+    return "";
+  }
+}
+
+MessageBuffer::MessageBuffer()
+{
+  MessageBuffers &buffers = message_buffers;
+  text_ = buffers.used < std::size(buffers.text) ? &buffers.text[buffers.used++] : &own_;
+  text_->clear();
+}
+
+MessageBuffer::~MessageBuffer()
+{
+  if (text_ != &own_)
+    --message_buffers.used;
+}
+
+void Tracer::Write(TraceSeverity severity, std::string_view message)
+{
+  MessageBuffer copy;
+  std::string &text = copy.text();
+  text.assign(message);
+  switch (severity)
+  {
+  case TraceSeverity::debug:
+    Debug(text);
+    break;
+  case TraceSeverity::warning:
+    Warning(text);
+    break;
+  case TraceSeverity::error:
+    Error(text);
+    break;
+  case TraceSeverity::critical:
+    Critical(text);
+    break;
+  default:
+    Info(text);
+    break;
+  }
+}
+
+void Tracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count)
+{
+  MessageBuffer line;
+  render_fields(line.text(), message, fields, count);
+  Write(severity, line.text());
+}
+
+void VoidTracer::Info(const std::string &message) {}
+void VoidTracer::Debug(const std::string &message) {}
+void VoidTracer::Warning(const std::string &message) {}
+void VoidTracer::Critical(const std::string &message) {}
+void VoidTracer::Error(const std::string &message) {}
+void VoidTracer::Fatal(const std::string &message) {}
+void VoidTracer::Write(TraceSeverity severity, std::string_view message) {}
+void VoidTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) {}
+
+// ---------------------------------------------------------------------------
+// FileTracer – construction / destruction
+// ---------------------------------------------------------------------------
+
+FileTracer::FileTracer(const std::string &filepath, const RotationConfig &rotation, const FlushPolicy &flush,
+                       FileIo io, bool flush_timer)
+    : filepath_(filepath), rotator_(filepath_, rotation), flush_policy_(flush)
+{
+  buffer_.reserve(std::max<std::size_t>(flush_policy_.max_buffered_bytes, 4096));
+  if (rotation.compress_live)
+    seekable_ = std::make_unique<SeekableZstdWriter>(rotation.compression_level);
+  if (rotation.time_index)
+    index_ = std::make_unique<TimeIndexWriter>();
+#if defined(__linux__)
+  // A few batches in flight; each buffer holds at least one full flush.
+  if (io == FileIo::uring)
+    uring_ = std::make_unique<UringWriter>(std::max<std::size_t>(flush_policy_.max_buffered_bytes, 64 * 1024), 8,
+                                           counters_);
+#else
+  (void)io;
+#endif
+  open_log_file();
+  // Without it a line followed by silence would stay buffered until the next write.
+  if (flush_timer && flush_policy_.max_delay.count() > 0 && flush_policy_.max_buffered_bytes > 0)
+    flusher_ = std::thread(&FileTracer::flusher_loop, this);
+}
+
+FileTracer::~FileTracer()
+{
+  if (flusher_.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    flusher_cv_.notify_one();
+    flusher_.join();
+  }
+  const char *header = nullptr;
+  append_repeats_locked(output_format(), timestamp_now(), header, duplicates_.take(header));
+  close_log_file();
+}
+
+void FileTracer::close_log_file()
+{
+  if (!is_open())
+    return;
+  flush_locked();
+  // Lines that could not be compressed belong to this file's index; they are lost.
+  buffer_.clear();
+  if (index_)
+    index_->close();
+  if (seekable_)
+  {
+    seekable_->finish(compressed_);
+    write_out(compressed_);
+  }
+#if defined(__linux__)
+  if (uring_)
+  {
+    uring_->close();
+    return;
+  }
+#endif
+  std::fclose(file_handle_);
+  file_handle_ = nullptr;
+}
+
+void FileTracer::open_log_file()
+{
+  const auto &path = rotator_.active_path();
+  // Strip the seek table (and a torn frame after a crash) so new frames can be appended.
+  if (seekable_)
+    seekable_->recover(path);
+
+#if defined(__linux__)
+  if (uring_)
+  {
+    uring_->open(path);
+    ++files_opened_;
+    current_size_ = static_cast<std::size_t>(uring_->size());
+    if (index_)
+      index_->open(path, seekable_ ? seekable_->content_size() : current_size_);
+    return;
+  }
+#endif
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  file_handle_ = _wfopen(path.c_str(), L"ab");
+#else
+  file_handle_ = std::fopen(path.c_str(), "ab");
+#endif
+  if (!file_handle_)
+  {
+    throw std::runtime_error("Failed to open log file: " + path.string());
+  }
+  // buffer_ already coalesces lines; a second stdio buffer would only split large writes.
+  std::setvbuf(file_handle_, nullptr, _IONBF, 0);
+  ++files_opened_;
+  // Track existing file size so rotation triggers correctly on an append.
+  if (std::filesystem::exists(path))
+  {
+    current_size_ = static_cast<std::size_t>(std::filesystem::file_size(path));
+  }
+  else
+  {
+    current_size_ = 0;
+  }
+  if (index_)
+    index_->open(path, seekable_ ? seekable_->content_size() : current_size_);
+}
+
+void FileTracer::reopen()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!is_open())
+    open_log_file();
+}
+
+// ---------------------------------------------------------------------------
+// FileTracer – rotation helpers
+// ---------------------------------------------------------------------------
+
+void FileTracer::maybe_rotate()
+{
+  const std::size_t max_file_size = rotator_.config().max_file_size;
+  if ((max_file_size > 0 && current_size_ >= max_file_size) || rotator_.interval_elapsed())
+    rotate();
+}
+
+void FileTracer::rotate()
+{
+  const auto started = std::chrono::steady_clock::now();
+  // Close the current file before renaming.
+  close_log_file();
+
+  // Renaming is all that happens here; shifting backups and compression run in the background.
+  rotator_.rotate();
+
+  // Re-open a fresh active log file.
+  open_log_file();
+  counters_.rotations.add();
+  counters_.rotation_ns.add(elapsed_ns(started));
+}
+
+// ---------------------------------------------------------------------------
+// FileTracer – severity methods
+// ---------------------------------------------------------------------------
+
+void FileTracer::write_record(std::int64_t when, const char *header, std::string_view message, bool urgent)
+{
+  const OutputFormat format = output_format();
+  char prefix[max_timestamp_length];
+  const std::size_t prefix_length = format == OutputFormat::text ? format_timestamp(prefix, when) : 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Start the new file before the first line past an interval boundary, not after it.
+  if (rotator_.interval_elapsed())
+    rotate();
+  if (duplicate_collapsing())
+  {
+    std::uint64_t repeats = 0;
+    const char *repeats_header = nullptr;
+    const bool admitted = duplicates_.admit(header, message, when, repeats, repeats_header);
+    append_repeats_locked(format, when, repeats_header, repeats);
+    if (!admitted)
+    {
+      if (repeats > 0)
+        commit_locked(urgent);
+      return;
+    }
+  }
+  append_locked(format, when, std::string_view(prefix, prefix_length), header, message);
+  commit_locked(urgent);
+}
+
+void FileTracer::append_locked(OutputFormat format, std::int64_t when, std::string_view prefix, const char *header,
+                               std::string_view message)
+{
+  if (buffer_.empty())
+    buffered_since_ = std::chrono::steady_clock::now();
+  const std::size_t before = buffer_.size();
+  if (format == OutputFormat::text)
+  {
+    buffer_.append(prefix);
+    buffer_.append(header);
+    buffer_.append(message);
+  }
+  else
+  {
+    render_message(buffer_, format, when, header, message);
+  }
+  if (index_)
+    index_->add(when, binlog::header_severity(header), buffer_.size() - before);
+  // With live compression the size is counted in compressed bytes when the frame is written.
+  if (!seekable_)
+    current_size_ += buffer_.size() - before;
+}
+
+void FileTracer::append_repeats_locked(OutputFormat format, std::int64_t when, const char *header,
+                                       std::uint64_t repeats)
+{
+  if (repeats == 0)
+    return;
+  thread_local std::string notice;
+  notice.clear();
+  append_repeat_notice(notice, repeats);
+  char prefix[max_timestamp_length];
+  const std::size_t prefix_length = format == OutputFormat::text ? format_timestamp(prefix, when) : 0;
+  append_locked(format, when, std::string_view(prefix, prefix_length), header, notice);
+}
+
+void FileTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count)
+{
+  write_structured(timestamp_now(), severity, message, fields, count);
+}
+
+void FileTracer::write_structured(std::int64_t when, TraceSeverity severity, std::string_view message,
+                                  const Field *fields, std::size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rotator_.interval_elapsed())
+    rotate();
+  if (buffer_.empty())
+    buffered_since_ = std::chrono::steady_clock::now();
+  const std::size_t before = buffer_.size();
+  render_structured(buffer_, output_format(), when, severity_header(severity), message, fields, count);
+  if (index_)
+    index_->add(when, binary_severity(severity), buffer_.size() - before);
+  if (!seekable_)
+    current_size_ += buffer_.size() - before;
+  commit_locked(severity == TraceSeverity::error || severity == TraceSeverity::critical);
+}
+
+void FileTracer::write_raw(std::string_view bytes, bool urgent)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (buffer_.empty())
+    buffered_since_ = std::chrono::steady_clock::now();
+  buffer_.append(bytes);
+  if (!seekable_)
+    current_size_ += bytes.size();
+  commit_locked(urgent);
+}
+
+void FileTracer::commit_locked(bool urgent)
+{
+  if (urgent && flush_policy_.flush_on_error)
+    flush_locked();
+  else if (buffer_.size() >= flush_policy_.max_buffered_bytes)
+    write_buffer();
+  else if (flush_policy_.max_delay.count() > 0 &&
+           std::chrono::steady_clock::now() - buffered_since_ >= flush_policy_.max_delay)
+    write_buffer();
+  maybe_rotate();
+}
+
+bool FileTracer::is_open() const
+{
+#if defined(__linux__)
+  if (uring_)
+    return uring_->is_open();
+#endif
+  return file_handle_ != nullptr;
+}
+
+void FileTracer::write_out(std::string_view bytes, bool sync)
+{
+#if defined(__linux__)
+  if (uring_)
+  {
+    // Counts its own syscalls, and bytes as their writes complete.
+    uring_->write(bytes, sync);
+    return;
+  }
+#else
+  (void)sync;
+#endif
+  const std::size_t written = std::fwrite(bytes.data(), 1, bytes.size(), file_handle_);
+  counters_.bytes_written.add(written);
+  counters_.syscalls.add();
+  if (written < bytes.size())
+  {
+    counters_.write_errors.add();
+    std::clearerr(file_handle_);
+  }
+}
+
+bool FileTracer::write_buffer(bool sync)
+{
+  if (buffer_.empty() || !is_open())
+    return false;
+  if (seekable_)
+  {
+    // One independent frame per flush: a crash loses at most the frame being written.
+    const auto started = std::chrono::steady_clock::now();
+    if (!seekable_->compress_frame(buffer_, compressed_))
+    {
+      // Raw text would break the frame sequence; keep the lines for the next flush.
+      counters_.write_errors.add();
+      return false;
+    }
+    counters_.compression_ns.add(elapsed_ns(started));
+    counters_.compression_input_bytes.add(buffer_.size());
+    counters_.compression_output_bytes.add(compressed_.size());
+    write_out(compressed_, sync);
+    current_size_ += compressed_.size();
+  }
+  else
+  {
+    write_out(buffer_, sync);
+  }
+  if (index_)
+    index_->written();
+  counters_.flushes.add();
+  buffer_.clear();
+  return true;
+}
+
+void FileTracer::flush_locked()
+{
+#if defined(__linux__)
+  if (uring_)
+  {
+    // The fdatasync rides along with the last write; flushed means the writes completed.
+    if (!write_buffer(flush_policy_.sync) && flush_policy_.sync)
+      uring_->sync();
+    uring_->wait();
+    return;
+  }
+#endif
+  write_buffer();
+  if (flush_policy_.sync && file_handle_)
+  {
+    sync_file(file_handle_);
+    counters_.syscalls.add();
+  }
+}
+
+void FileTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  SinkStats &stats = out.emplace_back();
+  stats.name = rotator_.active_path().string();
+  counters_.add_to(stats);
+  rotator_.add_stats(stats);
+}
+
+void FileTracer::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const char *header = nullptr;
+  append_repeats_locked(output_format(), timestamp_now(), header, duplicates_.take(header));
+  flush_locked();
+}
+
+void FileTracer::flusher_loop()
+{
+  const auto max_delay = flush_policy_.max_delay;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_)
+  {
+    // Wake when the oldest buffered line comes due; an empty buffer is checked again a delay later.
+    const auto now = std::chrono::steady_clock::now();
+    flusher_cv_.wait_until(lock, buffer_.empty() ? now + max_delay : buffered_since_ + max_delay);
+    if (stopping_ || buffer_.empty() || std::chrono::steady_clock::now() - buffered_since_ < max_delay)
+      continue;
+    try
+    {
+      flush_locked();
+    }
+    catch (const std::exception &)
+    {
+      // The next write reports a broken file to its caller.
+    }
+  }
+}
+
+void FileTracer::flush_if_stale()
+{
+  if (flush_policy_.max_delay.count() == 0)
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!buffer_.empty() && std::chrono::steady_clock::now() - buffered_since_ >= flush_policy_.max_delay)
+    flush_locked();
+}
+
+void FileTracer::Info(const std::string &message)
+{
+  write_record(timestamp_now(), "", message);
+}
+
+void FileTracer::Debug(const std::string &message)
+{
+  write_record(timestamp_now(), "Debug: ", message);
+}
+
+void FileTracer::Warning(const std::string &message)
+{
+  write_record(timestamp_now(), "Warning: ", message);
+}
+
+void FileTracer::Critical(const std::string &message)
+{
+  write_record(timestamp_now(), "CRITICAL: ", message, true);
+}
+
+void FileTracer::Error(const std::string &message)
+{
+  write_record(timestamp_now(), "ERROR: ", message, true);
+}
+
+void FileTracer::Fatal(const std::string &message)
+{
+  write_record(timestamp_now(), "*** FATAL ***: ", message, true);
+  flush();
+}
+
+void FileTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  write_record(timestamp_now(), severity_header(severity), message,
+               severity == TraceSeverity::error || severity == TraceSeverity::critical);
+}
+
+bool ConsoleTracer::render(const char *header, std::string_view message)
+{
+  line_.clear();
+  const OutputFormat format = output_format();
+  const std::int64_t when = timestamp_now();
+  if (duplicate_collapsing())
+  {
+    std::uint64_t repeats = 0;
+    const char *repeats_header = nullptr;
+    const bool admitted = duplicates_.admit(header, message, when, repeats, repeats_header);
+    if (repeats > 0)
+    {
+      thread_local std::string notice;
+      notice.clear();
+      append_repeat_notice(notice, repeats);
+      render_message(line_, format, when, repeats_header, notice);
+    }
+    if (!admitted)
+      return !line_.empty();
+  }
+  render_message(line_, format, when, header, message);
+  return true;
+}
+
+void ConsoleTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  SinkStats &stats = out.emplace_back();
+  stats.name = "console";
+  counters_.add_to(stats);
+}
+
+void ConsoleTracer::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const char *header = nullptr;
+  const std::uint64_t repeats = duplicates_.take(header);
+  if (repeats > 0)
+  {
+    thread_local std::string notice;
+    notice.clear();
+    append_repeat_notice(notice, repeats);
+    line_.clear();
+    render_message(line_, output_format(), timestamp_now(), header, notice);
+    write_impl(line_);
+  }
+#if !((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  write_pending();
+#endif
+}
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+
+namespace
+{
+  WORD severity_color(TraceSeverity severity)
+  {
+    switch (severity)
+    {
+    case TraceSeverity::debug:
+      return FOREGROUND_INTENSITY | FOREGROUND_GREEN;
+    case TraceSeverity::warning:
+      return FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN;
+    case TraceSeverity::error:
+      return FOREGROUND_INTENSITY | FOREGROUND_RED;
+    case TraceSeverity::critical:
+      return FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE;
+    default:
+      return FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE;
+    }
+  }
+}
+
+ConsoleTracer::ConsoleTracer(const ConsoleConfig &config)
+    : config_(config)
+{
+  line_.reserve(256);
+  SetConsoleOutputCP(65001);
+  std_out_ = GetStdHandle(STD_OUTPUT_HANDLE);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+  {
+    // what to do here?
+  }
+}
+
+ConsoleTracer::~ConsoleTracer()
+{
+  flush();
+}
+
+void ConsoleTracer::write_impl(const std::string &formatted)
+{
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  DWORD dwBytesWritten;
+  WriteConsoleA(std_out_, formatted.c_str(), static_cast<DWORD>(formatted.length()), &dwBytesWritten, NULL);
+  counters_.bytes_written.add(dwBytesWritten);
+  counters_.syscalls.add();
+}
+
+void ConsoleTracer::Info(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(TraceSeverity::info));
+  if (render("", message))
+    write_impl(line_);
+}
+
+void ConsoleTracer::Debug(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(TraceSeverity::debug));
+  if (render("Debug: ", message))
+    write_impl(line_);
+}
+
+void ConsoleTracer::Warning(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(TraceSeverity::warning));
+  if (render("Warning: ", message))
+    write_impl(line_);
+}
+
+void ConsoleTracer::Error(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(TraceSeverity::error));
+  if (render("ERROR: ", message))
+    write_impl(line_);
+}
+
+void ConsoleTracer::Critical(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(TraceSeverity::critical));
+  if (render("CRITICAL: ", message))
+    write_impl(line_);
+}
+
+void ConsoleTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(severity));
+  if (render(severity_header(severity), message))
+    write_impl(line_);
+}
+
+void ConsoleTracer::Fatal(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, BACKGROUND_RED | FOREGROUND_INTENSITY | FOREGROUND_RED);
+  if (render("*** FATAL ***: ", message))
+    write_impl(line_);
+  SetConsoleTextAttribute(std_out_, FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
+}
+
+void ConsoleTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (std_out_ == INVALID_HANDLE_VALUE)
+    return;
+  SetConsoleTextAttribute(std_out_, severity_color(severity));
+  line_.clear();
+  render_structured(line_, output_format(), timestamp_now(), severity_header(severity), message, fields, count);
+  write_impl(line_);
+}
+
+#else
+
+namespace
+{
+  //! ANSI colors matching the Windows console attributes.
+  const char *ansi_color(TraceSeverity severity)
+  {
+    switch (severity)
+    {
+    case TraceSeverity::debug:
+      return "\x1b[92m";
+    case TraceSeverity::warning:
+      return "\x1b[93m";
+    case TraceSeverity::error:
+      return "\x1b[91m";
+    case TraceSeverity::critical:
+      return "\x1b[95m";
+    default:
+      return "\x1b[96m";
+    }
+  }
+
+  constexpr const char *ansi_fatal = "\x1b[97;41m";
+  constexpr std::string_view ansi_reset = "\x1b[0m";
+
+  bool is_urgent(TraceSeverity severity)
+  {
+    return severity == TraceSeverity::error || severity == TraceSeverity::critical;
+  }
+
+  //! writev(2) everything, continuing after short writes.
+  void write_fully(int fd, iovec *parts, int count, SinkCounters &counters)
+  {
+    while (count > 0)
+    {
+      const ssize_t written = writev(fd, parts, count);
+      counters.syscalls.add();
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0)
+      {
+        counters.write_errors.add();
+        return;
+      }
+      counters.bytes_written.add(static_cast<std::uint64_t>(written));
+      auto left = static_cast<std::size_t>(written);
+      for (; count > 0 && left >= parts->iov_len; --count, ++parts)
+        left -= parts->iov_len;
+      if (count > 0)
+      {
+        parts->iov_base = static_cast<char *>(parts->iov_base) + left;
+        parts->iov_len -= left;
+      }
+    }
+  }
+}
+
+ConsoleTracer::ConsoleTracer(const ConsoleConfig &config)
+    : config_(config)
+{
+  line_.reserve(256);
+  for (int stream = 0; stream < 2; ++stream)
+  {
+    colored_[stream] = config_.colors && isatty(stream_fds_[stream]);
+    pending_[stream].reserve(config_.flush.max_buffered_bytes);
+  }
+  if (config_.flush.max_delay.count() > 0)
+    flusher_ = std::thread(&ConsoleTracer::flusher_loop, this);
+}
+
+ConsoleTracer::~ConsoleTracer()
+{
+  if (flusher_.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    flusher_cv_.notify_one();
+    flusher_.join();
+  }
+  flush();
+}
+
+void ConsoleTracer::flusher_loop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_)
+  {
+    flusher_cv_.wait_for(lock, config_.flush.max_delay);
+    if (std::chrono::steady_clock::now() - buffered_since_ >= config_.flush.max_delay)
+      write_pending();
+  }
+}
+
+void ConsoleTracer::write_line(std::string_view line, const char *color, bool urgent)
+{
+  const int stream = urgent && config_.errors_to_stderr ? 1 : 0;
+  // Keep the order of lines when both streams end up on the same terminal.
+  if (!pending_[1 - stream].empty())
+    write_stream(1 - stream);
+  if (!colored_[stream] || output_format() != OutputFormat::text)
+    color = nullptr;
+
+  const FlushPolicy &policy = config_.flush;
+  std::string &pending = pending_[stream];
+  const bool write_now = (urgent && policy.flush_on_error) || pending.size() + line.size() >= policy.max_buffered_bytes ||
+                         (policy.max_delay.count() > 0 && !pending.empty() &&
+                          std::chrono::steady_clock::now() - buffered_since_ >= policy.max_delay);
+  if (write_now)
+  {
+    write_stream(stream, line, color);
+    return;
+  }
+  if (pending.empty())
+    buffered_since_ = std::chrono::steady_clock::now();
+  if (!color)
+  {
+    pending.append(line);
+    return;
+  }
+  // Reset before the newline, so a cut-off line does not color the next one.
+  const bool newline = !line.empty() && line.back() == '\n';
+  pending.append(color);
+  pending.append(line.substr(0, line.size() - newline));
+  pending.append(ansi_reset);
+  if (newline)
+    pending.push_back('\n');
+}
+
+void ConsoleTracer::write_stream(int stream, std::string_view line, const char *color)
+{
+  std::string &pending = pending_[stream];
+  const bool newline = color && !line.empty() && line.back() == '\n';
+  if (color)
+    line.remove_suffix(newline);
+  iovec parts[5];
+  int count = 0;
+  const auto add = [&](std::string_view bytes)
+  {
+    if (!bytes.empty())
+      parts[count++] = {const_cast<char *>(bytes.data()), bytes.size()};
+  };
+  add(pending);
+  if (color)
+    add(color);
+  add(line);
+  if (color)
+    add(ansi_reset);
+  if (newline)
+    add("\n");
+  if (count == 0)
+    return;
+  write_fully(stream_fds_[stream], parts, count, counters_);
+  counters_.flushes.add();
+  pending.clear();
+}
+
+void ConsoleTracer::write_pending()
+{
+  for (int stream = 0; stream < 2; ++stream)
+  {
+    if (!pending_[stream].empty())
+      write_stream(stream);
+  }
+}
+
+void ConsoleTracer::write_impl(const std::string &formatted)
+{
+  write_line(formatted, nullptr, false);
+}
+
+void ConsoleTracer::Info(const std::string &message)
+{
+  Write(TraceSeverity::info, message);
+}
+
+void ConsoleTracer::Debug(const std::string &message)
+{
+  Write(TraceSeverity::debug, message);
+}
+
+void ConsoleTracer::Warning(const std::string &message)
+{
+  Write(TraceSeverity::warning, message);
+}
+
+void ConsoleTracer::Error(const std::string &message)
+{
+  Write(TraceSeverity::error, message);
+}
+
+void ConsoleTracer::Critical(const std::string &message)
+{
+  Write(TraceSeverity::critical, message);
+}
+
+void ConsoleTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (render(severity_header(severity), message))
+    write_line(line_, ansi_color(severity), is_urgent(severity));
+}
+
+void ConsoleTracer::Fatal(const std::string &message)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (render("*** FATAL ***: ", message))
+    write_line(line_, ansi_fatal, true);
+  write_pending();
+}
+
+void ConsoleTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  line_.clear();
+  render_structured(line_, output_format(), timestamp_now(), severity_header(severity), message, fields, count);
+  write_line(line_, ansi_color(severity), is_urgent(severity));
+}
+#endif
+
+Log::Log()
+{
+  set_level(TraceSeverity::info);
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  HMODULE isFromDll = GetModuleHandle(NULL);
+  if (!isFromDll)
+  {
+    install(make_tracer(TraceType::file));
+  }
+  else
+#endif
+    install(make_tracer(TraceType::console));
+}
+
+// ---------------------------------------------------------------------------
+// Log – tracer publication
+// ---------------------------------------------------------------------------
+
+Log::ActiveTracer::ActiveTracer(const Log &log)
+    : slot_(&this_thread_slot().tracer), previous_(slot_->load(std::memory_order_relaxed))
+{
+  // A nested call on the same thread: the enclosing call already protects a tracer, and
+  // replacing it in the slot would let configure() destroy that one underneath it.
+  if (previous_)
+  {
+    tracer_ = previous_;
+    return;
+  }
+  // Announce the tracer, then check it is still the active one; otherwise configure()
+  // may have scanned the slots before the announcement became visible.
+  Tracer *tracer = log.instance_.load(std::memory_order_acquire);
+  for (;;)
+  {
+    slot_->store(tracer, std::memory_order_seq_cst);
+    Tracer *current = log.instance_.load(std::memory_order_seq_cst);
+    if (current == tracer)
+      break;
+    tracer = current;
+  }
+  tracer_ = tracer;
+}
+
+Log::ActiveTracer::~ActiveTracer()
+{
+  slot_->store(previous_, std::memory_order_release);
+}
+
+Log& Log::set_level(TraceSeverity level)
+{
+  root_.set_level(level);
+  return *this;
+}
+
+Log& Log::clear_level(TraceSeverity level)
+{
+  root_.clear_level(level);
+  return *this;
+}
+
+Log& Log::set_deferred_formatting(bool enabled)
+{
+  deferred_.store(enabled);
+  return *this;
+}
+
+Log& Log::set_output_format(OutputFormat format)
+{
+  ::set_output_format(format);
+  return *this;
+}
+
+Log& Log::set_flight_recorder(bool enabled, const FlightRecorderConfig &config)
+{
+  if (enabled)
+    set_flight_recorder_config(config);
+  recording_.store(enabled, std::memory_order_relaxed);
+  return *this;
+}
+
+bool Log::dump_flight_recorder(const char *path)
+{
+  return ::dump_flight_recorder(path);
+}
+
+Log& Log::set_stats(bool enabled, std::uint32_t latency_sample_every)
+{
+  call_stats_.enable(enabled, latency_sample_every);
+  return *this;
+}
+
+LogStats Log::stats() const
+{
+  LogStats stats;
+  call_stats_.snapshot(stats);
+  ActiveTracer tracer(*this);
+  tracer->collect_stats(stats.sinks);
+  return stats;
+}
+
+void Log::record_text(binlog::Severity severity, const std::string &message)
+{
+  // Leave room for the type tag and the length.
+  constexpr std::size_t room = PackedArgs::capacity - 1 - sizeof(std::uint32_t);
+  PackedArgs packed;
+  packed.pack(std::string_view(message).substr(0, room));
+  flight_record(severity, "{}", packed);
+}
+
+void Log::write_fatal(const std::string &message)
+{
+  {
+    ActiveTracer tracer(*this);
+    tracer->Fatal(message);
+  }
+  if (is_recording())
+    ::dump_flight_recorder();
+}
+
+Log& Log::set_collapse_duplicates(bool enabled, std::chrono::seconds report_interval)
+{
+  set_duplicate_collapsing(enabled, report_interval);
+  return *this;
+}
+
+Log& Log::set_timestamp(const TimestampConfig &config)
+{
+  set_timestamp_config(config);
+  return *this;
+}
+
+Log& Log::reset_levels()
+{
+  root_.reset_levels();
+  return *this;
+}
+
+// ---------------------------------------------------------------------------
+// Log – callsites
+// ---------------------------------------------------------------------------
+
+std::vector<const Callsite *> Log::callsites() const
+{
+  return registered_callsites();
+}
+
+std::size_t Log::set_callsites(const CallsiteFilter &filter, CallsiteMode mode)
+{
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  return set_callsite_mode(filter, mode);
+}
+
+Log& Log::clear_callsites()
+{
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  clear_callsite_modes();
+  return *this;
+}
+
+// ---------------------------------------------------------------------------
+// Logger – named hierarchy
+// ---------------------------------------------------------------------------
+
+Logger &Log::get(std::string_view name)
+{
+  Log &log = get();
+  if (name.empty())
+    return log.root_;
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  Logger *parent = &log.root_;
+  // Create missing ancestors from the top down, so each one starts from its parent's levels.
+  for (std::size_t end = name.find('.');; end = name.find('.', end + 1))
+  {
+    const std::string path(name.substr(0, end));
+    auto &logger = log.loggers_[path];
+    if (!logger)
+    {
+      logger.reset(new Logger(path, parent));
+      parent->children_.push_back(logger.get());
+      logger->propagate_locked(parent->levels_.load(std::memory_order_relaxed));
+    }
+    parent = logger.get();
+    if (end == std::string_view::npos)
+      return *parent;
+  }
+}
+
+Logger::Logger(std::string name, Logger *parent)
+    : name_(std::move(name)), parent_(parent), own_levels_(parent == nullptr)
+{
+}
+
+Logger &Logger::set_level(TraceSeverity level)
+{
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  configure_locked(levels_.load(std::memory_order_relaxed) | static_cast<std::uint32_t>(level), true);
+  refresh_callsites();
+  return *this;
+}
+
+Logger &Logger::clear_level(TraceSeverity level)
+{
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  configure_locked(levels_.load(std::memory_order_relaxed) & ~static_cast<std::uint32_t>(level), true);
+  refresh_callsites();
+  return *this;
+}
+
+Logger &Logger::reset_levels()
+{
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  configure_locked(0, true);
+  refresh_callsites();
+  return *this;
+}
+
+Logger &Logger::inherit_levels()
+{
+  std::lock_guard<std::mutex> lock(logger_tree_mutex());
+  if (parent_)
+  {
+    configure_locked(parent_->levels_.load(std::memory_order_relaxed), false);
+    refresh_callsites();
+  }
+  return *this;
+}
+
+void Logger::configure_locked(std::uint32_t levels, bool own)
+{
+  own_levels_ = own;
+  levels_.store(levels, std::memory_order_relaxed);
+  for (Logger *child : children_)
+    child->propagate_locked(levels);
+}
+
+void Logger::propagate_locked(std::uint32_t inherited)
+{
+  if (own_levels_)
+    return;
+  configure_locked(inherited, false);
+}
+
+std::unique_ptr<Tracer> Log::make_tracer(TraceType lt)
+{
+  switch (lt)
+  {
+  case TraceType::devnull:
+    return std::make_unique<VoidTracer>();
+  case TraceType::console:
+    return std::make_unique<ConsoleTracer>();
+  case TraceType::file:
+    return std::make_unique<FileTracer>();
+  case TraceType::async_file:
+    return std::make_unique<AsyncFileTracer>();
+  case TraceType::mmap_file:
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    return std::make_unique<FileTracer>();
+#else
+    return std::make_unique<MappedFileTracer>();
+#endif
+  case TraceType::binary_file:
+    return std::make_unique<BinaryFileTracer>();
+  case TraceType::uring_file:
+    return std::make_unique<FileTracer>("log.txt", RotationConfig{}, FlushPolicy{}, FileIo::uring);
+  case TraceType::syslog:
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    // No syslog sink on Windows yet.
+    return nullptr;
+#else
+    return std::make_unique<SyslogTracer>();
+#endif
+  default:
+    // not implemented yet
+    return nullptr;
+  }
+}
+
+std::unique_ptr<Tracer> Log::make_file_tracer(TraceType lt, const std::string &filepath,
+                                              const RotationConfig &rotation, const AsyncConfig &async,
+                                              const FlushPolicy &flush)
+{
+  if (filepath.empty())
+    return make_tracer(lt);
+  switch (lt)
+  {
+  case TraceType::file:
+    return std::make_unique<FileTracer>(filepath, rotation, flush);
+  case TraceType::async_file:
+    return std::make_unique<AsyncFileTracer>(filepath, rotation, async, flush);
+  case TraceType::mmap_file:
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    // No mapped sink on Windows yet.
+    return std::make_unique<FileTracer>(filepath, rotation, flush);
+#else
+    return std::make_unique<MappedFileTracer>(filepath, rotation, flush);
+#endif
+  case TraceType::binary_file:
+    return std::make_unique<BinaryFileTracer>(filepath, rotation, flush);
+  case TraceType::uring_file:
+    return std::make_unique<FileTracer>(filepath, rotation, flush, FileIo::uring);
+  case TraceType::syslog:
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    return nullptr;
+#else
+  {
+    // The path is the address; rotation and flush settings do not apply to datagrams.
+    SyslogConfig config;
+    config.address = filepath;
+    config.queue = async;
+    return std::make_unique<SyslogTracer>(config);
+  }
+#endif
+  default:
+    return make_tracer(lt);
+  }
+}
+
+void Log::install(std::shared_ptr<Tracer> tracer)
+{
+  if (!tracer)
+    return;
+  // The wait below would never end: this thread is inside the tracer it retires.
+  Tracer *active = instance_.load(std::memory_order_relaxed);
+  if (active && this_thread_slot().tracer.load(std::memory_order_relaxed) == active)
+    throw std::logic_error("Log: the tracer cannot be replaced from inside one of its calls");
+  packed_tracer_.store(tracer->wants_packed_args(), std::memory_order_relaxed);
+  Tracer *retired = instance_.exchange(tracer.get(), std::memory_order_seq_cst);
+  if (retired)
+  {
+    // Calls that picked up the old tracer are still running; let them finish first.
+    for (HazardSlot *slot = hazard_slots.load(std::memory_order_acquire); slot; slot = slot->next)
+    {
+      while (slot->tracer.load(std::memory_order_seq_cst) == retired)
+        std::this_thread::yield();
+    }
+  }
+  owner_ = std::move(tracer);
+}
+
+void Log::install_sinks(std::vector<MultiTracer::Sink> sinks)
+{
+  install(std::make_shared<MultiTracer>(std::move(sinks)));
+}
+
+MultiTracer::SinkId Log::add_sink(std::unique_ptr<Tracer> tracer, const SinkConfig &config)
+{
+  if (!tracer)
+    return 0;
+  std::shared_ptr<Tracer> sink = std::move(tracer);
+  if (config.own_queue)
+    sink = std::make_shared<QueuedTracer>(std::move(sink), config.queue);
+
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  std::vector<MultiTracer::Sink> sinks;
+  if (auto *multi = dynamic_cast<MultiTracer *>(owner_.get()))
+    sinks = multi->sinks();
+  else if (owner_)
+    sinks.push_back({0, ~0u, owner_});
+  const MultiTracer::SinkId id = next_sink_id_++;
+  sinks.push_back({id, config.severities, std::move(sink)});
+  install_sinks(std::move(sinks));
+  return id;
+}
+
+MultiTracer::SinkId Log::add_sink(TraceType lt, const std::string &filepath, const SinkConfig &config,
+                                  const RotationConfig &rotation, const FlushPolicy &flush)
+{
+  return add_sink(make_file_tracer(lt, filepath, rotation, {}, flush), config);
+}
+
+bool Log::remove_sink(MultiTracer::SinkId id)
+{
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  auto *multi = dynamic_cast<MultiTracer *>(owner_.get());
+  if (!multi)
+    return false;
+  std::vector<MultiTracer::Sink> sinks = multi->sinks();
+  const auto removed = std::remove_if(sinks.begin(), sinks.end(), [id](const MultiTracer::Sink &sink)
+                                      { return sink.id == id; });
+  if (removed == sinks.end())
+    return false;
+  sinks.erase(removed, sinks.end());
+  // The removed sink is destroyed with the old MultiTracer, after in-flight calls finish.
+  install_sinks(std::move(sinks));
+  return true;
+}
+
+Log& Log::configure(TraceType lt)
+{
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  install(make_tracer(lt));
+  return *this;
+}
+
+Log& Log::configure(const ConsoleConfig &console)
+{
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  install(std::make_shared<ConsoleTracer>(console));
+  return *this;
+}
+
+Log& Log::configure(const SyslogConfig &syslog)
+{
+#if !((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  install(std::make_shared<SyslogTracer>(syslog));
+#endif
+  return *this;
+}
+
+Log& Log::configure(TraceType lt, const std::string &filepath)
+{
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  install(make_file_tracer(lt, filepath, {}, {}, {}));
+  return *this;
+}
+
+Log& Log::configure(TraceType lt, const std::string &filepath, const RotationConfig &rotation, const FlushPolicy &flush)
+{
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  install(make_file_tracer(lt, filepath, rotation, {}, flush));
+  return *this;
+}
+
+Log& Log::configure(TraceType lt, const std::string &filepath, const RotationConfig &rotation, const AsyncConfig &async,
+                    const FlushPolicy &flush)
+{
+  std::lock_guard<std::mutex> lock(configure_mutex_);
+  install(make_file_tracer(lt, filepath, rotation, async, flush));
+  return *this;
+}
+
+Log& Log::flush()
+{
+  ActiveTracer tracer(*this);
+  tracer->flush();
+  return *this;
+}
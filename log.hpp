@@ -1,300 +1,1584 @@
-#pragma once
-
-/*! \file A simple logger implementation */
-
-#include <mutex>
-#include <shared_mutex>
-#include <fstream>
-#include <format>
-#include <mutex>
-#include <memory>
-#include <iomanip>
-#include <string>
-#include <cstdint>
-#include <atomic>
-#include <filesystem>
-
-#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
-#include <windows.h>
-#endif
-
-#ifdef __linux__
-#include <iostream>
-#endif
-
-//! Macross for simple usage.
-#define LOG(...) LOG_INFO(__VA_ARGS__)
-#define LOG_LEVEL(x) Log::get().set_level(x)
-#define LOG_INFO(...) Log::get().log(TraceSeverity::info, __VA_ARGS__)
-#define LOG_DEBUG(...) Log::get().log(TraceSeverity::debug, __VA_ARGS__)
-#define LOG_EXCEPTION(description, exception) \
-  Log::get().log(TraceSeverity::debug, "{}: {} at {} {}:{}\n", description, exception.what(), __PRETTY_FUNCTION__, __FILE__, __LINE__)
-
-#define LOG_CALL(...) Log::get().log(TraceSeverity::verbose, __VA_ARGS__)
-
-//! A tracer-type class enumerator.
-enum class TraceType
-{
-  devnull,
-  console,
-  file,
-#if defined(__ARM_EABI__)
-  uart,
-  swd,
-  rtt
-#endif
-};
-
-//! A tracer severity class enumerator.
-enum class TraceSeverity
-{
-  info = 1,
-  warning = 2,
-  error = 4,
-  debug = 8,
-  verbose = 16,
-  critical = 32,
-};
-
-//! Configuration for log-file rotation and compression.
-struct RotationConfig
-{
-  //! Maximum size in bytes before rotation is triggered. 0 = no size limit.
-  std::size_t max_file_size = 0;
-  //! Maximum number of rotated (back-up) files to keep. 0 = unlimited.
-  std::size_t max_backup_count = 5;
-  //! Compress rotated files with zstd (maximum compression level).
-  bool compress = false;
-};
-
-//! A tracer abstract interface.
-class Tracer
-{
-public:
-  virtual ~Tracer() {}
-  /**
-   * @brief Generic informational message
-   */
-  virtual void Info(const std::string &message) = 0;
-  /**
-   * @brief A message usually only needed for debug purposes.
-   */
-  virtual void Debug(const std::string &message) = 0;
-  /**
-   * @brief A warning an user should pay an attention to.
-   */
-  virtual void Warning(const std::string &message) = 0;
-  /**
-   * @brief  A problem that can cause the system or application to malfunction or produce incorrect results,
-   * but it does not necessarily bring the system or application down completely.
-   */
-  virtual void Error(const std::string &message) = 0;
-
-  /**
-   * @brief A serious problem that can cause significant impact to the system or application,
-   * but the system or application can still continue to function with some limitations or degradation of service.
-   */
-  virtual void Critical(const std::string &message) = 0;
-  /**
-   * @brief A problem that causes the system or application to crash or become completely non-functional.
-   */
-  virtual void Fatal(const std::string &message) = 0;
-};
-
-//! A file tracer. Logs messages to a file with optional rotation & zstd compression.
-class FileTracer : public Tracer
-{
-public:
-  explicit FileTracer(const std::string &filepath = "log.txt",
-                      const RotationConfig &rotation = {});
-  ~FileTracer();
-
-  void Info(const std::string &message) override;
-  void Debug(const std::string &message) override;
-  void Warning(const std::string &message) override;
-  void Error(const std::string &message) override;
-  void Critical(const std::string &message) override;
-  void Fatal(const std::string &message) override;
-
-private:
-  //! Open (or re-open) the active log file.
-  void open_log_file();
-  //! Check whether the current file exceeds the size limit and rotate if needed.
-  void maybe_rotate();
-  //! Perform a single rotation step: close, rename, compress, prune.
-  void rotate();
-  //! Compress a file in-place using zstd at maximum compression level.
-  static bool compress_file_zstd(const std::filesystem::path &src);
-  //! Remove excess backup files beyond max_backup_count.
-  void prune_old_backups();
-
-  //! Path to the active log file.
-  std::filesystem::path filepath_;
-  //! Current number of bytes written since the file was opened.
-  std::size_t current_size_ = 0;
-  //! Rotation / compression configuration.
-  RotationConfig rotation_;
-  //! A handle to a filestream.
-  std::ofstream file_handle_;
-  //! A mutex to protect filestream.
-  std::mutex mutex_;
-};
-
-//! A void tracer. Used when you want to silent all message or there is nowhere to output.
-class VoidTracer : public Tracer
-{
-public:
-  void Info(const std::string &message) override;
-  void Debug(const std::string &message) override;
-  void Warning(const std::string &message) override;
-  void Critical(const std::string &message) override;
-  void Error(const std::string &message) override;
-  void Fatal(const std::string &message) override;
-};
-
-//! A console/terminal tracer.
-class ConsoleTracer : public Tracer
-{
-public:
-  ConsoleTracer()
-  {
-#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
-    SetConsoleOutputCP(65001);
-    std_out_ = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (std_out_ == INVALID_HANDLE_VALUE)
-    {
-      // what to do here?
-    }
-#endif
-  }
-  void Info(const std::string &message) override;
-  void Debug(const std::string &message) override;
-  void Warning(const std::string &message) override;
-  void Critical(const std::string &message) override;
-  void Error(const std::string &message) override;
-  void Fatal(const std::string &message) override;
-
-private:
-  //! Internal write without locking – caller must hold mutex_.
-  void write_impl(const std::string &formatted);
-
-#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
-  //! A handle to a terminal.
-  HANDLE std_out_;
-#endif
-  //! A mutex to protect terminal.
-  std::mutex mutex_;
-};
-
-//! A log singletone facade.
-class Log
-{
-public:
-  /**
-   * @brief Get an instance of a logger.
-   *
-   * @return Log& A logger's singletone instance
-   */
-  static Log &get()
-  {
-    static Log instance;
-    return instance;
-  }
-
-  /**
-   * @brief A main logging entry point for an user.
-   *
-   * @tparam S
-   * @tparam Args
-   * @param severity a log message severity level
-   * @param format
-   * @param args
-   */
-  template <typename S, typename... Args>
-  void log(TraceSeverity severity, const S &format, Args &&...args)
-  {
-    if (!is_severity_enabled(severity))
-    {
-      // This channel is muted.
-      return;
-    }
-    std::string message = std::vformat(format, std::make_format_args(args...));
-    std::shared_lock<std::shared_mutex> lock(instance_mutex_);
-    switch (severity)
-    {
-    case TraceSeverity::info:
-      instance_->Info(message);
-      break;
-    case TraceSeverity::debug:
-      instance_->Debug(message);
-      break;
-    case TraceSeverity::warning:
-      instance_->Warning(message);
-      break;
-    case TraceSeverity::error:
-      instance_->Error(message);
-      break;
-    case TraceSeverity::critical:
-      instance_->Critical(message);
-      break;
-    case TraceSeverity::verbose:
-      instance_->Info(message);
-      break;
-    default:
-      instance_->Info(message);
-      break;
-    }
-  }
-  /**
-   * @brief Set desired logger's level
-   *
-   * @param level A severity level.
-   */
-  Log& set_level(TraceSeverity level);
-  /**
-   * @brief Clear desired logger's level
-   *
-   * @param level A severity level.
-   */
-  Log& clear_level(TraceSeverity level);
-  /**
-   * @brief Reset all logger's levels
-   *
-   */
-  Log& reset_levels();
-
-  //! Configures enabled tracer.
-  Log& configure(TraceType lt);
-
-  //! Configures file tracer with a custom path.
-  Log& configure(TraceType lt, const std::string &filepath);
-
-  //! Configures file tracer with a custom path and rotation settings.
-  Log& configure(TraceType lt, const std::string &filepath, const RotationConfig &rotation);
-
-private:
-  Log();
-  Log(Log const &) = delete;
-  Log(Log &&) = delete;
-  Log &operator=(Log const &) = delete;
-  Log &operator=(Log &&) = delete;
-
-  /**
-   * @brief Checks against enable severity levels.
-   *
-   * @param level severity level to check.
-   * @return true if level is enabled.
-   * @return false if level is muted.
-   */
-  bool is_severity_enabled(TraceSeverity level);
-
-  //! Internal configure without locking – caller must hold instance_mutex_.
-  void configure_impl(TraceType lt);
-
-  //! Stores enabled severity level (atomic for lock-free read/write).
-  std::atomic<uint32_t> logging_level_{0};
-  //! Protects instance_ for concurrent log/configure access.
-  mutable std::shared_mutex instance_mutex_;
-  //! An instance of the actual worker tracer.
-  std::unique_ptr<Tracer> instance_;
-};
+#pragma once
+
+/*! \file A simple logger implementation */
+
+#include <mutex>
+#include <fstream>
+#include <cstdio>
+#include <format>
+#include <mutex>
+#include <memory>
+#include <iomanip>
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <unordered_map>
+#include <bit>
+#include <iterator>
+
+#include "overflow_queue.hpp"
+#include "packed_args.hpp"
+#include "timestamp.hpp"
+#include "rotation.hpp"
+#include "seekable.hpp"
+#include "binary_format.hpp"
+#include "structured.hpp"
+#include "rate_limit.hpp"
+#include "flight_recorder.hpp"
+#include "stats.hpp"
+#include "callsite.hpp"
+#include "time_index.hpp"
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <iostream>
+#endif
+
+//! Compile-time severity ranks for TINYLOG_MIN_SEVERITY.
+#define TINYLOG_LEVEL_VERBOSE 0
+#define TINYLOG_LEVEL_DEBUG 1
+#define TINYLOG_LEVEL_INFO 2
+#define TINYLOG_LEVEL_WARNING 3
+#define TINYLOG_LEVEL_ERROR 4
+#define TINYLOG_LEVEL_CRITICAL 5
+#define TINYLOG_LEVEL_OFF 6
+
+//! Statements below this rank are compiled out, e.g. -DTINYLOG_MIN_SEVERITY=TINYLOG_LEVEL_INFO.
+#ifndef TINYLOG_MIN_SEVERITY
+#define TINYLOG_MIN_SEVERITY TINYLOG_LEVEL_VERBOSE
+#endif
+
+//! The format string of a statement's arguments.
+#define TINYLOG_FIRST_(first, ...) first
+#define TINYLOG_FORMAT_(...) TINYLOG_FIRST_(__VA_ARGS__, )
+
+//! Evaluates the arguments only if the callsite is enabled at runtime or the flight recorder is on.
+//! The callsite follows the severity unless Log::set_callsites() switched it on or off.
+#define TINYLOG_LOG_(severity, ...)                                                                     \
+  do                                                                                                    \
+  {                                                                                                     \
+    static Callsite tinylog_site_(__FILE__, __LINE__, __func__, TINYLOG_FORMAT_(__VA_ARGS__), severity); \
+    if (tinylog_site_.enabled())                                                                        \
+      Log::get().log_unchecked(severity, __VA_ARGS__);                                                  \
+    else if (Log::get().is_recording())                                                                 \
+      Log::get().record(severity, __VA_ARGS__);                                                         \
+  } while (0)
+
+//! Still type-checks the format string and arguments, but generates no code.
+#define TINYLOG_DISCARD_(severity, ...)      \
+  do                                         \
+  {                                          \
+    if (false)                               \
+      Log::get().log(severity, __VA_ARGS__); \
+  } while (0)
+
+//! Key-value variants: TINYLOG_LOG_KV_(severity, message, key, value, ...).
+//! The message need not be a literal, so the callsite's format is left empty.
+#define TINYLOG_LOG_KV_(severity, ...)                                         \
+  do                                                                           \
+  {                                                                            \
+    static Callsite tinylog_site_(__FILE__, __LINE__, __func__, "", severity); \
+    if (tinylog_site_.enabled())                                               \
+      Log::get().log_kv_unchecked(severity, __VA_ARGS__);                      \
+  } while (0)
+
+#define TINYLOG_DISCARD_KV_(severity, ...)      \
+  do                                            \
+  {                                             \
+    if (false)                                  \
+      Log::get().log_kv(severity, __VA_ARGS__); \
+  } while (0)
+
+//! Macross for simple usage.
+#define LOG(...) LOG_INFO(__VA_ARGS__)
+#define LOG_LEVEL(x) Log::get().set_level(x)
+
+#if TINYLOG_MIN_SEVERITY <= TINYLOG_LEVEL_INFO
+#define LOG_INFO(...) TINYLOG_LOG_(TraceSeverity::info, __VA_ARGS__)
+#define LOG_INFO_KV(...) TINYLOG_LOG_KV_(TraceSeverity::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) TINYLOG_DISCARD_(TraceSeverity::info, __VA_ARGS__)
+#define LOG_INFO_KV(...) TINYLOG_DISCARD_KV_(TraceSeverity::info, __VA_ARGS__)
+#endif
+
+#if TINYLOG_MIN_SEVERITY <= TINYLOG_LEVEL_WARNING
+#define LOG_WARNING(...) TINYLOG_LOG_(TraceSeverity::warning, __VA_ARGS__)
+#define LOG_WARNING_KV(...) TINYLOG_LOG_KV_(TraceSeverity::warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) TINYLOG_DISCARD_(TraceSeverity::warning, __VA_ARGS__)
+#define LOG_WARNING_KV(...) TINYLOG_DISCARD_KV_(TraceSeverity::warning, __VA_ARGS__)
+#endif
+
+#if TINYLOG_MIN_SEVERITY <= TINYLOG_LEVEL_ERROR
+#define LOG_ERROR(...) TINYLOG_LOG_(TraceSeverity::error, __VA_ARGS__)
+#define LOG_ERROR_KV(...) TINYLOG_LOG_KV_(TraceSeverity::error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) TINYLOG_DISCARD_(TraceSeverity::error, __VA_ARGS__)
+#define LOG_ERROR_KV(...) TINYLOG_DISCARD_KV_(TraceSeverity::error, __VA_ARGS__)
+#endif
+
+#if TINYLOG_MIN_SEVERITY <= TINYLOG_LEVEL_CRITICAL
+#define LOG_CRITICAL(...) TINYLOG_LOG_(TraceSeverity::critical, __VA_ARGS__)
+#define LOG_CRITICAL_KV(...) TINYLOG_LOG_KV_(TraceSeverity::critical, __VA_ARGS__)
+#else
+#define LOG_CRITICAL(...) TINYLOG_DISCARD_(TraceSeverity::critical, __VA_ARGS__)
+#define LOG_CRITICAL_KV(...) TINYLOG_DISCARD_KV_(TraceSeverity::critical, __VA_ARGS__)
+#endif
+
+#if TINYLOG_MIN_SEVERITY <= TINYLOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) TINYLOG_LOG_(TraceSeverity::debug, __VA_ARGS__)
+#define LOG_DEBUG_KV(...) TINYLOG_LOG_KV_(TraceSeverity::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) TINYLOG_DISCARD_(TraceSeverity::debug, __VA_ARGS__)
+#define LOG_DEBUG_KV(...) TINYLOG_DISCARD_KV_(TraceSeverity::debug, __VA_ARGS__)
+#endif
+
+//! Always logged: calls Tracer::Fatal and dumps the flight recorder when it is on. Does not terminate.
+#define LOG_FATAL(...) Log::get().fatal(__VA_ARGS__)
+
+#define LOG_EXCEPTION(description, exception) \
+  LOG_DEBUG("{}: {} at {} {}:{}\n", description, exception.what(), __PRETTY_FUNCTION__, __FILE__, __LINE__)
+
+#if TINYLOG_MIN_SEVERITY <= TINYLOG_LEVEL_VERBOSE
+#define LOG_CALL(...) TINYLOG_LOG_(TraceSeverity::verbose, __VA_ARGS__)
+#else
+#define LOG_CALL(...) TINYLOG_DISCARD_(TraceSeverity::verbose, __VA_ARGS__)
+#endif
+
+//! Logs only if the callsite is enabled and its static limiter lets the call through.
+//! Suppressed calls evaluate no arguments and format nothing. The severity must not change between calls.
+#define TINYLOG_LOG_LIMITED_(limiter, severity, ...)                                                    \
+  do                                                                                                    \
+  {                                                                                                     \
+    static Callsite tinylog_site_(__FILE__, __LINE__, __func__, TINYLOG_FORMAT_(__VA_ARGS__), severity); \
+    if (tinylog_site_.enabled())                                                                        \
+    {                                                                                                   \
+      static auto tinylog_limiter_ = limiter;                                                           \
+      if (tinylog_limiter_.allow())                                                                     \
+        Log::get().log_unchecked(severity, __VA_ARGS__);                                                \
+    }                                                                                                   \
+  } while (0)
+
+//! Log the 1st, (n+1)th, (2n+1)th ... call, e.g. LOG_EVERY_N(TraceSeverity::error, 1000, "retry {}\n", id).
+#define LOG_EVERY_N(severity, n, ...) TINYLOG_LOG_LIMITED_(EveryN(n), severity, __VA_ARGS__)
+//! Log at most one call per ms milliseconds.
+#define LOG_EVERY_MS(severity, ms, ...) \
+  TINYLOG_LOG_LIMITED_(EveryInterval(std::chrono::milliseconds(ms)), severity, __VA_ARGS__)
+//! Log each call with the given probability in [0, 1].
+#define LOG_SAMPLED(severity, probability, ...) TINYLOG_LOG_LIMITED_(Sampler(probability), severity, __VA_ARGS__)
+//! Log at most per_second calls per second on average, in bursts of up to burst calls.
+#define LOG_RATE_LIMITED(severity, per_second, burst, ...) \
+  TINYLOG_LOG_LIMITED_(RateLimiter(per_second, burst), severity, __VA_ARGS__)
+
+//! Logs through a named logger, e.g. LOG_TO("net.http", TraceSeverity::debug, "sent {} bytes\n", n).
+//! The callsite looks its logger up once and follows its levels; name and severity must not change between calls.
+#define LOG_TO(name, severity, ...)                                                                            \
+  do                                                                                                           \
+  {                                                                                                            \
+    static Callsite tinylog_site_(__FILE__, __LINE__, __func__, TINYLOG_FORMAT_(__VA_ARGS__), severity, name); \
+    if (tinylog_site_.enabled())                                                                               \
+      Log::get().log_unchecked(severity, __VA_ARGS__);                                                         \
+    else if (Log::get().is_recording())                                                                        \
+      Log::get().record(severity, __VA_ARGS__);                                                                \
+  } while (0)
+
+//! A tracer-type class enumerator.
+enum class TraceType
+{
+  devnull,
+  console,
+  file,
+  async_file,
+  mmap_file,
+  binary_file,
+  //! A file written through io_uring (Linux); a plain file tracer elsewhere.
+  uring_file,
+  //! RFC 5424 datagrams to /dev/log, or to the "udp://host:port" given as the path (POSIX).
+  syslog,
+#if defined(__ARM_EABI__)
+  uart,
+  swd,
+  rtt
+#endif
+};
+
+//! A tracer severity class enumerator.
+enum class TraceSeverity
+{
+  info = 1,
+  warning = 2,
+  error = 4,
+  debug = 8,
+  verbose = 16,
+  critical = 32,
+};
+
+//! Header the text tracers put in front of a message, e.g. "Debug: ".
+const char *severity_header(TraceSeverity severity);
+
+//! Severity code of the binary log format.
+binlog::Severity binary_severity(TraceSeverity severity);
+
+//! Index of a severity in per-severity tables such as DropCounts.
+inline std::size_t severity_slot(TraceSeverity severity)
+{
+  return static_cast<std::size_t>(std::countr_zero(static_cast<std::uint32_t>(severity)));
+}
+
+//! Append "N messages dropped (info: a, debug: b)\n" for counts indexed by severity_slot().
+void append_drop_notice(std::string &out, const DropCounts &counts);
+
+//! When buffered file output is handed to the OS and made durable.
+//! The defaults write every message through right away, like an unbuffered stream.
+//! For "never" (OS-buffered) use a large max_buffered_bytes, no max_delay and no flush_on_error.
+struct FlushPolicy
+{
+  //! Hand data to the OS once this many bytes are buffered. 0 = after every message.
+  std::size_t max_buffered_bytes = 0;
+  //! Also hand data to the OS once the oldest buffered message is this old. 0 = no age limit.
+  //! Checked on every write, and by a timer thread of the tracer so that a quiet log is written too.
+  std::chrono::milliseconds max_delay{0};
+  //! Flush immediately on error, critical and fatal messages.
+  bool flush_on_error = true;
+  //! Make every flush durable with fdatasync() (audit logs). Expensive.
+  bool sync = false;
+};
+
+//! How FileTracer hands its buffer to the OS.
+enum class FileIo
+{
+  //! write(2) through an unbuffered stdio stream; the call returns once the kernel has the data.
+  stdio,
+  //! Queued io_uring writes with several in flight, waited for on flush() (Linux; stdio elsewhere).
+  uring,
+};
+
+/**
+ * @brief An empty string the calling thread reuses for as long as the object lives.
+ *
+ * Buffers are handed out in nesting order, so a log call made while formatting or
+ * writing another one gets a buffer of its own; past a few levels it gets a fresh string.
+ */
+class MessageBuffer
+{
+public:
+  MessageBuffer();
+  ~MessageBuffer();
+
+  MessageBuffer(const MessageBuffer &) = delete;
+  MessageBuffer &operator=(const MessageBuffer &) = delete;
+
+  std::string &text() { return *text_; }
+
+private:
+  std::string *text_;
+  //! Used when all of the thread's buffers are taken.
+  std::string own_;
+};
+
+//! A tracer abstract interface.
+class Tracer
+{
+public:
+  virtual ~Tracer() {}
+  /**
+   * @brief Generic informational message
+   */
+  virtual void Info(const std::string &message) = 0;
+  /**
+   * @brief A message usually only needed for debug purposes.
+   */
+  virtual void Debug(const std::string &message) = 0;
+  /**
+   * @brief A warning an user should pay an attention to.
+   */
+  virtual void Warning(const std::string &message) = 0;
+  /**
+   * @brief  A problem that can cause the system or application to malfunction or produce incorrect results,
+   * but it does not necessarily bring the system or application down completely.
+   */
+  virtual void Error(const std::string &message) = 0;
+
+  /**
+   * @brief A serious problem that can cause significant impact to the system or application,
+   * but the system or application can still continue to function with some limitations or degradation of service.
+   */
+  virtual void Critical(const std::string &message) = 0;
+  /**
+   * @brief A problem that causes the system or application to crash or become completely non-functional.
+   */
+  virtual void Fatal(const std::string &message) = 0;
+  /**
+   * @brief A formatted message of any severity but fatal; the entry point of Log::log().
+   *
+   * The default copies the message into a reused string and calls the severity method.
+   * Tracers that can take the view as it is override this, so a steady-state
+   * call does not allocate.
+   *
+   * @param severity a log message severity level; verbose goes to Info()
+   * @param message the message, valid only for the duration of the call
+   */
+  virtual void Write(TraceSeverity severity, std::string_view message);
+  /**
+   * @brief Push everything accepted so far to the underlying device.
+   */
+  virtual void flush() {}
+  /**
+   * @brief Accept a message whose formatting is left to the tracer.
+   *
+   * @param severity a log message severity level
+   * @param format a format string with static storage duration
+   * @param args the captured arguments
+   * @return false if the tracer wants the message formatted by the caller.
+   */
+  virtual bool Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args) { return false; }
+  /**
+   * @brief Whether the tracer stores packed arguments itself and should get Deferred() calls
+   * even when deferred formatting is off.
+   */
+  virtual bool wants_packed_args() const { return false; }
+  /**
+   * @brief A message with key-value fields.
+   *
+   * The default renders "message key=value ...\n" and passes it to the severity method.
+   *
+   * @param severity a log message severity level
+   * @param message a fixed message
+   * @param fields the fields, valid only for the duration of the call
+   * @param count number of fields
+   */
+  virtual void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count);
+  /**
+   * @brief Append the counters of every output device behind the tracer, see Log::stats().
+   */
+  virtual void collect_stats(std::vector<SinkStats> &out) {}
+};
+
+class UringWriter;
+
+//! A file tracer. Logs messages to a file with optional rotation & zstd compression.
+class FileTracer : public Tracer
+{
+public:
+  //! With a FlushPolicy::max_delay and flush_timer, a background thread writes data buffered that
+  //! long; an owner that calls flush_if_stale() from a thread of its own passes false.
+  explicit FileTracer(const std::string &filepath = "log.txt",
+                      const RotationConfig &rotation = {},
+                      const FlushPolicy &flush = {},
+                      FileIo io = FileIo::stdio,
+                      bool flush_timer = true);
+  //! Flushes pending data before closing the file.
+  ~FileTracer();
+
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  void Fatal(const std::string &message) override;
+  //! Appends straight into the write buffer.
+  void Write(TraceSeverity severity, std::string_view message) override;
+  //! Writes out the buffer, and syncs it if the policy asks for durability.
+  void flush() override;
+  //! Renders the record straight into the write buffer in the current OutputFormat.
+  void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) override;
+  void collect_stats(std::vector<SinkStats> &out) override;
+
+  /**
+   * @brief Append a single line stamped with the given time, flushing as the policy dictates.
+   *
+   * @param when capture time of the message, see timestamp_now()
+   * @param header severity header, e.g. "Debug: "
+   * @param message already formatted message
+   * @param urgent the message is an error or worse
+   */
+  void write_record(std::int64_t when, const char *header, std::string_view message, bool urgent = false);
+
+  //! Structured() with a given capture time, for records written on another thread.
+  void write_structured(std::int64_t when, TraceSeverity severity, std::string_view message, const Field *fields,
+                        std::size_t count);
+
+  //! Append bytes as they are, flushing as the policy dictates.
+  void write_raw(std::string_view bytes, bool urgent = false);
+
+  //! Number of times a file was opened; changes when the tracer rotates into a new file.
+  std::uint64_t files_opened() const { return files_opened_; }
+
+  //! Flush if the oldest buffered message exceeded FlushPolicy::max_delay.
+  void flush_if_stale();
+
+  //! Open the active file again if a rotation could not; throws like the constructor.
+  void reopen();
+
+  //! Maximum time buffered data may wait before flush_if_stale() writes it; 0 = no limit.
+  std::chrono::milliseconds max_flush_delay() const { return flush_policy_.max_delay; }
+
+private:
+  //! Flush and rotate as the policy dictates after appending to buffer_; caller must hold mutex_.
+  void commit_locked(bool urgent);
+  /**
+   * @brief Hand the buffer to the OS; caller must hold mutex_.
+   *
+   * @param sync with io_uring, link an fdatasync to the write
+   * @return false if there was nothing to write, or compression failed and the buffer was kept
+   */
+  bool write_buffer(bool sync = false);
+  //! Write bytes to the active file; caller must hold mutex_.
+  void write_out(std::string_view bytes, bool sync = false);
+  bool is_open() const;
+  //! write_buffer() plus fdatasync when configured; caller must hold mutex_.
+  void flush_locked();
+  //! Open (or re-open) the active log file.
+  void open_log_file();
+  //! Check whether the current file exceeds the size limit and rotate if needed.
+  void maybe_rotate();
+  //! Close the file, hand it to the rotator and reopen.
+  void rotate();
+  //! Flush and close the active file, appending the seek table when compressing live.
+  void close_log_file();
+  //! Append one line in the given format; prefix is the text-format timestamp. Caller must hold mutex_.
+  void append_locked(OutputFormat format, std::int64_t when, std::string_view prefix, const char *header,
+                     std::string_view message);
+  //! Append a "last message repeated" line if repeats > 0; caller must hold mutex_.
+  void append_repeats_locked(OutputFormat format, std::int64_t when, const char *header, std::uint64_t repeats);
+  //! Writes data buffered longer than FlushPolicy::max_delay.
+  void flusher_loop();
+
+  //! Path to the active log file.
+  std::filesystem::path filepath_;
+  //! Current number of bytes written since the file was opened.
+  std::size_t current_size_ = 0;
+  //! Incremented by open_log_file().
+  std::uint64_t files_opened_ = 0;
+  //! Moves full files into the backup chain and compresses them in the background.
+  LogRotator rotator_;
+  //! Flush / durability configuration.
+  FlushPolicy flush_policy_;
+  //! A handle to the file, unbuffered at the C library level: buffer_ is the only buffer.
+  std::FILE *file_handle_ = nullptr;
+#if defined(__linux__)
+  //! Replaces file_handle_ for FileIo::uring.
+  std::unique_ptr<UringWriter> uring_;
+#endif
+  //! Pending lines not yet handed to the OS.
+  std::string buffer_;
+  //! When the first line in buffer_ was added.
+  std::chrono::steady_clock::time_point buffered_since_;
+  //! Frame compressor for RotationConfig::compress_live, null otherwise.
+  std::unique_ptr<SeekableZstdWriter> seekable_;
+  //! Compressed frame scratch buffer.
+  std::string compressed_;
+  //! Sidecar time index for RotationConfig::time_index, null otherwise.
+  std::unique_ptr<TimeIndexWriter> index_;
+  //! Collapses repeated messages when set_duplicate_collapsing() is on.
+  DuplicateFilter duplicates_;
+  //! Written under mutex_.
+  SinkCounters counters_;
+  //! A mutex to protect filestream.
+  std::mutex mutex_;
+  std::thread flusher_;
+  std::condition_variable flusher_cv_;
+  bool stopping_ = false;
+};
+
+//! A record handed from a logging thread to a background writer.
+struct AsyncRecord
+{
+  //! Capture time of the message, see timestamp_now().
+  std::int64_t when = 0;
+  //! Severity header, points to a string literal.
+  const char *header = "";
+  //! Error or worse, subject to FlushPolicy::flush_on_error.
+  bool urgent = false;
+  //! Formatted message, used when format is empty.
+  //! A Structured() record keeps its fields here as well, packed after the text.
+  std::string message;
+  //! Offset in message where the fields start, after the text; npos if there are none.
+  std::size_t fields_offset = std::string::npos;
+  //! Format string of a deferred message.
+  std::string_view format;
+  //! Arguments of a deferred message.
+  PackedArgs args;
+  //! Severity the message was logged with; Fatal records use critical.
+  TraceSeverity severity = TraceSeverity::info;
+  //! Written by Fatal(); never dropped, whatever the overflow policy.
+  bool fatal = false;
+
+  //! OverflowPolicy::drop_by_severity and drop_oldest keep error and worse.
+  bool droppable() const { return !urgent && !fatal; }
+  std::size_t severity_slot() const { return ::severity_slot(severity); }
+};
+
+/**
+ * @brief Base of the tracers that hand records to a background writer thread.
+ *
+ * Owns the bounded queue, the writer thread and the flush accounting; a subclass only
+ * writes the records the writer drains. It calls start_writer() at the end of its
+ * constructor and stop_writer() first thing in its destructor, so that the writer never
+ * runs while the subclass is only partly alive.
+ */
+class AsyncTracer : public Tracer
+{
+public:
+  //! Stops the writer if the subclass has not.
+  ~AsyncTracer();
+
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  //! Enqueues the message, never dropped, and calls flush().
+  void Fatal(const std::string &message) override;
+  void Write(TraceSeverity severity, std::string_view message) override;
+  //! Enqueues the raw arguments; the writer thread formats them.
+  bool Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args) override;
+  //! Enqueues the message with copies of the fields.
+  void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) override;
+
+  //! Messages of a severity dropped by the overflow policy so far.
+  std::uint64_t dropped(TraceSeverity severity) const { return queue_.dropped(severity_slot(severity)); }
+  //! Records lost because the sink threw on the writer thread.
+  std::uint64_t write_errors() const { return write_errors_.get(); }
+
+protected:
+  /**
+   * @param config queue size and overflow policy
+   * @param idle_wait how long the idle writer sleeps before calling idle() again; 0 = until woken
+   */
+  explicit AsyncTracer(const AsyncConfig &config, std::chrono::milliseconds idle_wait = {});
+
+  void start_writer();
+  //! Drain the queue and join the writer; idempotent.
+  void stop_writer();
+  //! Block until every record enqueued before the call was written, or dropped.
+  void drain();
+  //! Mark the entry as queued and add the queue's counters to it.
+  void add_queue_stats(SinkStats &stats) const;
+  /**
+   * @brief The message of a record as one text, in a scratch buffer if needed. Writer thread only.
+   *
+   * Deferred arguments are formatted; the fields of a Structured() record are appended
+   * as "key=value" with a line end, see render_fields().
+   */
+  std::string_view text(const AsyncRecord &record);
+  /**
+   * @brief Split a Structured() record into its message and fields. Writer thread only.
+   *
+   * @return the fields, valid until the next call and while the record is; a record whose
+   *         fields were cut off by the queue's byte budget keeps those that fit.
+   */
+  const std::vector<Field> &fields(const AsyncRecord &record, std::string_view &message);
+
+  //! Called on the writer before the first record of a batch.
+  virtual void begin_batch() {}
+  //! Write one record; an exception is counted in write_errors_ and loses the record.
+  virtual void write_record(const AsyncRecord &record) = 0;
+  //! Called on the writer after the last record of a batch, before flush() callers are woken.
+  virtual void end_batch() {}
+  //! Called on the writer before it goes to sleep on an empty queue.
+  virtual void idle() {}
+
+  StatCounter write_errors_;
+
+private:
+  //! Push a record, applying the overflow policy if the queue is full.
+  void enqueue(AsyncRecord &&record);
+  //! Count records that left the queue, written or dropped, waking flush() callers.
+  void retire(std::size_t count);
+  //! Wake the writer if it is sleeping.
+  void wake_writer();
+  //! Call a writer hook, counting an exception as a write error.
+  template <typename Hook>
+  void guarded(Hook &&hook);
+  //! Background writer thread body.
+  void writer_loop();
+
+  //! Pending records.
+  OverflowQueue<AsyncRecord> queue_;
+  //! Most records the writer found waiting.
+  StatCounter high_water_;
+  //! See the constructor.
+  std::chrono::milliseconds idle_wait_;
+  //! Scratch buffers of text() and fields(), so steady-state formatting does not allocate.
+  std::string formatted_;
+  std::vector<Field> fields_;
+  //! Number of records accepted by the queue.
+  std::atomic<std::uint64_t> enqueued_{0};
+  //! Number of records written by the writer, or dropped.
+  std::atomic<std::uint64_t> written_{0};
+  //! Number of flush() calls waiting for written_.
+  std::atomic<int> flush_waiters_{0};
+  //! Set while the writer waits for work.
+  std::atomic<bool> writer_idle_{false};
+  //! Asks the writer to drain the queue and exit.
+  std::atomic<bool> stop_{false};
+  //! Protects the condition variables below.
+  std::mutex wake_mutex_;
+  //! Signals the writer about new records.
+  std::condition_variable wake_cv_;
+  //! Signals flush() callers about written records.
+  std::condition_variable drained_cv_;
+  std::thread writer_;
+};
+
+//! A file tracer that hands records to a background writer thread.
+//! Callers only pay for a queue push; timestamping, rotation and disk I/O happen on the writer.
+class AsyncFileTracer : public AsyncTracer
+{
+public:
+  explicit AsyncFileTracer(const std::string &filepath = "log.txt",
+                           const RotationConfig &rotation = {},
+                           const AsyncConfig &async = {},
+                           const FlushPolicy &flush = {});
+  //! Drains the queue before closing the file.
+  ~AsyncFileTracer();
+
+  //! Blocks until every record enqueued before the call is written and flushed.
+  void flush() override;
+  //! The file's counters plus the queue's.
+  void collect_stats(std::vector<SinkStats> &out) override;
+
+protected:
+  //! Retries opening the file after a write error.
+  void begin_batch() override;
+  void write_record(const AsyncRecord &record) override;
+  //! Group commit: one flush per drained batch instead of one per line.
+  void end_batch() override;
+  //! Writes a buffer older than FlushPolicy::max_delay.
+  void idle() override;
+
+private:
+  //! The actual file sink, only written from the writer thread.
+  FileTracer sink_;
+  //! Flush after each drained batch (FlushPolicy::max_buffered_bytes == 0).
+  bool flush_per_batch_;
+  //! Cleared by a failed write; the file is reopened once per batch until that works again.
+  bool sink_ok_ = true;
+};
+
+/**
+ * @brief A file tracer that writes compact binary records, see binary_format.hpp.
+ *
+ * Stores the timestamp, severity, thread, an interned format-string id and the packed
+ * arguments instead of formatted text; tinylog-decode turns the file back into text.
+ * Messages with arguments that cannot be packed are stored preformatted.
+ */
+class BinaryFileTracer : public Tracer
+{
+public:
+  explicit BinaryFileTracer(const std::string &filepath = "log.bin",
+                            const RotationConfig &rotation = {},
+                            const FlushPolicy &flush = {});
+
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  void Fatal(const std::string &message) override;
+  void Write(TraceSeverity severity, std::string_view message) override;
+  void flush() override;
+  //! Stores the arguments without formatting them.
+  bool Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args) override;
+  bool wants_packed_args() const override { return true; }
+  void collect_stats(std::vector<SinkStats> &out) override { sink_.collect_stats(out); }
+
+private:
+  //! Encode one record, with either packed arguments or a preformatted message.
+  void write(binlog::Severity severity, std::string_view format, const PackedArgs *args, std::string_view message);
+
+  //! The file sink; buffering, rotation and compression work as for text.
+  FileTracer sink_;
+  //! FileTracer::files_opened() when the current header was written.
+  std::uint64_t file_generation_ = 0;
+  //! Ids of the format strings defined in the current file, keyed by address.
+  std::unordered_map<const char *, std::uint32_t> formats_;
+  //! Timestamp of the previous record in the current file.
+  std::int64_t last_when_ = 0;
+  //! Encoding scratch buffers.
+  std::string entry_;
+  std::string args_;
+  //! Serializes encoding; records must reach the sink in timestamp-delta order.
+  std::mutex mutex_;
+};
+
+#if !((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+/**
+ * @brief A file tracer that appends into preallocated, memory-mapped segments.
+ *
+ * Appending a line reserves space with a CAS on the segment's write offset and copies
+ * into the mapping; only segment rollover takes a lock and makes syscalls.
+ * The file is truncated to its real length on rotation and close.
+ * RotationConfig::compress_live is not supported and ignored.
+ *
+ * Lines are visible to readers as soon as they are copied, so FlushPolicy's buffer
+ * limits do not apply; flush_on_error and sync choose how error and critical lines,
+ * flush() and segment rollover are written back with msync().
+ */
+class MappedFileTracer : public Tracer
+{
+public:
+  //! Default size of a preallocated segment.
+  static constexpr std::size_t default_segment_size = 16 * 1024 * 1024;
+
+  explicit MappedFileTracer(const std::string &filepath = "log.txt",
+                            const RotationConfig &rotation = {},
+                            const FlushPolicy &flush = {},
+                            std::size_t segment_size = default_segment_size);
+  //! Truncates the file to its real length and closes it.
+  ~MappedFileTracer();
+
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  //! Appends the message and writes the current segment back before returning.
+  void Fatal(const std::string &message) override;
+  void Write(TraceSeverity severity, std::string_view message) override;
+  //! Renders the fields in the current output_format().
+  void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) override;
+  //! Schedules the current segment for writeback, or waits for it with FlushPolicy::sync;
+  //! data is visible to readers without it.
+  void flush() override;
+  //! Bytes are counted per segment; lines still being copied are not included.
+  void collect_stats(std::vector<SinkStats> &out) override;
+
+private:
+  //! Bits of Segment::reserved holding the offset; the generation of the mapping is above them.
+  static constexpr unsigned offset_bits = 40;
+  static constexpr std::uint64_t offset_mask = (std::uint64_t(1) << offset_bits) - 1;
+
+  /**
+   * @brief A mapped window of the file, remapped in place on every rollover.
+   *
+   * A writer may still hold the pointer from before a rollover. The generation in
+   * reserved makes its reservation fail, so it never writes into the new mapping with
+   * an offset checked against the old one.
+   */
+  struct Segment
+  {
+    //! Start of the mapping, page aligned; read by writers once they reserved space.
+    char *base = nullptr;
+    //! Size of the mapping, below 2^offset_bits.
+    std::atomic<std::size_t> capacity{0};
+    //! File offset of base.
+    std::uint64_t file_offset = 0;
+    //! Generation << offset_bits | offset within the mapping up to which space has been handed out.
+    //! An offset of offset_mask seals the segment.
+    alignas(64) std::atomic<std::uint64_t> reserved{offset_mask};
+    //! Offset within the mapping up to which writers have finished copying.
+    alignas(64) std::atomic<std::size_t> committed{0};
+  };
+
+  //! Reserve space in the current segment and copy the line in; urgent lines follow flush_on_error.
+  void append(std::int64_t when, const char *header, std::string_view message, bool urgent = false);
+  //! Reserve space for a whole line and copy it in.
+  void append_line(std::string_view line, bool urgent);
+  //! msync() the current segment with MS_SYNC or MS_ASYNC. Caller holds mutex_.
+  void sync_current(bool wait);
+  //! Replace the current segment unless it has room for needed bytes; takes mutex_.
+  //! Returns false once the file is closed.
+  bool roll_over(std::size_t needed);
+  //! Seal the current segment, wait for its writers and unmap it. Caller holds mutex_.
+  void retire_current();
+  //! Open the active file and drop the unused tail a crash left behind. Caller holds mutex_.
+  void open_log_file();
+  //! Truncate to the real length and close. Caller holds mutex_.
+  void close_log_file();
+  //! Map the segment at file_length_ and publish it. Caller holds mutex_.
+  bool map_segment(std::size_t needed);
+
+  //! Path to the active log file.
+  std::filesystem::path filepath_;
+  //! Moves full files into the backup chain.
+  LogRotator rotator_;
+  //! Only flush_on_error and sync apply.
+  FlushPolicy flush_policy_;
+  //! Preferred segment size, a multiple of the page size.
+  std::size_t segment_size_;
+  //! Page size of the system.
+  std::size_t page_size_;
+  //! File descriptor of the active file.
+  int fd_ = -1;
+  //! Bytes of log data in the file, excluding the preallocated tail; valid while no segment is current.
+  std::uint64_t file_length_ = 0;
+  //! The only segment, allocated once; lives as long as the tracer since writers may hold it.
+  std::unique_ptr<Segment> segment_ = std::make_unique<Segment>();
+  //! segment_ while it is mapped, for new lines to go to.
+  std::atomic<Segment *> current_{nullptr};
+  //! Bytes committed to retired segments, msync calls and rotations; written under mutex_.
+  SinkCounters counters_;
+  //! Serializes rollover, rotation and close.
+  std::mutex mutex_;
+};
+#endif
+
+//! Where and how SyslogTracer sends records.
+struct SyslogConfig
+{
+  //! A Unix datagram socket path such as "/dev/log", or "udp://host:port", e.g. "udp://127.0.0.1:514" or "udp://[::1]:514".
+  std::string address = "/dev/log";
+  //! Syslog facility 0-23: 1 is user-level messages, 16-23 are local0-local7.
+  int facility = 1;
+  //! APP-NAME field; empty for the program name.
+  std::string app_name;
+  //! HOSTNAME field; empty for gethostname().
+  std::string hostname;
+  //! Most datagrams handed to the kernel per sendmmsg call.
+  std::size_t batch_size = 64;
+  //! Longest datagram; longer records are truncated. RFC 5424 receivers should accept 2048 bytes.
+  std::size_t max_datagram = 2048;
+  //! Queue size and overflow policy.
+  AsyncConfig queue{};
+};
+
+#if !((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+/**
+ * @brief Sends RFC 5424 syslog records as datagrams, over UDP or a Unix socket such as /dev/log.
+ *
+ * Callers only pay for a queue push; a writer thread formats the drained records and
+ * hands up to SyslogConfig::batch_size datagrams to the kernel with one sendmmsg call.
+ * Datagrams the receiver refuses are counted and dropped; a Unix socket is reconnected
+ * once per batch, so a restarted syslog daemon is picked up again.
+ */
+class SyslogTracer : public AsyncTracer
+{
+public:
+  //! Throws std::runtime_error if the address cannot be resolved or connected.
+  explicit SyslogTracer(const SyslogConfig &config = {});
+  //! Drains the queue before closing the socket.
+  ~SyslogTracer();
+
+  //! Blocks until every record enqueued before the call was sent or dropped.
+  void flush() override;
+  //! Datagrams and bytes sent plus the queue's counters.
+  void collect_stats(std::vector<SinkStats> &out) override;
+
+  //! Datagrams the socket refused so far, e.g. because nothing listened on the UDP port.
+  std::uint64_t send_errors() const { return send_errors_.get(); }
+
+protected:
+  //! Renders the record, with alert priority if it is fatal, and sends a full batch.
+  void write_record(const AsyncRecord &record) override;
+  //! Sends what is left of the batch.
+  void end_batch() override;
+
+private:
+  //! Resolve the address and connect a new socket; throws std::runtime_error on failure.
+  void connect_socket();
+  //! Render one record into the next free datagram of the batch.
+  void render(std::int64_t when, int severity, std::string_view message);
+  //! Send the rendered datagrams and empty the batch.
+  void send_batch();
+
+  SyslogConfig config_;
+  //! " HOSTNAME APP-NAME PROCID - - ", written between the timestamp and the message.
+  std::string fields_;
+  //! Socket connected to the receiver.
+  int fd_ = -1;
+  //! The address names a Unix socket rather than a UDP port.
+  bool local_ = false;
+  //! Datagrams of the current batch and their sendmmsg headers, reused between batches.
+  struct Batch;
+  std::unique_ptr<Batch> batch_;
+  //! Second of the cached timestamp prefix, and the prefix "YYYY-MM-DDTHH:MM:SS".
+  std::int64_t cached_second_ = -1;
+  char cached_time_[20] = {};
+  //! Datagram bytes and sendmmsg calls; written by the writer thread.
+  SinkCounters counters_;
+  StatCounter send_errors_;
+};
+#endif
+
+//! Mask of the given severities, e.g. for SinkConfig::severities.
+template <typename... Severities>
+constexpr std::uint32_t severity_mask(Severities... severities)
+{
+  return (static_cast<std::uint32_t>(severities) | ... | 0u);
+}
+
+//! How a sink of a MultiTracer receives messages.
+struct SinkConfig
+{
+  //! TraceSeverity bits the sink receives, see severity_mask(); Fatal always goes to every sink.
+  std::uint32_t severities = ~0u;
+  //! Give the sink its own queue and writer thread, so a slow sink cannot stall the others.
+  bool own_queue = false;
+  //! Queue size and overflow policy when own_queue is set.
+  AsyncConfig queue{};
+};
+
+/**
+ * @brief Runs any tracer on a writer thread of its own, behind a bounded queue.
+ *
+ * A full queue is handled by the AsyncConfig's overflow policy.
+ */
+class QueuedTracer : public AsyncTracer
+{
+public:
+  QueuedTracer(std::shared_ptr<Tracer> target, const AsyncConfig &config);
+  //! Drains the queue.
+  ~QueuedTracer();
+
+  //! Blocks until every record enqueued before the call reached the target, then flushes it.
+  void flush() override;
+  bool wants_packed_args() const override { return target_->wants_packed_args(); }
+  //! The target's counters plus the queue's.
+  void collect_stats(std::vector<SinkStats> &out) override;
+
+protected:
+  //! Hands the record to the target, offering it the packed arguments first and the fields
+  //! of a Structured() record through the target's Structured().
+  void write_record(const AsyncRecord &record) override;
+
+private:
+  //! The wrapped tracer, only called from the writer thread.
+  std::shared_ptr<Tracer> target_;
+};
+
+/**
+ * @brief Fans every message out to several sinks, each with its own severity mask.
+ *
+ * The message is formatted once and passed to every sink by reference. A sink that throws
+ * does not keep the message from the others; the first exception reaches the caller once
+ * every sink had the message. The sink list is immutable; Log::add_sink() and
+ * Log::remove_sink() install a new MultiTracer sharing the remaining sinks, so logging
+ * threads never wait for a change of the list.
+ */
+class MultiTracer : public Tracer
+{
+public:
+  using SinkId = std::uint64_t;
+
+  //! A registered sink.
+  struct Sink
+  {
+    SinkId id = 0;
+    //! TraceSeverity bits the sink receives.
+    std::uint32_t severities = ~0u;
+    std::shared_ptr<Tracer> tracer;
+  };
+
+  explicit MultiTracer(std::vector<Sink> sinks);
+
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  void Fatal(const std::string &message) override;
+  //! Passes the view on to every sink that takes the severity.
+  void Write(TraceSeverity severity, std::string_view message) override;
+  void flush() override;
+  //! Offers the packed arguments to each sink; formats them once for the sinks that decline.
+  bool Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args) override;
+  void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) override;
+  bool wants_packed_args() const override { return wants_packed_args_; }
+  void collect_stats(std::vector<SinkStats> &out) override;
+
+  const std::vector<Sink> &sinks() const { return sinks_; }
+
+private:
+  //! Pass a formatted message to every sink that takes the severity.
+  void dispatch(TraceSeverity severity, std::string_view message);
+
+  std::vector<Sink> sinks_;
+  //! Some sink wants packed arguments.
+  bool wants_packed_args_ = false;
+};
+
+//! A void tracer. Used when you want to silent all message or there is nowhere to output.
+class VoidTracer : public Tracer
+{
+public:
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Fatal(const std::string &message) override;
+  void Write(TraceSeverity severity, std::string_view message) override;
+  void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) override;
+};
+
+//! Output settings of the console tracer; the stream and color settings apply outside Windows.
+struct ConsoleConfig
+{
+  //! When batched lines are written; the default writes every line through. sync is ignored.
+  //! With a max_delay, a background thread writes lines that waited that long.
+  FlushPolicy flush{};
+  //! Send error, critical and fatal lines to stderr instead of stdout.
+  bool errors_to_stderr = false;
+  //! Color plain-text lines by severity with ANSI codes, on streams that are terminals.
+  bool colors = true;
+};
+
+//! A console/terminal tracer.
+class ConsoleTracer : public Tracer
+{
+public:
+  explicit ConsoleTracer(const ConsoleConfig &config = {});
+  void Info(const std::string &message) override;
+  void Debug(const std::string &message) override;
+  void Warning(const std::string &message) override;
+  void Critical(const std::string &message) override;
+  void Error(const std::string &message) override;
+  void Fatal(const std::string &message) override;
+  void Write(TraceSeverity severity, std::string_view message) override;
+  void Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count) override;
+  //! Reports a pending run of collapsed duplicates and writes out batched lines.
+  void flush() override;
+  void collect_stats(std::vector<SinkStats> &out) override;
+  ~ConsoleTracer();
+
+private:
+  /**
+   * @brief Render a plain message into line_ – caller must hold mutex_.
+   *
+   * @return false if the message is a collapsed duplicate and there is nothing to write.
+   */
+  bool render(const char *header, std::string_view message);
+  //! Internal write without locking – caller must hold mutex_.
+  void write_impl(const std::string &formatted);
+
+  ConsoleConfig config_;
+  //! Line being written, reused between calls.
+  std::string line_;
+  //! Collapses repeated messages when set_duplicate_collapsing() is on.
+  DuplicateFilter duplicates_;
+  //! Written under mutex_.
+  SinkCounters counters_;
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  //! A handle to a terminal.
+  HANDLE std_out_;
+#else
+  /**
+   * @brief Queue a line for stdout or stderr, writing as the flush policy dictates – caller must hold mutex_.
+   *
+   * @param color ANSI color of the line, nullptr for none
+   * @param urgent an error or worse; goes to stderr if configured
+   */
+  void write_line(std::string_view line, const char *color, bool urgent);
+  //! Write out a stream's batched lines, plus an optional line, in one writev – caller must hold mutex_.
+  void write_stream(int stream, std::string_view line = {}, const char *color = nullptr);
+  //! Write out both streams – caller must hold mutex_.
+  void write_pending();
+  //! Writes lines that waited longer than FlushPolicy::max_delay.
+  void flusher_loop();
+
+  //! File descriptors of stdout and stderr.
+  static constexpr int stream_fds_[2] = {1, 2};
+  //! Batched output per stream, indexed like stream_fds_.
+  std::string pending_[2];
+  //! The stream is a terminal and colors are on.
+  bool colored_[2] = {};
+  //! When the oldest batched line was added.
+  std::chrono::steady_clock::time_point buffered_since_;
+  std::thread flusher_;
+  std::condition_variable flusher_cv_;
+  bool stopping_ = false;
+#endif
+  //! A mutex to protect terminal.
+  std::mutex mutex_;
+};
+
+/**
+ * @brief A named logger with its own enabled severities, e.g. Log::get("net.http").
+ *
+ * Names form a dot-separated hierarchy below the root, Log::get() itself. A logger
+ * that never had a level set follows its parent, so enabling debug on "net" enables it
+ * for "net.http" as well, unless that set levels of its own. Configuration rewrites the
+ * level words of the affected loggers under a lock; the enabled check reads one word.
+ * Loggers live as long as the process, so references to them may be kept.
+ */
+class Logger
+{
+public:
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  //! Dot-separated name; empty for the root.
+  const std::string &name() const { return name_; }
+  //! Checks against the enabled severities, its own or inherited.
+  bool is_severity_enabled(TraceSeverity level) const
+  {
+    return (levels_.load(std::memory_order_relaxed) & static_cast<std::uint32_t>(level)) != 0;
+  }
+  //! Log through the process-wide tracer if the severity is enabled here, see Log::log().
+  template <typename... Args>
+  void log(TraceSeverity severity, std::format_string<Args...> format, Args &&...args);
+  //! Log key-value fields if the severity is enabled here, see Log::log_kv().
+  template <typename... KV>
+  void log_kv(TraceSeverity severity, std::string_view message, const KV &...kv);
+
+  //! Enable a severity here and below; the logger stops following its parent.
+  Logger &set_level(TraceSeverity level);
+  //! Disable a severity here and below; the logger stops following its parent.
+  Logger &clear_level(TraceSeverity level);
+  //! Disable every severity here and below; the logger stops following its parent.
+  Logger &reset_levels();
+  //! Follow the parent's severities again. Has no effect on the root.
+  Logger &inherit_levels();
+
+private:
+  friend class Log;
+
+  Logger(std::string name, Logger *parent);
+
+  //! Apply a change to the own levels and pass the result down; caller holds the logger tree lock.
+  void configure_locked(std::uint32_t levels, bool own);
+  //! Recompute levels_ from the parent's and update the children; caller holds the logger tree lock.
+  void propagate_locked(std::uint32_t inherited);
+
+  const std::string name_;
+  Logger *const parent_;
+  //! Written under the logger tree lock.
+  std::vector<Logger *> children_;
+  //! Levels were set on this logger; written under the logger tree lock.
+  bool own_levels_ = false;
+  //! Effective severities, read without locking.
+  std::atomic<std::uint32_t> levels_{0};
+};
+
+//! A log singletone facade.
+class Log
+{
+public:
+  /**
+   * @brief Get an instance of a logger.
+   *
+   * @return Log& A logger's singletone instance
+   */
+  static Log &get()
+  {
+    static Log instance;
+    return instance;
+  }
+
+  /**
+   * @brief Get the named logger, creating it and any missing parents, e.g. "net" for "net.http".
+   *
+   * Takes a lock; call sites look their logger up once, see LOG_TO.
+   *
+   * @param name dot-separated name; empty for the root, whose levels are Log's own.
+   */
+  static Logger &get(std::string_view name);
+
+  /**
+   * @brief A main logging entry point for an user.
+   *
+   * @tparam Args
+   * @param severity a log message severity level
+   * @param format a format string, validated against the arguments at compile time
+   * @param args
+   */
+  template <typename... Args>
+  void log(TraceSeverity severity, std::format_string<Args...> format, Args &&...args)
+  {
+    if (!is_severity_enabled(severity))
+    {
+      // This channel is muted.
+      return;
+    }
+    emit(severity, format.get(), args...);
+  }
+  /**
+   * @brief Capture a call in the flight recorder without formatting it or passing it to the tracer.
+   *
+   * Arguments PackedArgs cannot hold are formatted and stored as text.
+   *
+   * @param severity a log message severity level, recorded even if muted
+   * @param format a format string, validated against the arguments at compile time
+   * @param args
+   */
+  template <typename... Args>
+  void record(TraceSeverity severity, std::format_string<Args...> format, Args &&...args)
+  {
+    record_as(binary_severity(severity), format.get(), args...);
+  }
+  /**
+   * @brief Log a message that ends the useful life of the process.
+   *
+   * Always logged regardless of the enabled levels. The message goes to Tracer::Fatal, and
+   * the flight recorder, when on, is dumped to its configured file. Does not terminate.
+   */
+  template <typename... Args>
+  void fatal(std::format_string<Args...> format, Args &&...args)
+  {
+    CallStats::Scope stats(call_stats_, severity_slot(TraceSeverity::critical));
+    if (is_recording())
+      record_as(binlog::Severity::fatal, format.get(), args...);
+    write_fatal(std::vformat(format.get(), std::make_format_args(args...)));
+  }
+  /**
+   * @brief Log a fixed message with key-value fields, e.g.
+   * log_kv(TraceSeverity::info, "request done", "status", 200, "latency_us", 1532).
+   *
+   * Values may be arithmetic, pointer or string types. Strings are not copied; the
+   * tracer renders the record before the call returns.
+   *
+   * @param severity a log message severity level
+   * @param message the message
+   * @param kv alternating keys and values
+   */
+  template <typename... KV>
+  void log_kv(TraceSeverity severity, std::string_view message, const KV &...kv)
+  {
+    static_assert(sizeof...(KV) % 2 == 0, "keys and values must come in pairs");
+    if (is_severity_enabled(severity))
+      emit_kv(severity, message, kv...);
+  }
+  //! log() without checking the enabled severities, for callsites that decided already.
+  template <typename... Args>
+  void log_unchecked(TraceSeverity severity, std::format_string<Args...> format, Args &&...args)
+  {
+    emit(severity, format.get(), args...);
+  }
+  //! log_kv() without checking the enabled severities, for callsites that decided already.
+  template <typename... KV>
+  void log_kv_unchecked(TraceSeverity severity, std::string_view message, const KV &...kv)
+  {
+    static_assert(sizeof...(KV) % 2 == 0, "keys and values must come in pairs");
+    emit_kv(severity, message, kv...);
+  }
+  //! Whether the flight recorder captures calls.
+  bool is_recording() const
+  {
+    return recording_.load(std::memory_order_relaxed);
+  }
+  /**
+   * @brief Checks against enable severity levels.
+   *
+   * @param level severity level to check.
+   * @return true if level is enabled.
+   * @return false if level is muted.
+   */
+  bool is_severity_enabled(TraceSeverity level) const
+  {
+    return root_.is_severity_enabled(level);
+  }
+  /**
+   * @brief Set desired logger's level
+   *
+   * @param level A severity level.
+   */
+  Log& set_level(TraceSeverity level);
+  /**
+   * @brief Clear desired logger's level
+   *
+   * @param level A severity level.
+   */
+  Log& clear_level(TraceSeverity level);
+  /**
+   * @brief Reset all logger's levels
+   *
+   */
+  Log& reset_levels();
+  /**
+   * @brief Let buffered tracers capture arguments in binary form and format them on their writer thread.
+   *
+   * Applies to calls with a string-literal format and arithmetic, pointer or string arguments;
+   * everything else, and every call on an unbuffered tracer, is still formatted by the caller.
+   * TraceType::binary_file captures arguments regardless of this setting.
+   *
+   * @param enabled true to defer formatting.
+   */
+  Log& set_deferred_formatting(bool enabled);
+  /**
+   * @brief Select the clock, layout and sub-second precision of message timestamps.
+   *
+   * @param config timestamp settings, applied process-wide.
+   */
+  Log& set_timestamp(const TimestampConfig &config);
+  /**
+   * @brief Select plain text, JSON Lines or logfmt output for the file and console tracers.
+   *
+   * @param format output format, applied process-wide.
+   */
+  Log& set_output_format(OutputFormat format);
+  /**
+   * @brief Collapse runs of identical consecutive messages into "last message repeated N times".
+   *
+   * Applies to the plain messages of the file and console tracers.
+   *
+   * @param enabled true to collapse duplicates.
+   * @param report_interval how often a run still going on is reported.
+   */
+  Log& set_collapse_duplicates(bool enabled, std::chrono::seconds report_interval = std::chrono::seconds(30));
+
+  /**
+   * @brief List the LOG_* statements that ran at least once, newest first.
+   *
+   * Each one holds its file, line, function, format string, severity, logger and mode.
+   */
+  std::vector<const Callsite *> callsites() const;
+  /**
+   * @brief Switch matching LOG_* statements on or off regardless of the enabled severities,
+   * or back to following them with CallsiteMode::follow.
+   *
+   * Applies to statements that have not run yet as well; the newest matching call wins.
+   * Calling it again with an equal filter replaces the earlier call's effect.
+   * A statement switched off costs as much as one whose severity is disabled.
+   *
+   * @param filter file, function, format and line to match, e.g. {.file = "http.cc", .function = "send*"}
+   * @param mode on, off or follow
+   * @return number of statements that ran already and matched.
+   */
+  std::size_t set_callsites(const CallsiteFilter &filter, CallsiteMode mode);
+  //! Undo every set_callsites() call; all statements follow the enabled severities again.
+  Log& clear_callsites();
+
+  /**
+   * @brief Record every log call, muted severities included, in a per-thread ring buffer.
+   *
+   * The rings are dumped in the binary log format (read it with tinylog-decode) by LOG_FATAL,
+   * by fatal signals when the configuration asks for it, and by dump_flight_recorder().
+   *
+   * @param enabled true to start recording, false to stop; recorded history is kept.
+   * @param config ring size, dump file and signal handling.
+   */
+  Log& set_flight_recorder(bool enabled, const FlightRecorderConfig &config = {});
+
+  /**
+   * @brief Write the flight recorder's records to a file now.
+   *
+   * @param path output file; nullptr for the configured path
+   * @return false if the file could not be written or a dump is already running.
+   */
+  bool dump_flight_recorder(const char *path = nullptr);
+
+  /**
+   * @brief Count accepted messages per severity and optionally sample call latency, see stats().
+   *
+   * Counters are sharded by thread; while off, a call pays one relaxed load.
+   * Sink counters (bytes, flushes, rotations, queues) are kept regardless.
+   *
+   * @param enabled true to count messages.
+   * @param latency_sample_every time one in this many calls per thread; 0 = no latency histogram.
+   */
+  Log& set_stats(bool enabled, std::uint32_t latency_sample_every = 0);
+
+  /**
+   * @brief Take a snapshot of the logger's own counters.
+   *
+   * Message counts and latency cover the time set_stats() was on; the sink counters
+   * cover the lifetime of the active tracer's sinks.
+   */
+  LogStats stats() const;
+
+  // configure(), add_sink() and remove_sink() wait for calls into the current tracer to finish;
+  // from inside such a call, e.g. a custom Tracer's Write(), they throw std::logic_error instead.
+
+  //! Configures enabled tracer.
+  Log& configure(TraceType lt);
+
+  //! Configures file tracer with a custom path.
+  Log& configure(TraceType lt, const std::string &filepath);
+
+  //! Configures the console tracer with batching, stderr routing and color settings.
+  Log& configure(const ConsoleConfig &console);
+
+  //! Configures the syslog tracer with an address, facility, identity and batching settings.
+  Log& configure(const SyslogConfig &syslog);
+
+  //! Configures file tracer with a custom path, rotation and flush settings.
+  Log& configure(TraceType lt, const std::string &filepath, const RotationConfig &rotation, const FlushPolicy &flush = {});
+
+  //! Configures a buffered tracer with a custom path, rotation, queue and flush settings.
+  Log& configure(TraceType lt, const std::string &filepath, const RotationConfig &rotation, const AsyncConfig &async,
+                 const FlushPolicy &flush = {});
+
+  /**
+   * @brief Write to another sink in addition to the current ones.
+   *
+   * The first call turns the configured tracer into sink 0, receiving every severity.
+   * Logging threads are not blocked; the caller waits for calls already in flight.
+   * Log::set_level() still applies before any sink mask.
+   *
+   * @return id for remove_sink().
+   */
+  MultiTracer::SinkId add_sink(std::unique_ptr<Tracer> tracer, const SinkConfig &config = {});
+
+  //! Add a sink of a built-in type, see add_sink(std::unique_ptr<Tracer>, const SinkConfig &).
+  MultiTracer::SinkId add_sink(TraceType lt, const std::string &filepath, const SinkConfig &config = {},
+                               const RotationConfig &rotation = {}, const FlushPolicy &flush = {});
+
+  /**
+   * @brief Stop writing to a sink and destroy it once in-flight calls are done.
+   *
+   * @return false if there is no such sink.
+   */
+  bool remove_sink(MultiTracer::SinkId id);
+
+  //! Blocks until all messages logged so far are handed to the output device.
+  Log& flush();
+
+private:
+  friend class Logger;
+
+  Log();
+  Log(Log const &) = delete;
+  Log(Log &&) = delete;
+  Log &operator=(Log const &) = delete;
+  Log &operator=(Log &&) = delete;
+
+  /**
+   * @brief Keeps the active tracer alive for the duration of one call.
+   *
+   * Publishes the tracer in a hazard slot owned by the calling thread, so a concurrent
+   * configure() waits for the call to finish before destroying it. Nothing is shared
+   * between logging threads. A nested call, e.g. from a tracer that logs, keeps using
+   * the tracer of the enclosing call.
+   */
+  class ActiveTracer
+  {
+  public:
+    explicit ActiveTracer(const Log &log);
+    ~ActiveTracer();
+
+    ActiveTracer(const ActiveTracer &) = delete;
+    ActiveTracer &operator=(const ActiveTracer &) = delete;
+
+    Tracer *operator->() const { return tracer_; }
+
+  private:
+    //! Hazard slot of the calling thread.
+    std::atomic<Tracer *> *slot_;
+    //! Slot contents of an enclosing call on the same thread.
+    Tracer *previous_;
+    //! The protected tracer.
+    Tracer *tracer_;
+  };
+
+  //! Pass an enabled call on to the tracer; format must have been validated against the arguments.
+  template <typename... Args>
+  void emit(TraceSeverity severity, std::string_view format, Args &...args)
+  {
+    CallStats::Scope stats(call_stats_, severity_slot(severity));
+    if (is_recording())
+      record_as(binary_severity(severity), format, args...);
+    // A format_string is a compile-time constant, so it outlives the call.
+    if constexpr ((is_packable_v<Args> && ...))
+    {
+      if (deferred_.load(std::memory_order_relaxed) || packed_tracer_.load(std::memory_order_relaxed))
+      {
+        PackedArgs packed;
+        if (packed.pack(args...))
+        {
+          ActiveTracer tracer(*this);
+          if (tracer->Deferred(severity, format, packed))
+            return;
+        }
+      }
+    }
+    // Formatted into a buffer the thread reuses, so the call does not allocate once it has grown.
+    MessageBuffer buffer;
+    std::vformat_to(std::back_inserter(buffer.text()), format, std::make_format_args(args...));
+    ActiveTracer tracer(*this);
+    tracer->Write(severity, buffer.text());
+  }
+
+  //! format must have been validated against the arguments.
+  template <typename... Args>
+  void record_as(binlog::Severity severity, std::string_view format, Args &...args)
+  {
+    if constexpr ((is_packable_v<Args> && ...))
+    {
+      PackedArgs packed;
+      if (packed.pack(args...))
+      {
+        flight_record(severity, format, packed);
+        return;
+      }
+    }
+    record_text(severity, std::vformat(format, std::make_format_args(args...)));
+  }
+
+  //! Record an already formatted message, truncated to what fits into a record.
+  static void record_text(binlog::Severity severity, const std::string &message);
+
+  //! Pass a message to Tracer::Fatal and dump the flight recorder.
+  void write_fatal(const std::string &message);
+
+  template <typename... KV>
+  void emit_kv(TraceSeverity severity, std::string_view message, const KV &...kv)
+  {
+    CallStats::Scope stats(call_stats_, severity_slot(severity));
+    Field fields[sizeof...(KV) / 2 + 1];
+    make_fields(fields, kv...);
+    ActiveTracer tracer(*this);
+    tracer->Structured(severity, message, fields, sizeof...(KV) / 2);
+  }
+
+  static void make_fields(Field *) {}
+
+  template <typename K, typename V, typename... Rest>
+  static void make_fields(Field *out, const K &key, const V &value, const Rest &...rest)
+  {
+    out->key = std::string_view(key);
+    out->value = make_field_value(value);
+    make_fields(out + 1, rest...);
+  }
+
+  //! Creates a tracer with default settings; nullptr if the type is not supported.
+  static std::unique_ptr<Tracer> make_tracer(TraceType lt);
+
+  //! Creates a file-based tracer.
+  static std::unique_ptr<Tracer> make_file_tracer(TraceType lt, const std::string &filepath,
+                                                  const RotationConfig &rotation, const AsyncConfig &async,
+                                                  const FlushPolicy &flush);
+
+  //! Publishes a tracer and releases the previous one once no call uses it; caller holds configure_mutex_.
+  //! Throws std::logic_error if the calling thread is inside the active tracer.
+  void install(std::shared_ptr<Tracer> tracer);
+
+  //! Installs a MultiTracer with the given sinks; caller holds configure_mutex_.
+  void install_sinks(std::vector<MultiTracer::Sink> sinks);
+
+  //! Root of the named loggers; holds the enabled severity levels of Log itself.
+  Logger root_{"", nullptr};
+  //! Every named logger by name, guarded by the logger tree lock; never erased, so references stay valid.
+  std::unordered_map<std::string, std::unique_ptr<Logger>> loggers_;
+  //! Hand packed arguments to tracers instead of formatting on the caller's thread.
+  std::atomic<bool> deferred_{false};
+  //! Capture calls in the flight recorder.
+  std::atomic<bool> recording_{false};
+  //! The active tracer stores packed arguments itself (Tracer::wants_packed_args()).
+  std::atomic<bool> packed_tracer_{false};
+  //! Message counts and call latency, see set_stats().
+  CallStats call_stats_;
+  //! Serializes configure() calls.
+  std::mutex configure_mutex_;
+  //! An instance of the actual worker tracer, read without locking.
+  std::atomic<Tracer *> instance_{nullptr};
+  //! Keeps instance_ alive; shared with a MultiTracer that took it over as a sink.
+  std::shared_ptr<Tracer> owner_;
+  //! Id of the next sink added with add_sink().
+  MultiTracer::SinkId next_sink_id_ = 1;
+};
+
+template <typename... Args>
+void Logger::log(TraceSeverity severity, std::format_string<Args...> format, Args &&...args)
+{
+  if (is_severity_enabled(severity))
+    Log::get().emit(severity, format.get(), args...);
+}
+
+template <typename... KV>
+void Logger::log_kv(TraceSeverity severity, std::string_view message, const KV &...kv)
+{
+  static_assert(sizeof...(KV) % 2 == 0, "keys and values must come in pairs");
+  if (is_severity_enabled(severity))
+    Log::get().emit_kv(severity, message, kv...);
+}
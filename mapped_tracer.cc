@@ -0,0 +1,304 @@
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  //! Live compression needs whole frames; the mapped sink always writes plain text.
+  RotationConfig plain_rotation(RotationConfig rotation)
+  {
+    rotation.compress_live = false;
+    return rotation;
+  }
+
+  std::size_t round_up(std::size_t value, std::size_t multiple)
+  {
+    return (value + multiple - 1) / multiple * multiple;
+  }
+
+  //! Make sure [offset, offset + length) is backed by the file, allocating blocks where supported.
+  bool reserve_file(int fd, std::uint64_t offset, std::size_t length)
+  {
+#if defined(__linux__)
+    if (posix_fallocate(fd, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0)
+      return true;
+#endif
+    // Sparse fallback: running out of disk later raises SIGBUS on the mapping.
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+      return false;
+    const std::uint64_t end = offset + length;
+    return static_cast<std::uint64_t>(info.st_size) >= end || ftruncate(fd, static_cast<off_t>(end)) == 0;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// MappedFileTracer – construction / destruction
+// ---------------------------------------------------------------------------
+
+MappedFileTracer::MappedFileTracer(const std::string &filepath, const RotationConfig &rotation,
+                                   const FlushPolicy &flush, std::size_t segment_size)
+    : filepath_(filepath), rotator_(filepath_, plain_rotation(rotation)), flush_policy_(flush),
+      page_size_(static_cast<std::size_t>(sysconf(_SC_PAGESIZE)))
+{
+  segment_size_ = round_up(std::clamp<std::size_t>(segment_size, 1, offset_mask / 2), page_size_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  open_log_file();
+  if (!map_segment(0))
+  {
+    close_log_file();
+    throw std::runtime_error("Failed to map log file: " + filepath_.string());
+  }
+}
+
+MappedFileTracer::~MappedFileTracer()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  retire_current();
+  close_log_file();
+}
+
+void MappedFileTracer::open_log_file()
+{
+  const auto &path = rotator_.active_path();
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    throw std::runtime_error("Failed to open log file: " + path.string());
+
+  struct stat info;
+  file_length_ = fstat(fd_, &info) == 0 ? static_cast<std::uint64_t>(info.st_size) : 0;
+
+  // A crash leaves the preallocated tail of the last segment behind as NUL bytes.
+  char chunk[4096];
+  while (file_length_ > 0)
+  {
+    const std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(file_length_, sizeof(chunk)));
+    if (pread(fd_, chunk, length, static_cast<off_t>(file_length_ - length)) != static_cast<ssize_t>(length))
+      break;
+    std::size_t used = length;
+    while (used > 0 && chunk[used - 1] == '\0')
+      --used;
+    file_length_ -= length - used;
+    if (used > 0)
+      break;
+  }
+  if (file_length_ != static_cast<std::uint64_t>(info.st_size))
+    ftruncate(fd_, static_cast<off_t>(file_length_));
+}
+
+void MappedFileTracer::close_log_file()
+{
+  if (fd_ < 0)
+    return;
+  // Give back the preallocated space nobody wrote to.
+  ftruncate(fd_, static_cast<off_t>(file_length_));
+  ::close(fd_);
+  fd_ = -1;
+}
+
+// ---------------------------------------------------------------------------
+// MappedFileTracer – segments
+// ---------------------------------------------------------------------------
+
+bool MappedFileTracer::map_segment(std::size_t needed)
+{
+  const std::uint64_t offset = file_length_ / page_size_ * page_size_;
+  const std::size_t skip = static_cast<std::size_t>(file_length_ - offset);
+
+  // End the last segment of a file near max_file_size so rollover and rotation coincide.
+  std::size_t capacity = segment_size_;
+  const std::size_t max_file_size = rotator_.config().max_file_size;
+  if (max_file_size > 0 && offset < max_file_size)
+    capacity = std::min<std::size_t>(capacity, round_up(static_cast<std::size_t>(max_file_size - offset), page_size_));
+  capacity = std::max(capacity, round_up(skip + needed, page_size_));
+
+  if (!reserve_file(fd_, offset, capacity))
+    return false;
+  void *base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, static_cast<off_t>(offset));
+  if (base == MAP_FAILED)
+    return false;
+
+  // Writers that reserved space in the previous mapping are done (retire_current() waited);
+  // the new generation turns away those that still hold an offset of it.
+  Segment *segment = segment_.get();
+  const std::uint64_t generation = (segment->reserved.load(std::memory_order_relaxed) >> offset_bits) + 1;
+  segment->base = static_cast<char *>(base);
+  segment->capacity.store(capacity, std::memory_order_relaxed);
+  segment->file_offset = offset;
+  segment->committed.store(skip, std::memory_order_relaxed);
+  segment->reserved.store(generation << offset_bits | skip, std::memory_order_release);
+  current_.store(segment, std::memory_order_release);
+  return true;
+}
+
+void MappedFileTracer::retire_current()
+{
+  Segment *segment = current_.load(std::memory_order_relaxed);
+  if (!segment)
+    return;
+  // Sealing turns away new writers; the ones already in finish their copy.
+  const std::size_t end = segment->reserved.fetch_or(offset_mask, std::memory_order_acq_rel) & offset_mask;
+  while (segment->committed.load(std::memory_order_acquire) != end)
+    std::this_thread::yield();
+  if (flush_policy_.sync)
+    sync_current(true);
+  current_.store(nullptr, std::memory_order_relaxed);
+  munmap(segment->base, segment->capacity.load(std::memory_order_relaxed));
+  // file_length_ still holds the length the segment was mapped at.
+  counters_.bytes_written.add(segment->file_offset + end - file_length_);
+  file_length_ = segment->file_offset + end;
+}
+
+bool MappedFileTracer::roll_over(std::size_t needed)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ < 0)
+    return false;
+  if (const Segment *segment = current_.load(std::memory_order_relaxed))
+  {
+    const std::uint64_t offset = segment->reserved.load(std::memory_order_relaxed) & offset_mask;
+    if (offset + needed <= segment->capacity.load(std::memory_order_relaxed))
+      return true; // another thread got here first
+  }
+
+  retire_current();
+  const std::size_t max_file_size = rotator_.config().max_file_size;
+  if (max_file_size > 0 && file_length_ >= max_file_size)
+  {
+    const auto started = std::chrono::steady_clock::now();
+    close_log_file();
+    // Renaming is all that happens here; shifting backups and compression run in the background.
+    rotator_.rotate();
+    open_log_file();
+    counters_.rotations.add();
+    counters_.rotation_ns.add(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count()));
+  }
+  // On failure current_ stays empty and the next append tries again.
+  return map_segment(needed);
+}
+
+// ---------------------------------------------------------------------------
+// MappedFileTracer – severity methods
+// ---------------------------------------------------------------------------
+
+void MappedFileTracer::append(std::int64_t when, const char *header, std::string_view message, bool urgent)
+{
+  thread_local std::string line;
+  char prefix[max_timestamp_length];
+  line.assign(prefix, format_timestamp(prefix, when));
+  line.append(header);
+  line.append(message);
+  append_line(line, urgent);
+}
+
+void MappedFileTracer::append_line(std::string_view line, bool urgent)
+{
+  for (;;)
+  {
+    if (Segment *segment = current_.load(std::memory_order_acquire))
+    {
+      // Acquire: a state of a new generation comes with that mapping's capacity and base.
+      std::uint64_t state = segment->reserved.load(std::memory_order_acquire);
+      while ((state & offset_mask) + line.size() <= segment->capacity.load(std::memory_order_relaxed))
+      {
+        if (segment->reserved.compare_exchange_weak(state, state + line.size(), std::memory_order_acquire,
+                                                    std::memory_order_acquire))
+        {
+          std::memcpy(segment->base + (state & offset_mask), line.data(), line.size());
+          segment->committed.fetch_add(line.size(), std::memory_order_release);
+          if (urgent && flush_policy_.flush_on_error)
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sync_current(flush_policy_.sync);
+          }
+          return;
+        }
+      }
+    }
+    if (!roll_over(line.size()))
+      return;
+  }
+}
+
+void MappedFileTracer::sync_current(bool wait)
+{
+  if (Segment *segment = current_.load(std::memory_order_relaxed))
+  {
+    msync(segment->base, segment->capacity.load(std::memory_order_relaxed), wait ? MS_SYNC : MS_ASYNC);
+    counters_.flushes.add();
+    counters_.syscalls.add();
+  }
+}
+
+void MappedFileTracer::flush()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  sync_current(flush_policy_.sync);
+}
+
+void MappedFileTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  SinkStats &stats = out.emplace_back();
+  stats.name = rotator_.active_path().string();
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_.add_to(stats);
+  rotator_.add_stats(stats);
+  if (const Segment *segment = current_.load(std::memory_order_relaxed))
+    stats.bytes_written += segment->file_offset + segment->committed.load(std::memory_order_relaxed) - file_length_;
+}
+
+void MappedFileTracer::Info(const std::string &message)
+{
+  append(timestamp_now(), "", message);
+}
+
+void MappedFileTracer::Debug(const std::string &message)
+{
+  append(timestamp_now(), "Debug: ", message);
+}
+
+void MappedFileTracer::Warning(const std::string &message)
+{
+  append(timestamp_now(), "Warning: ", message);
+}
+
+void MappedFileTracer::Critical(const std::string &message)
+{
+  append(timestamp_now(), "CRITICAL: ", message, true);
+}
+
+void MappedFileTracer::Error(const std::string &message)
+{
+  append(timestamp_now(), "ERROR: ", message, true);
+}
+
+void MappedFileTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  append(timestamp_now(), severity_header(severity), message,
+         severity == TraceSeverity::error || severity == TraceSeverity::critical);
+}
+
+void MappedFileTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields,
+                                  std::size_t count)
+{
+  thread_local std::string line;
+  line.clear();
+  render_structured(line, output_format(), timestamp_now(), severity_header(severity), message, fields, count);
+  append_line(line, severity == TraceSeverity::error || severity == TraceSeverity::critical);
+}
+
+void MappedFileTracer::Fatal(const std::string &message)
+{
+  append(timestamp_now(), "*** FATAL ***: ", message);
+  std::lock_guard<std::mutex> lock(mutex_);
+  sync_current(true);
+}
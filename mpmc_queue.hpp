@@ -0,0 +1,170 @@
+#pragma once
+
+/*! \file A bounded lock-free multi-producer/multi-consumer queue (D. Vyukov's design). */
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+//! A bounded lock-free queue. Capacity is rounded up to the next power of two.
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(std::size_t capacity)
+  {
+    std::size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    mask_ = size - 1;
+    cells_ = std::make_unique<Cell[]>(size);
+    for (std::size_t i = 0; i < size; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  /**
+   * @brief Try to append an element.
+   *
+   * @param pinned keep the element from being taken by try_pop_unpinned()
+   * @return true if the element was moved into the queue.
+   * @return false if the queue is full, the element is left untouched.
+   */
+  bool try_push(T &&value, bool pinned = false)
+  {
+    Cell *cell;
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell = &cells_[pos & mask_];
+      const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false; // full
+      }
+      else
+      {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(value);
+    cell->pinned.store(pinned, std::memory_order_relaxed);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Try to take the oldest element.
+   *
+   * @return true if an element was moved into @p value.
+   * @return false if the queue is empty.
+   */
+  bool try_pop(T &value)
+  {
+    Cell *cell;
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell = &cells_[pos & mask_];
+      const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false; // empty
+      }
+      else
+      {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->data);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Like try_pop(), but leaves an oldest element that was pushed pinned in place.
+   *
+   * @param head_pinned set when false is returned because the oldest element is pinned
+   * @return true if an element was moved into @p value.
+   */
+  bool try_pop_unpinned(T &value, bool &head_pinned)
+  {
+    Cell *cell;
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell = &cells_[pos & mask_];
+      const std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0)
+      {
+        // The flag belongs to this position only while no one has taken it yet.
+        if (cell->pinned.load(std::memory_order_relaxed) && dequeue_pos_.load(std::memory_order_relaxed) == pos)
+        {
+          head_pinned = true;
+          return false;
+        }
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+      {
+        return false; // empty
+      }
+      else
+      {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->data);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! Number of slots in the ring.
+  std::size_t capacity() const { return mask_ + 1; }
+
+  //! Bytes taken by one slot of the ring.
+  static constexpr std::size_t slot_size() { return sizeof(Cell); }
+
+  //! Approximate number of queued elements; exact only when no one is pushing or popping.
+  std::size_t size_approx() const
+  {
+    const std::size_t tail = enqueue_pos_.load(std::memory_order_acquire);
+    const std::size_t head = dequeue_pos_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+  }
+
+private:
+  struct alignas(64) Cell
+  {
+    std::atomic<std::size_t> sequence{0};
+    //! Set by try_push(); see try_pop_unpinned().
+    std::atomic<bool> pinned{false};
+    T data{};
+  };
+
+  //! Ring storage.
+  std::unique_ptr<Cell[]> cells_;
+  //! capacity - 1, capacity is a power of two.
+  std::size_t mask_ = 0;
+  //! Producers' position, kept on its own cache line.
+  alignas(64) std::atomic<std::size_t> enqueue_pos_{0};
+  //! Consumers' position, kept on its own cache line.
+  alignas(64) std::atomic<std::size_t> dequeue_pos_{0};
+};
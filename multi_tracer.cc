@@ -0,0 +1,189 @@
+#include "log.hpp"
+
+#include <exception>
+
+namespace
+{
+  //! Format packed arguments, turning a bad format into a readable line.
+  void format_or_report(std::string &out, std::string_view format, const PackedArgs &args)
+  {
+    out.clear();
+    try
+    {
+      format_packed(out, format, args);
+    }
+    catch (const std::format_error &e)
+    {
+      out = std::string("<format error: ") + e.what() + "> " + std::string(format);
+    }
+  }
+
+  /**
+   * @brief Call a function with every sink that takes one of the severity bits.
+   *
+   * A sink that throws does not keep the message from the sinks after it; the first
+   * exception is rethrown once every sink had its turn.
+   */
+  template <typename Call>
+  void each_sink(const std::vector<MultiTracer::Sink> &sinks, std::uint32_t bits, Call &&call)
+  {
+    std::exception_ptr error;
+    for (const MultiTracer::Sink &sink : sinks)
+    {
+      if (!(sink.severities & bits))
+        continue;
+      try
+      {
+        call(*sink.tracer);
+      }
+      catch (...)
+      {
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// QueuedTracer
+// ---------------------------------------------------------------------------
+
+QueuedTracer::QueuedTracer(std::shared_ptr<Tracer> target, const AsyncConfig &config)
+    : AsyncTracer(config), target_(std::move(target))
+{
+  start_writer();
+}
+
+QueuedTracer::~QueuedTracer()
+{
+  stop_writer();
+}
+
+void QueuedTracer::flush()
+{
+  drain();
+  target_->flush();
+}
+
+void QueuedTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  const std::size_t first = out.size();
+  target_->collect_stats(out);
+  // A target without counters of its own still gets an entry for its queue.
+  if (out.size() == first)
+    out.emplace_back().name = "queue";
+  add_queue_stats(out[first]);
+}
+
+void QueuedTracer::write_record(const AsyncRecord &record)
+{
+  if (record.fatal)
+  {
+    target_->Fatal(record.message);
+  }
+  else if (record.fields_offset != std::string::npos)
+  {
+    std::string_view message;
+    const std::vector<Field> &pairs = fields(record, message);
+    target_->Structured(record.severity, message, pairs.data(), pairs.size());
+  }
+  else if (record.format.empty())
+  {
+    target_->Write(record.severity, record.message);
+  }
+  else if (!target_->Deferred(record.severity, record.format, record.args))
+  {
+    target_->Write(record.severity, text(record));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// MultiTracer
+// ---------------------------------------------------------------------------
+
+MultiTracer::MultiTracer(std::vector<Sink> sinks)
+    : sinks_(std::move(sinks))
+{
+  for (const Sink &sink : sinks_)
+    wants_packed_args_ = wants_packed_args_ || sink.tracer->wants_packed_args();
+}
+
+void MultiTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  for (const Sink &sink : sinks_)
+    sink.tracer->collect_stats(out);
+}
+
+void MultiTracer::dispatch(TraceSeverity severity, std::string_view message)
+{
+  each_sink(sinks_, static_cast<std::uint32_t>(severity), [&](Tracer &tracer)
+            { tracer.Write(severity, message); });
+}
+
+void MultiTracer::Write(TraceSeverity severity, std::string_view message)
+{
+  dispatch(severity, message);
+}
+
+void MultiTracer::Info(const std::string &message)
+{
+  dispatch(TraceSeverity::info, message);
+}
+
+void MultiTracer::Debug(const std::string &message)
+{
+  dispatch(TraceSeverity::debug, message);
+}
+
+void MultiTracer::Warning(const std::string &message)
+{
+  dispatch(TraceSeverity::warning, message);
+}
+
+void MultiTracer::Error(const std::string &message)
+{
+  dispatch(TraceSeverity::error, message);
+}
+
+void MultiTracer::Critical(const std::string &message)
+{
+  dispatch(TraceSeverity::critical, message);
+}
+
+void MultiTracer::Fatal(const std::string &message)
+{
+  each_sink(sinks_, ~0u, [&](Tracer &tracer)
+            { tracer.Fatal(message); });
+}
+
+void MultiTracer::flush()
+{
+  each_sink(sinks_, ~0u, [](Tracer &tracer)
+            { tracer.flush(); });
+}
+
+bool MultiTracer::Deferred(TraceSeverity severity, std::string_view format, const PackedArgs &args)
+{
+  thread_local std::string formatted;
+  bool have_formatted = false;
+  each_sink(sinks_, static_cast<std::uint32_t>(severity), [&](Tracer &tracer)
+            {
+              if (tracer.Deferred(severity, format, args))
+                return;
+              if (!have_formatted)
+              {
+                format_or_report(formatted, format, args);
+                have_formatted = true;
+              }
+              tracer.Write(severity, formatted); });
+  return true;
+}
+
+void MultiTracer::Structured(TraceSeverity severity, std::string_view message, const Field *fields, std::size_t count)
+{
+  each_sink(sinks_, static_cast<std::uint32_t>(severity), [&](Tracer &tracer)
+            { tracer.Structured(severity, message, fields, count); });
+}
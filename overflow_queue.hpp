@@ -0,0 +1,273 @@
+#pragma once
+
+/*! \file Bounded record queue of the buffered tracers, with overflow policies and drop accounting. */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "mpmc_queue.hpp"
+
+//! What a producer does when the queue of a buffered tracer is full.
+enum class OverflowPolicy
+{
+  //! Wait for room, up to AsyncConfig::block_timeout, then drop the new record.
+  block,
+  //! Drop the new record.
+  drop_newest,
+  //! Drop the oldest queued records to make room. Error and worse records are never evicted:
+  //! while one is the oldest, a new record below error is dropped and one above waits for room.
+  drop_oldest,
+  //! Drop new records below error severity; error, critical and fatal records wait for room.
+  drop_by_severity,
+};
+
+//! Configuration for buffered (background writer) tracers.
+struct AsyncConfig
+{
+  //! Number of records the queue can hold before the overflow policy applies.
+  std::size_t queue_capacity = 8192;
+  //! What to do when the queue is full.
+  OverflowPolicy overflow = OverflowPolicy::block;
+  //! Longest wait under OverflowPolicy::block; 0 waits for as long as it takes.
+  std::chrono::milliseconds block_timeout{0};
+  /**
+   * Upper bound of the queue's memory: the preallocated ring plus the text of queued
+   * messages. The ring is shrunk to at most half of it; longer messages are truncated
+   * to fit. 0 = bounded by queue_capacity only.
+   */
+  std::size_t max_queued_bytes = 0;
+};
+
+//! Dropped records per severity slot, see OverflowQueue.
+using DropCounts = std::array<std::uint64_t, 8>;
+
+/**
+ * @brief A BoundedQueue that applies an OverflowPolicy and a byte budget.
+ *
+ * T needs a std::string member "message" (the only heap memory of a record), a
+ * "bool droppable() const" and a "std::size_t severity_slot() const" below 8 that
+ * selects the drop counter.
+ */
+template <typename T>
+class OverflowQueue
+{
+public:
+  explicit OverflowQueue(const AsyncConfig &config)
+      : queue_(ring_slots(config)), policy_(config.overflow), block_timeout_(config.block_timeout),
+        text_budget_(text_budget(config, queue_.capacity()))
+  {
+  }
+
+  /**
+   * @brief Queue a record, applying the overflow policy when there is no room.
+   *
+   * @param wake called while waiting, to get the consumer going
+   * @return number of records that left without reaching the consumer: the new one
+   *         if it was dropped, or the oldest ones evicted for it.
+   */
+  template <typename Wake>
+  std::size_t push(T &&record, Wake &&wake)
+  {
+    const std::size_t bytes = fit(record);
+    if (try_push(record, bytes))
+      return 0;
+
+    switch (policy_)
+    {
+    case OverflowPolicy::drop_newest:
+      count_drop(record);
+      return 1;
+    case OverflowPolicy::drop_oldest:
+    {
+      std::size_t evicted = 0;
+      T oldest;
+      while (!try_push(record, bytes))
+      {
+        bool head_pinned = false;
+        if (queue_.try_pop_unpinned(oldest, head_pinned))
+        {
+          count_drop(oldest);
+          release(oldest);
+          ++evicted;
+          continue;
+        }
+        if (!head_pinned)
+          continue;
+        // The oldest record must reach the consumer; the new one gives way, or waits if it must not be lost.
+        if (record.droppable())
+        {
+          count_drop(record);
+          return evicted + 1;
+        }
+        wake();
+        std::this_thread::yield();
+      }
+      return evicted;
+    }
+    case OverflowPolicy::drop_by_severity:
+      if (record.droppable())
+      {
+        count_drop(record);
+        return 1;
+      }
+      wait_for_room(record, bytes, wake, std::chrono::milliseconds(0));
+      return 0;
+    default:
+      if (wait_for_room(record, bytes, wake, block_timeout_))
+        return 0;
+      count_drop(record);
+      return 1;
+    }
+  }
+
+  //! Queue a record that must not be lost (fatal), waiting for room whatever the policy.
+  template <typename Wake>
+  void push_wait(T &&record, Wake &&wake)
+  {
+    const std::size_t bytes = fit(record);
+    wait_for_room(record, bytes, wake, std::chrono::milliseconds(0));
+  }
+
+  //! Take the oldest record; call release() once it has been consumed.
+  bool pop(T &record) { return queue_.try_pop(record); }
+
+  //! Return a consumed record's share of the byte budget and free its text.
+  void release(T &record)
+  {
+    if (text_budget_ == 0)
+      return;
+    queued_bytes_.fetch_sub(charge(record), std::memory_order_relaxed);
+    std::string().swap(record.message);
+  }
+
+  std::size_t size_approx() const { return queue_.size_approx(); }
+
+  //! Records dropped so far with the given severity slot.
+  std::uint64_t dropped(std::size_t slot) const { return dropped_[slot].load(std::memory_order_relaxed); }
+
+  //! Records dropped so far, per severity slot.
+  DropCounts dropped_counts() const
+  {
+    DropCounts counts{};
+    for (std::size_t slot = 0; slot < counts.size(); ++slot)
+      counts[slot] = dropped(slot);
+    return counts;
+  }
+
+  //! Drops not reported yet, per severity slot; resets them. Returns false if there are none.
+  bool take_unreported(DropCounts &counts)
+  {
+    if (unreported_.load(std::memory_order_relaxed) == 0)
+      return false;
+    std::uint64_t total = 0;
+    for (std::size_t slot = 0; slot < counts.size(); ++slot)
+    {
+      counts[slot] = unreported_by_slot_[slot].exchange(0, std::memory_order_relaxed);
+      total += counts[slot];
+    }
+    unreported_.fetch_sub(total, std::memory_order_relaxed);
+    return total > 0;
+  }
+
+private:
+  static std::size_t ring_slots(const AsyncConfig &config)
+  {
+    std::size_t slots = 2;
+    while (slots < config.queue_capacity)
+      slots <<= 1;
+    if (config.max_queued_bytes == 0)
+      return slots;
+    const std::size_t limit = config.max_queued_bytes / 2 / BoundedQueue<T>::slot_size();
+    while (slots > 2 && slots > limit)
+      slots >>= 1;
+    return slots;
+  }
+
+  static std::size_t text_budget(const AsyncConfig &config, std::size_t slots)
+  {
+    if (config.max_queued_bytes == 0)
+      return 0;
+    const std::size_t ring = slots * BoundedQueue<T>::slot_size();
+    // Never 0 here, which would mean "no budget".
+    return config.max_queued_bytes > ring + 1 ? config.max_queued_bytes - ring : 1;
+  }
+
+  //! Truncate a message that could never fit into the budget; returns the record's charge.
+  std::size_t fit(T &record) const
+  {
+    if (text_budget_ > 0 && record.message.capacity() > text_budget_)
+    {
+      record.message.resize(text_budget_ / 2);
+      record.message.shrink_to_fit();
+    }
+    return charge(record);
+  }
+
+  //! Share of the byte budget taken by a record; strings within the object count as well.
+  std::size_t charge(const T &record) const
+  {
+    if (text_budget_ == 0)
+      return 0;
+    return record.message.capacity() < text_budget_ ? record.message.capacity() : text_budget_;
+  }
+
+  bool try_push(T &record, std::size_t bytes)
+  {
+    if (bytes > 0)
+    {
+      std::size_t queued = queued_bytes_.load(std::memory_order_relaxed);
+      do
+      {
+        if (queued + bytes > text_budget_)
+          return false;
+      } while (!queued_bytes_.compare_exchange_weak(queued, queued + bytes, std::memory_order_relaxed));
+    }
+    const bool pinned = !record.droppable();
+    if (queue_.try_push(std::move(record), pinned))
+      return true;
+    if (bytes > 0)
+      queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    return false;
+  }
+
+  //! Retry until there is room; false on timeout (0 = no timeout).
+  template <typename Wake>
+  bool wait_for_room(T &record, std::size_t bytes, Wake &wake, std::chrono::milliseconds timeout)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!try_push(record, bytes))
+    {
+      if (timeout.count() > 0 && std::chrono::steady_clock::now() >= deadline)
+        return false;
+      // The consumer is behind; make sure it runs and give it the CPU.
+      wake();
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  void count_drop(const T &record)
+  {
+    const std::size_t slot = record.severity_slot();
+    dropped_[slot].fetch_add(1, std::memory_order_relaxed);
+    unreported_by_slot_[slot].fetch_add(1, std::memory_order_relaxed);
+    unreported_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  BoundedQueue<T> queue_;
+  const OverflowPolicy policy_;
+  const std::chrono::milliseconds block_timeout_;
+  //! Bytes of message text the queue may hold; 0 = unlimited.
+  const std::size_t text_budget_;
+  std::atomic<std::size_t> queued_bytes_{0};
+  std::atomic<std::uint64_t> dropped_[8] = {};
+  std::atomic<std::uint64_t> unreported_by_slot_[8] = {};
+  //! Sum of unreported_by_slot_, so the consumer checks a single word per batch.
+  std::atomic<std::uint64_t> unreported_{0};
+};
@@ -0,0 +1,254 @@
+#include "packed_args.hpp"
+
+#include <format>
+#include <iterator>
+
+namespace
+{
+  //! A single decoded argument.
+  struct Arg
+  {
+    PackedType type;
+    union
+    {
+      bool boolean;
+      char character;
+      std::int64_t signed_integer;
+      std::uint64_t unsigned_integer;
+      float single_float;
+      double double_float;
+      const void *pointer;
+    };
+    std::string_view string;
+  };
+
+  template <typename T>
+  void read_value(const unsigned char *&cursor, const unsigned char *end, T &value)
+  {
+    if (static_cast<std::size_t>(end - cursor) < sizeof(T))
+      throw std::format_error("truncated packed argument");
+    std::memcpy(&value, cursor, sizeof(T));
+    cursor += sizeof(T);
+  }
+
+  std::size_t unpack(const unsigned char *data, std::size_t size, Arg *args)
+  {
+    const unsigned char *cursor = data;
+    const unsigned char *end = data + size;
+    std::size_t count = 0;
+    while (cursor < end)
+    {
+      if (count == PackedArgs::max_args)
+        throw std::format_error("too many packed arguments");
+      Arg &arg = args[count++];
+      arg.type = static_cast<PackedType>(*cursor++);
+      switch (arg.type)
+      {
+      case PackedType::boolean:
+        read_value(cursor, end, arg.boolean);
+        break;
+      case PackedType::character:
+        read_value(cursor, end, arg.character);
+        break;
+      case PackedType::signed_integer:
+        read_value(cursor, end, arg.signed_integer);
+        break;
+      case PackedType::unsigned_integer:
+        read_value(cursor, end, arg.unsigned_integer);
+        break;
+      case PackedType::single_float:
+        read_value(cursor, end, arg.single_float);
+        break;
+      case PackedType::double_float:
+        read_value(cursor, end, arg.double_float);
+        break;
+      case PackedType::pointer:
+        read_value(cursor, end, arg.pointer);
+        break;
+      case PackedType::string:
+      {
+        std::uint32_t length = 0;
+        read_value(cursor, end, length);
+        if (static_cast<std::size_t>(end - cursor) < length)
+          throw std::format_error("truncated packed string");
+        arg.string = std::string_view(reinterpret_cast<const char *>(cursor), length);
+        cursor += length;
+        break;
+      }
+      default:
+        throw std::format_error("unknown packed argument type");
+      }
+    }
+    return count;
+  }
+
+  template <typename T>
+  void format_value(std::string &out, std::string_view field, const T &value)
+  {
+    std::vformat_to(std::back_inserter(out), field, std::make_format_args(value));
+  }
+
+  void format_arg(std::string &out, std::string_view field, const Arg &arg)
+  {
+    switch (arg.type)
+    {
+    case PackedType::boolean:
+      format_value(out, field, arg.boolean);
+      break;
+    case PackedType::character:
+      format_value(out, field, arg.character);
+      break;
+    case PackedType::signed_integer:
+      format_value(out, field, arg.signed_integer);
+      break;
+    case PackedType::unsigned_integer:
+      format_value(out, field, arg.unsigned_integer);
+      break;
+    case PackedType::single_float:
+      format_value(out, field, arg.single_float);
+      break;
+    case PackedType::double_float:
+      format_value(out, field, arg.double_float);
+      break;
+    case PackedType::pointer:
+      format_value(out, field, arg.pointer);
+      break;
+    case PackedType::string:
+      format_value(out, field, arg.string);
+      break;
+    }
+  }
+
+  //! Parse an optional argument index; returns npos for automatic numbering.
+  std::size_t parse_index(std::string_view id)
+  {
+    if (id.empty())
+      return std::string_view::npos;
+    std::size_t index = 0;
+    for (char c : id)
+    {
+      if (c < '0' || c > '9')
+        throw std::format_error("named arguments are not supported");
+      index = index * 10 + static_cast<std::size_t>(c - '0');
+    }
+    return index;
+  }
+
+  //! Argument numbering state of one format string; std::format forbids mixing both styles.
+  struct Numbering
+  {
+    std::size_t next_auto = 0;
+    bool automatic = false;
+    bool manual = false;
+  };
+
+  const Arg &select(const Arg *args, std::size_t count, std::size_t index, Numbering &numbering)
+  {
+    if (index == std::string_view::npos)
+    {
+      numbering.automatic = true;
+      index = numbering.next_auto++;
+    }
+    else
+    {
+      numbering.manual = true;
+    }
+    if (numbering.automatic && numbering.manual)
+      throw std::format_error("cannot switch between automatic and manual argument indexing");
+    if (index >= count)
+      throw std::format_error("argument index out of range");
+    return args[index];
+  }
+
+  //! Append a nested width/precision argument as a plain decimal number.
+  void append_dynamic(std::string &spec, const Arg &arg)
+  {
+    if (arg.type == PackedType::signed_integer)
+      spec += std::to_string(arg.signed_integer);
+    else if (arg.type == PackedType::unsigned_integer)
+      spec += std::to_string(arg.unsigned_integer);
+    else
+      throw std::format_error("width/precision argument is not an integer");
+  }
+}
+
+void format_packed(std::string &out, std::string_view format, const unsigned char *data, std::size_t size)
+{
+  Arg args[PackedArgs::max_args];
+  const std::size_t count = unpack(data, size, args);
+  Numbering numbering;
+  // Single-argument format string handed to std::vformat, e.g. "{:>8}".
+  std::string field;
+
+  std::size_t pos = 0;
+  while (pos < format.size())
+  {
+    const std::size_t special = format.find_first_of("{}", pos);
+    if (special == std::string_view::npos)
+    {
+      out.append(format.substr(pos));
+      break;
+    }
+    out.append(format.substr(pos, special - pos));
+
+    if (format[special] == '}')
+    {
+      if (special + 1 >= format.size() || format[special + 1] != '}')
+        throw std::format_error("unmatched '}' in format string");
+      out.push_back('}');
+      pos = special + 2;
+      continue;
+    }
+    if (special + 1 < format.size() && format[special + 1] == '{')
+    {
+      out.push_back('{');
+      pos = special + 2;
+      continue;
+    }
+
+    // Find the end of the replacement field, skipping nested {} in the spec.
+    std::size_t close = special + 1;
+    int depth = 1;
+    for (; close < format.size(); ++close)
+    {
+      if (format[close] == '{')
+        ++depth;
+      else if (format[close] == '}' && --depth == 0)
+        break;
+    }
+    if (depth != 0)
+      throw std::format_error("unterminated replacement field");
+
+    const std::string_view body = format.substr(special + 1, close - special - 1);
+    const std::size_t colon = body.find(':');
+    const std::string_view id = body.substr(0, colon);
+    const Arg &arg = select(args, count, parse_index(id), numbering);
+
+    field.assign("{");
+    if (colon != std::string_view::npos)
+    {
+      field.push_back(':');
+      const std::string_view spec = body.substr(colon + 1);
+      std::size_t spec_pos = 0;
+      while (spec_pos < spec.size())
+      {
+        const std::size_t open = spec.find('{', spec_pos);
+        if (open == std::string_view::npos)
+        {
+          field.append(spec.substr(spec_pos));
+          break;
+        }
+        const std::size_t nested_close = spec.find('}', open);
+        if (nested_close == std::string_view::npos)
+          throw std::format_error("unterminated nested replacement field");
+        field.append(spec.substr(spec_pos, open - spec_pos));
+        const std::string_view nested_id = spec.substr(open + 1, nested_close - open - 1);
+        append_dynamic(field, select(args, count, parse_index(nested_id), numbering));
+        spec_pos = nested_close + 1;
+      }
+    }
+    field.push_back('}');
+    format_arg(out, field, arg);
+    pos = close + 1;
+  }
+}
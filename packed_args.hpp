@@ -0,0 +1,178 @@
+#pragma once
+
+/*! \file Binary capture of log arguments, formatted later by a consumer. */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+//! Type tag stored in front of every packed argument.
+enum class PackedType : std::uint8_t
+{
+  boolean = 1,
+  character = 2,
+  signed_integer = 3,
+  unsigned_integer = 4,
+  single_float = 5,
+  double_float = 6,
+  pointer = 7,
+  string = 8,
+};
+
+namespace packed_detail
+{
+  template <typename T>
+  inline constexpr bool is_char_type_v =
+      std::is_same_v<T, char> || std::is_same_v<T, wchar_t> || std::is_same_v<T, char8_t> ||
+      std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>;
+
+  template <typename T>
+  inline constexpr bool is_string_v =
+      std::is_same_v<T, const char *> || std::is_same_v<T, char *> ||
+      std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+  template <typename T>
+  inline constexpr bool is_pointer_v =
+      std::is_same_v<T, const void *> || std::is_same_v<T, void *> || std::is_same_v<T, std::nullptr_t>;
+
+  template <typename T>
+  inline constexpr bool is_packable_v =
+      std::is_same_v<T, bool> || std::is_same_v<T, char> ||
+      (std::is_integral_v<T> && !std::is_same_v<T, bool> && !is_char_type_v<T>) ||
+      std::is_same_v<T, float> || std::is_same_v<T, double> ||
+      is_pointer_v<T> || is_string_v<T>;
+}
+
+//! True for argument types that PackedArgs can capture without losing formatting semantics.
+template <typename T>
+inline constexpr bool is_packable_v = packed_detail::is_packable_v<std::decay_t<T>>;
+
+//! A compact, self-describing copy of a log call's arguments.
+class PackedArgs
+{
+public:
+  //! Maximum payload size; argument lists that do not fit are formatted eagerly.
+  static constexpr std::size_t capacity = 192;
+  //! Maximum number of arguments.
+  static constexpr std::size_t max_args = 32;
+
+  /**
+   * @brief Capture the arguments.
+   *
+   * @return false if they do not fit into the buffer.
+   */
+  template <typename... Args>
+  bool pack(const Args &...args)
+  {
+    size_ = 0;
+    if constexpr (sizeof...(Args) > max_args)
+      return false;
+    else
+      return (put(args) && ...);
+  }
+
+  //! Replace the contents with an already packed buffer, e.g. read back from disk.
+  bool assign(const unsigned char *data, std::size_t size)
+  {
+    if (size > capacity)
+      return false;
+    std::memcpy(data_, data, size);
+    size_ = static_cast<std::uint16_t>(size);
+    return true;
+  }
+
+  const unsigned char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  bool put_raw(PackedType type, const void *payload, std::size_t length)
+  {
+    if (size_ + 1 + length > capacity)
+      return false;
+    data_[size_] = static_cast<unsigned char>(type);
+    std::memcpy(data_ + size_ + 1, payload, length);
+    size_ += static_cast<std::uint16_t>(1 + length);
+    return true;
+  }
+
+  bool put_string(const char *text, std::size_t length)
+  {
+    if (size_ + 1 + sizeof(std::uint32_t) + length > capacity)
+      return false;
+    const auto length32 = static_cast<std::uint32_t>(length);
+    data_[size_] = static_cast<unsigned char>(PackedType::string);
+    std::memcpy(data_ + size_ + 1, &length32, sizeof(length32));
+    if (length)
+      std::memcpy(data_ + size_ + 1 + sizeof(length32), text, length);
+    size_ += static_cast<std::uint16_t>(1 + sizeof(length32) + length);
+    return true;
+  }
+
+  template <typename A>
+  bool put(const A &arg)
+  {
+    using T = std::decay_t<A>;
+    if constexpr (std::is_same_v<T, bool>)
+      return put_raw(PackedType::boolean, &arg, sizeof(bool));
+    else if constexpr (std::is_same_v<T, char>)
+      return put_raw(PackedType::character, &arg, sizeof(char));
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+    {
+      const std::int64_t value = arg;
+      return put_raw(PackedType::signed_integer, &value, sizeof(value));
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+      const std::uint64_t value = arg;
+      return put_raw(PackedType::unsigned_integer, &value, sizeof(value));
+    }
+    else if constexpr (std::is_same_v<T, float>)
+      return put_raw(PackedType::single_float, &arg, sizeof(float));
+    else if constexpr (std::is_same_v<T, double>)
+      return put_raw(PackedType::double_float, &arg, sizeof(double));
+    else if constexpr (packed_detail::is_pointer_v<T>)
+    {
+      const void *value = arg;
+      return put_raw(PackedType::pointer, &value, sizeof(value));
+    }
+    else if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>)
+    {
+      const char *text = arg;
+      return text ? put_string(text, std::strlen(text)) : put_string("", 0);
+    }
+    else
+    {
+      static_assert(std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>,
+                    "type is not packable");
+      return put_string(arg.data(), arg.size());
+    }
+  }
+
+  //! Number of used bytes in data_.
+  std::uint16_t size_ = 0;
+  //! Tagged arguments, left uninitialized on purpose.
+  unsigned char data_[capacity];
+};
+
+/**
+ * @brief Format a packed argument list, appending the result.
+ *
+ * Supports the std::format replacement field syntax, including explicit
+ * argument indices and nested width/precision fields.
+ *
+ * @param out destination string
+ * @param format std::format-style format string
+ * @param data packed arguments
+ * @param size number of bytes in data
+ * @throws std::format_error on malformed format strings or argument mismatch
+ */
+void format_packed(std::string &out, std::string_view format, const unsigned char *data, std::size_t size);
+
+//! Convenience overload for a PackedArgs instance.
+inline void format_packed(std::string &out, std::string_view format, const PackedArgs &args)
+{
+  format_packed(out, format, args.data(), args.size());
+}
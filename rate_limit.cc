@@ -0,0 +1,65 @@
+#include "rate_limit.hpp"
+
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+  std::atomic<bool> collapsing{false};
+  std::atomic<std::int64_t> report_interval_ns{30'000'000'000};
+}
+
+void set_duplicate_collapsing(bool enabled, std::chrono::seconds report_interval)
+{
+  report_interval_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(report_interval).count(),
+                           std::memory_order_relaxed);
+  collapsing.store(enabled, std::memory_order_relaxed);
+}
+
+bool duplicate_collapsing()
+{
+  return collapsing.load(std::memory_order_relaxed);
+}
+
+bool DuplicateFilter::admit(const char *header, std::string_view message, std::int64_t when,
+                            std::uint64_t &repeats, const char *&repeats_header)
+{
+  repeats = 0;
+  repeats_header = last_header_;
+  if (has_last_ && message == last_ && std::strcmp(header, last_header_) == 0)
+  {
+    ++repeats_;
+    const std::int64_t interval = report_interval_ns.load(std::memory_order_relaxed);
+    if (when - reported_at_ >= interval)
+    {
+      repeats = repeats_;
+      repeats_ = 0;
+      reported_at_ = when;
+    }
+    return false;
+  }
+  repeats = repeats_;
+  repeats_ = 0;
+  reported_at_ = when;
+  last_.assign(message);
+  last_header_ = header;
+  has_last_ = true;
+  return true;
+}
+
+std::uint64_t DuplicateFilter::take(const char *&header)
+{
+  header = last_header_;
+  const std::uint64_t repeats = repeats_;
+  repeats_ = 0;
+  return repeats;
+}
+
+void append_repeat_notice(std::string &out, std::uint64_t repeats)
+{
+  char digits[24];
+  const auto result = std::to_chars(digits, digits + sizeof(digits), repeats);
+  out += "last message repeated ";
+  out.append(digits, result.ptr);
+  out += repeats == 1 ? " time\n" : " times\n";
+}
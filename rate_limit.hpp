@@ -0,0 +1,158 @@
+#pragma once
+
+/*! \file Per-callsite rate limiting and sampling, and collapsing of repeated messages. */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace rate_limit_detail
+{
+  inline std::int64_t steady_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  //! Per-thread xorshift generator, so sampling shares no state between threads.
+  inline std::uint32_t random32()
+  {
+    thread_local std::uint64_t state =
+        0x9e3779b97f4a7c15ull ^ static_cast<std::uint64_t>(steady_ns()) ^ reinterpret_cast<std::uintptr_t>(&state);
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<std::uint32_t>(state >> 32);
+  }
+}
+
+//! Lets the 1st, (n+1)th, (2n+1)th ... call through.
+class EveryN
+{
+public:
+  constexpr explicit EveryN(std::uint64_t n) : n_(n ? n : 1) {}
+
+  bool allow() { return count_.fetch_add(1, std::memory_order_relaxed) % n_ == 0; }
+
+private:
+  const std::uint64_t n_;
+  std::atomic<std::uint64_t> count_{0};
+};
+
+//! Lets at most one call per interval through.
+class EveryInterval
+{
+public:
+  constexpr explicit EveryInterval(std::chrono::nanoseconds interval) : interval_(interval.count()) {}
+
+  bool allow()
+  {
+    const std::int64_t now = rate_limit_detail::steady_ns();
+    std::int64_t next = next_.load(std::memory_order_relaxed);
+    // Suppressed calls only read the shared word.
+    return now >= next && next_.compare_exchange_strong(next, now + interval_, std::memory_order_relaxed);
+  }
+
+private:
+  const std::int64_t interval_;
+  std::atomic<std::int64_t> next_{0};
+};
+
+//! Lets each call through with a fixed probability.
+class Sampler
+{
+public:
+  constexpr explicit Sampler(double probability)
+      : threshold_(probability <= 0.0   ? 0
+                   : probability >= 1.0 ? 0x100000000ull
+                                        : static_cast<std::uint64_t>(probability * 4294967296.0))
+  {
+  }
+
+  bool allow() const { return rate_limit_detail::random32() < threshold_; }
+
+private:
+  const std::uint64_t threshold_;
+};
+
+/**
+ * @brief Token bucket: a sustained rate with bursts of up to burst calls.
+ *
+ * Kept as a single "theoretical arrival time" word (GCRA), so a call costs one
+ * compare-and-swap when allowed and one load when suppressed.
+ */
+class RateLimiter
+{
+public:
+  constexpr RateLimiter(double per_second, std::uint32_t burst)
+      : interval_(per_second > 0.0 ? static_cast<std::int64_t>(1e9 / per_second) : INT64_MAX / 2),
+        tolerance_(per_second > 0.0 ? interval_ * static_cast<std::int64_t>(burst ? burst - 1 : 0) : 0)
+  {
+  }
+
+  bool allow()
+  {
+    const std::int64_t now = rate_limit_detail::steady_ns();
+    std::int64_t arrival = arrival_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      const std::int64_t start = arrival > now ? arrival : now;
+      if (start - now > tolerance_)
+        return false;
+      if (arrival_.compare_exchange_weak(arrival, start + interval_, std::memory_order_relaxed))
+        return true;
+    }
+  }
+
+private:
+  const std::int64_t interval_;
+  const std::int64_t tolerance_;
+  std::atomic<std::int64_t> arrival_{0};
+};
+
+/**
+ * @brief Collapse runs of identical consecutive messages in the text tracers.
+ *
+ * A run is reported as "last message repeated N times" when a different message
+ * arrives, on flush, and at least every report_interval while it lasts.
+ *
+ * @param enabled false writes every message, the default.
+ */
+void set_duplicate_collapsing(bool enabled, std::chrono::seconds report_interval = std::chrono::seconds(30));
+
+//! Whether set_duplicate_collapsing() is on.
+bool duplicate_collapsing();
+
+//! Drops consecutive copies of a message and counts them. The owning tracer serializes calls.
+class DuplicateFilter
+{
+public:
+  /**
+   * @brief Account for a message about to be written.
+   *
+   * @param header severity header of the message
+   * @param when timestamp_now() of the message
+   * @param[out] repeats copies of the previous message to report before writing, 0 if none
+   * @param[out] repeats_header severity header of those copies
+   * @return false if the message repeats the previous one and must be dropped.
+   */
+  bool admit(const char *header, std::string_view message, std::int64_t when, std::uint64_t &repeats,
+             const char *&repeats_header);
+
+  //! Copies suppressed and not reported yet; resets the count.
+  std::uint64_t take(const char *&header);
+
+private:
+  std::string last_;
+  const char *last_header_ = "";
+  bool has_last_ = false;
+  std::uint64_t repeats_ = 0;
+  //! When the current run was last reported.
+  std::int64_t reported_at_ = 0;
+};
+
+//! Append the text of a repeat report, "last message repeated N times\n".
+void append_repeat_notice(std::string &out, std::uint64_t repeats);
@@ -0,0 +1,540 @@
+#include "rotation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <zstd.h>
+
+#include "seekable.hpp"
+#include "time_index.hpp"
+
+namespace
+{
+  //! Suffix of active files that were rotated but not yet moved into the backup chain.
+  const std::string pending_marker = ".rotating.";
+
+  std::tm local_time(std::time_t seconds)
+  {
+    std::tm local{};
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    return local;
+  }
+
+  bool all_digits(std::string_view text)
+  {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](char c)
+                                        { return c >= '0' && c <= '9'; });
+  }
+
+  //! Uncompressed bytes per frame of rotated files compressed for RotationConfig::time_index.
+  constexpr std::size_t indexed_frame_size = 256 * 1024;
+
+  //! Length of "yyyymmdd-hhmmss".
+  constexpr std::size_t stamp_length = 15;
+
+  //! Split a BackupNaming::timestamp key into the stamp and the collision suffix.
+  bool parse_stamp(std::string_view key, std::string &stamp, std::uint64_t &suffix)
+  {
+    if (key.size() < stamp_length || key[8] != '-' || !all_digits(key.substr(0, 8)) ||
+        !all_digits(key.substr(9, 6)))
+      return false;
+    stamp.assign(key.substr(0, stamp_length));
+    suffix = 0;
+    if (key.size() == stamp_length)
+      return true;
+    if (key[stamp_length] != '-' || !all_digits(key.substr(stamp_length + 1)))
+      return false;
+    suffix = std::stoull(std::string(key.substr(stamp_length + 1)));
+    return true;
+  }
+
+  //! The path without a ".zst" suffix.
+  std::filesystem::path uncompressed(std::filesystem::path path)
+  {
+    if (path.extension() == ".zst")
+      path.replace_extension();
+    return path;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// LogRotator – construction / destruction
+// ---------------------------------------------------------------------------
+
+LogRotator::LogRotator(const std::filesystem::path &filepath, const RotationConfig &rotation)
+    : filepath_(filepath), active_path_(filepath), rotation_(rotation)
+{
+  if (rotation_.compress_live)
+    active_path_ += ".zst";
+
+  // Pick up rotations a previous process did not get to finish.
+  const auto dir = filepath_.parent_path().empty() ? std::filesystem::current_path() : filepath_.parent_path();
+  const auto prefix = active_path_.filename().string() + pending_marker;
+  std::vector<std::pair<std::size_t, std::filesystem::path>> leftovers;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+  {
+    const auto name = entry.path().filename().string();
+    // Time indexes of pending files move along with them.
+    if (name.rfind(prefix, 0) != 0 || !all_digits(std::string_view(name).substr(prefix.size())))
+      continue;
+    try
+    {
+      leftovers.emplace_back(std::stoull(name.substr(prefix.size())), entry.path());
+    }
+    catch (const std::exception &)
+    {
+      // Not one of ours.
+    }
+  }
+  std::sort(leftovers.begin(), leftovers.end());
+  for (auto &[sequence, path] : leftovers)
+  {
+    pending_sequence_ = std::max(pending_sequence_, sequence + 1);
+    jobs_.push_back(std::move(path));
+  }
+  scan_backups(dir);
+
+  // A file last written before the boundary that has passed since is rotated on the first write.
+  auto last_write = std::chrono::system_clock::now();
+  const auto modified = std::filesystem::last_write_time(active_path_, ec);
+  if (!ec)
+    last_write = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+        std::chrono::file_clock::to_sys(modified));
+  next_boundary_ = boundary_after(last_write);
+
+  if (!jobs_.empty())
+    worker_ = std::thread(&LogRotator::worker_loop, this);
+}
+
+LogRotator::~LogRotator()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  jobs_cv_.notify_one();
+  if (worker_.joinable())
+    worker_.join();
+}
+
+// ---------------------------------------------------------------------------
+// LogRotator – logging-thread side
+// ---------------------------------------------------------------------------
+
+void LogRotator::rotate()
+{
+  next_boundary_ = boundary_after(std::chrono::system_clock::now());
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto pending = active_path_;
+  pending += pending_marker + std::to_string(pending_sequence_++);
+  std::error_code ec;
+  move_file(active_path_, pending, ec);
+  if (ec)
+    return;
+  jobs_.push_back(std::move(pending));
+  if (!worker_.joinable())
+    worker_ = std::thread(&LogRotator::worker_loop, this);
+  jobs_cv_.notify_one();
+}
+
+void LogRotator::wait_idle()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cv_.wait(lock, [this]
+                { return jobs_.empty() && !busy_; });
+}
+
+// ---------------------------------------------------------------------------
+// LogRotator – background side
+// ---------------------------------------------------------------------------
+
+void LogRotator::worker_loop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;)
+  {
+    jobs_cv_.wait(lock, [this]
+                  { return stop_ || !jobs_.empty(); });
+    if (jobs_.empty())
+      break; // stop_ and nothing left
+    const auto pending = std::move(jobs_.front());
+    jobs_.pop_front();
+    busy_ = true;
+    lock.unlock();
+    finish_rotation(pending);
+    lock.lock();
+    busy_ = false;
+    if (jobs_.empty())
+      idle_cv_.notify_all();
+  }
+}
+
+std::filesystem::path LogRotator::backup_path(const std::string &key) const
+{
+  const auto stem = filepath_.stem().string();
+  const auto ext = filepath_.extension().string();
+  const auto dir = filepath_.parent_path().empty() ? std::filesystem::current_path() : filepath_.parent_path();
+  auto path = dir / (stem + "." + key + ext);
+  if (rotation_.compress_live)
+    path += ".zst";
+  return path;
+}
+
+void LogRotator::move_file(const std::filesystem::path &from, const std::filesystem::path &to,
+                           std::error_code &ec) const
+{
+  std::filesystem::rename(from, to, ec);
+  if (ec || !rotation_.time_index)
+    return;
+  std::error_code index_ec;
+  std::filesystem::rename(timeindex::sidecar_path(from), timeindex::sidecar_path(to), index_ec);
+}
+
+std::chrono::system_clock::time_point LogRotator::boundary_after(std::chrono::system_clock::time_point when) const
+{
+  if (rotation_.interval == RotationInterval::none)
+    return std::chrono::system_clock::time_point::max();
+  std::tm local = local_time(std::chrono::system_clock::to_time_t(when));
+  local.tm_sec = 0;
+  local.tm_min = 0;
+  if (rotation_.interval == RotationInterval::daily)
+  {
+    local.tm_hour = 0;
+    ++local.tm_mday;
+  }
+  else
+  {
+    ++local.tm_hour;
+  }
+  // Let mktime normalize the overflow and pick the DST offset of the boundary itself.
+  local.tm_isdst = -1;
+  return std::chrono::system_clock::from_time_t(std::mktime(&local));
+}
+
+void LogRotator::scan_backups(const std::filesystem::path &dir)
+{
+  const auto stem = filepath_.stem().string() + ".";
+  const auto ext = filepath_.extension().string();
+  struct Found
+  {
+    std::string stamp;
+    Backup backup;
+  };
+  std::vector<Found> found;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+  {
+    if (!entry.is_regular_file(ec))
+      continue;
+    std::string name = uncompressed(entry.path().filename()).string();
+    if (name.size() <= stem.size() + ext.size() || name.rfind(stem, 0) != 0 ||
+        name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+      continue;
+    const std::string_view key(name.data() + stem.size(), name.size() - stem.size() - ext.size());
+    Found backup;
+    if (rotation_.naming == BackupNaming::timestamp)
+    {
+      if (!parse_stamp(key, backup.stamp, backup.backup.number))
+        continue;
+    }
+    else
+    {
+      if (!all_digits(key))
+        continue;
+      backup.backup.number = std::stoull(std::string(key));
+    }
+    backup.backup.path = entry.path();
+    backup.backup.size = entry.file_size(ec);
+    if (ec)
+      backup.backup.size = 0;
+    found.push_back(std::move(backup));
+  }
+
+  // Oldest first: the highest index, the lowest sequence number or the earliest time.
+  std::sort(found.begin(), found.end(), [this](const Found &a, const Found &b)
+            {
+              if (rotation_.naming == BackupNaming::index)
+                return a.backup.number > b.backup.number;
+              if (a.stamp != b.stamp)
+                return a.stamp < b.stamp;
+              return a.backup.number < b.backup.number; });
+  for (Found &backup : found)
+  {
+    backup_bytes_ += backup.backup.size;
+    if (rotation_.naming == BackupNaming::sequence)
+      next_sequence_ = std::max(next_sequence_, backup.backup.number + 1);
+    backups_.push_back(std::move(backup.backup));
+  }
+  if (!found.empty())
+  {
+    last_stamp_ = std::move(found.back().stamp);
+    last_suffix_ = backups_.back().number;
+  }
+}
+
+std::filesystem::path LogRotator::next_backup_path(const std::filesystem::path &pending)
+{
+  if (rotation_.naming == BackupNaming::sequence)
+    return backup_path(std::to_string(next_sequence_++));
+
+  auto written = std::chrono::system_clock::now();
+  std::error_code ec;
+  const auto modified = std::filesystem::last_write_time(pending, ec);
+  if (!ec)
+    written = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+        std::chrono::file_clock::to_sys(modified));
+  const std::tm local = local_time(std::chrono::system_clock::to_time_t(written));
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+
+  // Rotating again within the same second counts up a suffix, so names keep sorting by age.
+  if (last_stamp_ == stamp)
+    return backup_path(last_stamp_ + "-" + std::to_string(++last_suffix_));
+  last_stamp_ = stamp;
+  last_suffix_ = 0;
+  return backup_path(last_stamp_);
+}
+
+void LogRotator::finish_rotation(const std::filesystem::path &pending)
+{
+  const std::size_t max_count =
+      rotation_.max_backup_count > 0 ? rotation_.max_backup_count : std::numeric_limits<std::size_t>::max();
+  // Make room first, so that index naming does not rename files about to go.
+  if (rotation_.max_backup_count > 0)
+    prune_old_backups(max_count - 1);
+
+  std::error_code ec;
+  Backup backup;
+  if (rotation_.naming == BackupNaming::index)
+  {
+    // log.N -> log.N+1, oldest first so that no name is taken yet.
+    for (Backup &older : backups_)
+    {
+      auto shifted = backup_path(std::to_string(older.number + 1));
+      if (!rotation_.compress_live && older.path.extension() == ".zst")
+        shifted += ".zst";
+      move_file(older.path, shifted, ec);
+      if (!ec)
+      {
+        older.path = std::move(shifted);
+        ++older.number;
+      }
+    }
+    backup.path = backup_path("1");
+    backup.number = 1;
+  }
+  else
+  {
+    backup.path = next_backup_path(pending);
+  }
+
+  move_file(pending, backup.path, ec);
+  if (ec)
+    return;
+  backup.size = std::filesystem::file_size(backup.path, ec);
+  // An error returns uintmax_t(-1), which would make prune_old_backups() delete every backup.
+  if (ec)
+    backup.size = 0;
+
+  // Compress the freshly-rotated file if requested and not compressed already.
+  if (rotation_.compress && !rotation_.compress_live)
+  {
+    const auto started = std::chrono::steady_clock::now();
+    // Indexed files stay seekable, so queries decompress only the frames they need.
+    const bool compressed =
+        rotation_.time_index
+            ? compress_file_seekable(backup.path, rotation_.compression_level, indexed_frame_size)
+            : compress_file_zstd(backup.path, rotation_.compression_level, rotation_.compression_workers);
+    if (compressed)
+    {
+      if (rotation_.time_index)
+      {
+        auto compressed_path = backup.path;
+        compressed_path += ".zst";
+        std::filesystem::rename(timeindex::sidecar_path(backup.path), timeindex::sidecar_path(compressed_path), ec);
+      }
+      compression_ns_.add(static_cast<std::uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count()));
+      backup.path += ".zst";
+      const std::uintmax_t output = std::filesystem::file_size(backup.path, ec);
+      if (!ec)
+      {
+        compression_input_.add(backup.size);
+        compression_output_.add(output);
+        backup.size = output;
+      }
+    }
+  }
+
+  backup_bytes_ += backup.size;
+  backups_.push_back(std::move(backup));
+  prune_old_backups(max_count);
+}
+
+void LogRotator::add_stats(SinkStats &stats) const
+{
+  stats.compression_input_bytes += compression_input_.get();
+  stats.compression_output_bytes += compression_output_.get();
+  stats.compression_time += std::chrono::nanoseconds(compression_ns_.get());
+}
+
+bool LogRotator::compress_file_zstd(const std::filesystem::path &src, int level, int workers)
+{
+  std::ifstream ifs(src, std::ios::binary);
+  if (!ifs.is_open())
+    return false;
+
+  // Write next to the final name first so a half-written .zst never shows up.
+  auto dst_path = src;
+  dst_path += ".zst";
+  auto tmp_path = dst_path;
+  tmp_path += ".tmp";
+  std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open())
+    return false;
+
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  if (!cctx)
+    return false;
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+  if (workers > 0)
+  {
+    // Fails harmlessly when zstd is built without multithreading.
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, workers);
+  }
+
+  // Fixed-size buffers: memory use does not depend on the file size.
+  std::vector<char> in_buf(ZSTD_CStreamInSize());
+  std::vector<char> out_buf(ZSTD_CStreamOutSize());
+  bool ok = true;
+  bool last = false;
+  while (ok && !last)
+  {
+    ifs.read(in_buf.data(), static_cast<std::streamsize>(in_buf.size()));
+    const auto read = static_cast<std::size_t>(ifs.gcount());
+    last = read < in_buf.size();
+    if (ifs.bad())
+    {
+      ok = false;
+      break;
+    }
+
+    const ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+    ZSTD_inBuffer input{in_buf.data(), read, 0};
+    bool finished = false;
+    while (!finished)
+    {
+      ZSTD_outBuffer output{out_buf.data(), out_buf.size(), 0};
+      const std::size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+      if (ZSTD_isError(remaining))
+      {
+        ok = false;
+        break;
+      }
+      ofs.write(out_buf.data(), static_cast<std::streamsize>(output.pos));
+      finished = last ? remaining == 0 : input.pos == input.size;
+    }
+  }
+  ZSTD_freeCCtx(cctx);
+  ifs.close();
+  ofs.close();
+
+  std::error_code ec;
+  if (!ok || !ofs)
+  {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  std::filesystem::rename(tmp_path, dst_path, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+
+  // Remove the uncompressed source.
+  std::filesystem::remove(src, ec);
+  return true;
+}
+
+bool LogRotator::compress_file_seekable(const std::filesystem::path &src, int level, std::size_t frame_size)
+{
+  std::ifstream ifs(src, std::ios::binary);
+  if (!ifs.is_open())
+    return false;
+
+  auto dst_path = src;
+  dst_path += ".zst";
+  auto tmp_path = dst_path;
+  tmp_path += ".tmp";
+  std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open())
+    return false;
+
+  bool ok = true;
+  try
+  {
+    SeekableZstdWriter writer(level);
+    std::string frame(frame_size, '\0');
+    std::string compressed;
+    while (ok)
+    {
+      ifs.read(frame.data(), static_cast<std::streamsize>(frame.size()));
+      const auto read = static_cast<std::size_t>(ifs.gcount());
+      if (ifs.bad())
+        ok = false;
+      if (!ok || read == 0)
+        break;
+      ok = writer.compress_frame(std::string_view(frame.data(), read), compressed);
+      ofs.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+    }
+    writer.finish(compressed);
+    ofs.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+  }
+  catch (const std::exception &)
+  {
+    ok = false;
+  }
+  ifs.close();
+  ofs.close();
+
+  std::error_code ec;
+  if (!ok || !ofs)
+  {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  std::filesystem::rename(tmp_path, dst_path, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  std::filesystem::remove(src, ec);
+  return true;
+}
+
+void LogRotator::prune_old_backups(std::size_t keep)
+{
+  while (!backups_.empty() &&
+         (backups_.size() > keep || (rotation_.max_total_size > 0 && backup_bytes_ > rotation_.max_total_size)))
+  {
+    std::error_code ec;
+    std::filesystem::remove(backups_.front().path, ec);
+    if (rotation_.time_index)
+      std::filesystem::remove(timeindex::sidecar_path(backups_.front().path), ec);
+    backup_bytes_ -= backups_.front().size;
+    backups_.pop_front();
+  }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+/*! \file Log-file rotation with background zstd compression. */
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "stats.hpp"
+
+//! How rotated files are named.
+enum class BackupNaming
+{
+  //! "log.1.txt" is the newest; every rotation renames the older backups up by one.
+  index,
+  //! "log.<n>.txt" with n growing by one per rotation; backups are never renamed.
+  sequence,
+  //! "log.<yyyymmdd-hhmmss>.txt", the local time the file was last written; backups are never renamed.
+  timestamp,
+};
+
+//! Rotation on wall-clock boundaries, in local time.
+enum class RotationInterval
+{
+  none,
+  hourly,
+  daily,
+};
+
+//! Configuration for log-file rotation and compression.
+struct RotationConfig
+{
+  //! Maximum size in bytes before rotation is triggered. 0 = no size limit.
+  std::size_t max_file_size = 0;
+  //! Maximum number of rotated (back-up) files to keep. 0 = unlimited.
+  std::size_t max_backup_count = 5;
+  //! Upper bound of the size of all backups together; the oldest go first. 0 = unlimited.
+  std::uint64_t max_total_size = 0;
+  //! Names of the backups.
+  BackupNaming naming = BackupNaming::index;
+  //! Also rotate at the first write after every full hour or midnight. Not supported by TraceType::mmap_file.
+  RotationInterval interval = RotationInterval::none;
+  //! Compress rotated files with zstd on a background thread.
+  bool compress = false;
+  //! zstd compression level; negative levels trade ratio for speed, up to ZSTD_maxCLevel().
+  int compression_level = 3;
+  //! Extra zstd worker threads per file. 0 = compress on the background thread alone.
+  int compression_workers = 0;
+  //! Write the active file itself as "<path>.zst" in the zstd seekable format, one frame per flush,
+  //! so rotation needs no recompression. Pair with a buffering FlushPolicy for a useful ratio.
+  bool compress_live = false;
+  //! Keep a "<file>.idx" time index of every text log file for tinylog-query; rotated files are
+  //! then compressed in the zstd seekable format. Not supported by TraceType::mmap_file and binary_file.
+  bool time_index = false;
+};
+
+/**
+ * @brief Moves a closed log file into the backup chain.
+ *
+ * The caller only renames the active file out of the way; naming, compression
+ * and pruning run on a background thread, one file at a time. The existing
+ * backups are listed once at construction and tracked in memory afterwards,
+ * so pruning never probes the file system.
+ */
+class LogRotator
+{
+public:
+  LogRotator(const std::filesystem::path &filepath, const RotationConfig &rotation);
+  //! Finishes all pending jobs.
+  ~LogRotator();
+
+  LogRotator(const LogRotator &) = delete;
+  LogRotator &operator=(const LogRotator &) = delete;
+
+  const RotationConfig &config() const { return rotation_; }
+
+  //! Path of the file being written: the configured path, plus ".zst" for live compression.
+  const std::filesystem::path &active_path() const { return active_path_; }
+
+  //! A RotationInterval boundary passed since the last rotation. Callers serialize it with rotate().
+  bool interval_elapsed() const
+  {
+    return rotation_.interval != RotationInterval::none && std::chrono::system_clock::now() >= next_boundary_;
+  }
+
+  /**
+   * @brief Rotate the active file, which the caller must have closed.
+   *
+   * Only renames it to a pending name; the caller can reopen the active path right away.
+   */
+  void rotate();
+
+  //! Block until every queued rotation is finished.
+  void wait_idle();
+
+  //! Add the compression counters of rotated files to a snapshot.
+  void add_stats(SinkStats &stats) const;
+
+  /**
+   * @brief Compress a file to "<src>.zst" with the streaming API and remove the source.
+   *
+   * @return true on success; on failure the source is left in place.
+   */
+  static bool compress_file_zstd(const std::filesystem::path &src, int level, int workers);
+
+  /**
+   * @brief Compress a file to "<src>.zst" in the zstd seekable format and remove the source.
+   *
+   * Frames hold frame_size bytes each, so readers can decompress parts of the file.
+   *
+   * @return true on success; on failure the source is left in place.
+   */
+  static bool compress_file_seekable(const std::filesystem::path &src, int level, std::size_t frame_size);
+
+private:
+  //! A backup file known to the worker.
+  struct Backup
+  {
+    std::filesystem::path path;
+    std::uint64_t size = 0;
+    //! The n of "log.<n>.txt" under BackupNaming::index; only the scan sets it otherwise.
+    std::uint64_t number = 0;
+  };
+
+  //! List the existing backups into backups_, oldest first.
+  void scan_backups(const std::filesystem::path &dir);
+  //! Background thread body.
+  void worker_loop();
+  //! Name the pending file as the newest backup, compress it, prune.
+  void finish_rotation(const std::filesystem::path &pending);
+  //! Remove the oldest backups while more than keep are left or they exceed max_total_size.
+  void prune_old_backups(std::size_t keep);
+  //! Name of a backup with the given key, e.g. "log.<key>.txt" ("log.<key>.txt.zst" with live compression).
+  std::filesystem::path backup_path(const std::string &key) const;
+  //! Rename a log file and its time index, if it has one.
+  void move_file(const std::filesystem::path &from, const std::filesystem::path &to, std::error_code &ec) const;
+  //! Name for a new backup under BackupNaming::sequence or timestamp.
+  std::filesystem::path next_backup_path(const std::filesystem::path &pending);
+  //! First RotationInterval boundary after the given time.
+  std::chrono::system_clock::time_point boundary_after(std::chrono::system_clock::time_point when) const;
+
+  //! Configured path of the log file; backups are named after it.
+  std::filesystem::path filepath_;
+  //! Path to the active log file.
+  std::filesystem::path active_path_;
+  //! Rotation / compression configuration.
+  RotationConfig rotation_;
+  //! Sequence number for pending file names.
+  std::size_t pending_sequence_ = 0;
+  //! Next time the active file is due for rotation under RotationInterval.
+  std::chrono::system_clock::time_point next_boundary_;
+  //! Existing backups, oldest first; owned by the worker once it runs.
+  std::deque<Backup> backups_;
+  //! Sum of the sizes in backups_.
+  std::uint64_t backup_bytes_ = 0;
+  //! Next number under BackupNaming::sequence.
+  std::uint64_t next_sequence_ = 1;
+  //! Stamp and collision suffix of the newest backup under BackupNaming::timestamp.
+  std::string last_stamp_;
+  std::uint64_t last_suffix_ = 0;
+  //! Protects jobs_, busy_ and stop_.
+  std::mutex mutex_;
+  //! Wakes the worker.
+  std::condition_variable jobs_cv_;
+  //! Wakes wait_idle() callers.
+  std::condition_variable idle_cv_;
+  //! Rotated files waiting to be moved into the backup chain, oldest first.
+  std::deque<std::filesystem::path> jobs_;
+  //! The worker is processing a job.
+  bool busy_ = false;
+  //! Asks the worker to exit once jobs_ is empty.
+  bool stop_ = false;
+  //! Bytes before and after compressing rotated files, and the time it took; written by the worker.
+  StatCounter compression_input_;
+  StatCounter compression_output_;
+  StatCounter compression_ns_;
+  //! Started on the first rotation.
+  std::thread worker_;
+};
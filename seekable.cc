@@ -0,0 +1,294 @@
+#include "seekable.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <zstd.h>
+#include <zstd_errors.h>
+
+namespace
+{
+  //! Skippable frame magic used for the seek table.
+  constexpr std::uint32_t seek_table_magic = 0x184D2A5E;
+  //! Last four bytes of a seek table.
+  constexpr std::uint32_t seekable_magic = 0x8F92EAB1;
+  //! Number_Of_Frames + Seek_Table_Descriptor + Seekable_Magic_Number.
+  constexpr std::size_t footer_size = 9;
+
+  void put_le32(std::string &out, std::uint32_t value)
+  {
+    const char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                           static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+    out.append(bytes, 4);
+  }
+
+  std::uint32_t get_le32(const char *in)
+  {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(in);
+    return static_cast<std::uint32_t>(bytes[0]) | static_cast<std::uint32_t>(bytes[1]) << 8 |
+           static_cast<std::uint32_t>(bytes[2]) << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+  }
+}
+
+SeekableZstdWriter::SeekableZstdWriter(int level)
+    : cctx_(ZSTD_createCCtx())
+{
+  if (!cctx_)
+    throw std::runtime_error("Failed to create zstd context");
+  ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level);
+}
+
+SeekableZstdWriter::~SeekableZstdWriter()
+{
+  ZSTD_freeCCtx(cctx_);
+}
+
+std::uint64_t SeekableZstdWriter::recover(const std::filesystem::path &path)
+{
+  entries_.clear();
+  std::error_code ec;
+  const std::uint64_t size = std::filesystem::file_size(path, ec);
+  if (ec || size == 0)
+    return 0;
+
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open())
+    throw std::runtime_error("Failed to open log file: " + path.string());
+
+  // A sliding window over the file; frames are bounded by the flush buffer size.
+  std::string window;
+  std::uint64_t window_offset = 0;
+  std::uint64_t good = 0;
+  while (good < size)
+  {
+    const std::size_t skip = static_cast<std::size_t>(good - window_offset);
+    const char *frame = window.data() + skip;
+    const std::size_t available = window.size() - skip;
+    const std::size_t frame_size = available ? ZSTD_findFrameCompressedSize(frame, available) : 0;
+    if (available && ZSTD_isError(frame_size) && ZSTD_getErrorCode(frame_size) != ZSTD_error_srcSize_wrong)
+      throw std::runtime_error("Not a zstd log file: " + path.string());
+
+    if (!available || ZSTD_isError(frame_size))
+    {
+      // The frame continues past the window.
+      if (window_offset + window.size() >= size)
+        break; // torn last frame
+      window.erase(0, skip);
+      window_offset = good;
+      const std::size_t chunk = std::max<std::size_t>(window.size(), 1 << 20);
+      const std::size_t old_size = window.size();
+      window.resize(old_size + chunk);
+      in.read(window.data() + old_size, static_cast<std::streamsize>(chunk));
+      window.resize(old_size + static_cast<std::size_t>(in.gcount()));
+      continue;
+    }
+
+    const std::uint32_t magic = get_le32(frame);
+    if ((magic & ZSTD_MAGIC_SKIPPABLE_MASK) == ZSTD_MAGIC_SKIPPABLE_START)
+    {
+      // Our own seek table at the end is rewritten on close; anything else is kept as is.
+      if (good + frame_size == size && frame_size >= 8 + footer_size &&
+          get_le32(frame + frame_size - 4) == seekable_magic)
+        break;
+      entries_.push_back({static_cast<std::uint32_t>(frame_size), 0});
+    }
+    else
+    {
+      const unsigned long long content = ZSTD_getFrameContentSize(frame, frame_size);
+      if (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR)
+        break;
+      entries_.push_back({static_cast<std::uint32_t>(frame_size), static_cast<std::uint32_t>(content)});
+    }
+    good += frame_size;
+  }
+  in.close();
+
+  if (good < size)
+    std::filesystem::resize_file(path, good, ec);
+  return good;
+}
+
+bool SeekableZstdWriter::compress_frame(std::string_view data, std::string &out)
+{
+  out.resize(ZSTD_compressBound(data.size()));
+  const std::size_t compressed = ZSTD_compress2(cctx_, out.data(), out.size(), data.data(), data.size());
+  if (ZSTD_isError(compressed))
+  {
+    out.clear();
+    return false;
+  }
+  out.resize(compressed);
+  entries_.push_back({static_cast<std::uint32_t>(compressed), static_cast<std::uint32_t>(data.size())});
+  return true;
+}
+
+std::uint64_t SeekableZstdWriter::content_size() const
+{
+  std::uint64_t size = 0;
+  for (const Entry &entry : entries_)
+    size += entry.decompressed_size;
+  return size;
+}
+
+void SeekableZstdWriter::finish(std::string &out)
+{
+  out.clear();
+  put_le32(out, seek_table_magic);
+  put_le32(out, static_cast<std::uint32_t>(entries_.size() * 8 + footer_size));
+  for (const Entry &entry : entries_)
+  {
+    put_le32(out, entry.compressed_size);
+    put_le32(out, entry.decompressed_size);
+  }
+  put_le32(out, static_cast<std::uint32_t>(entries_.size()));
+  out.push_back(0); // Seek_Table_Descriptor: no checksums
+  put_le32(out, seekable_magic);
+  entries_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// SeekableZstdReader
+// ---------------------------------------------------------------------------
+
+SeekableZstdReader::SeekableZstdReader()
+    : dctx_(ZSTD_createDCtx())
+{
+  if (!dctx_)
+    throw std::runtime_error("Failed to create zstd context");
+}
+
+SeekableZstdReader::~SeekableZstdReader()
+{
+  ZSTD_freeDCtx(dctx_);
+}
+
+bool SeekableZstdReader::open(const std::filesystem::path &path)
+{
+  frames_.clear();
+  size_ = 0;
+  in_.close();
+  in_.clear();
+  in_.open(path, std::ios::binary);
+  std::error_code ec;
+  const std::uint64_t file_size = std::filesystem::file_size(path, ec);
+  if (!in_.is_open() || ec)
+    return false;
+  return load_seek_table(file_size) || walk_frames(file_size);
+}
+
+bool SeekableZstdReader::load_seek_table(std::uint64_t file_size)
+{
+  if (file_size < 8 + footer_size)
+    return false;
+  char footer[footer_size];
+  in_.seekg(static_cast<std::streamoff>(file_size - footer_size));
+  if (!in_.read(footer, sizeof(footer)) || get_le32(footer + 5) != seekable_magic)
+    return false;
+  const std::uint32_t count = get_le32(footer);
+  // Bit 7 of the descriptor: every entry carries a checksum.
+  const std::size_t entry_size = (footer[4] & 0x80) ? 12 : 8;
+  const std::uint64_t table_size = 8 + std::uint64_t{count} * entry_size + footer_size;
+  if (table_size > file_size)
+    return false;
+  std::string table(static_cast<std::size_t>(table_size), '\0');
+  in_.seekg(static_cast<std::streamoff>(file_size - table_size));
+  if (!in_.read(table.data(), static_cast<std::streamsize>(table.size())) ||
+      get_le32(table.data()) != seek_table_magic)
+  {
+    in_.clear();
+    return false;
+  }
+  std::uint64_t compressed_offset = 0;
+  for (std::uint32_t i = 0; i < count; ++i)
+  {
+    const char *entry = table.data() + 8 + i * entry_size;
+    const std::uint32_t compressed_size = get_le32(entry);
+    add_frame(compressed_offset, compressed_size, get_le32(entry + 4));
+    compressed_offset += compressed_size;
+  }
+  return true;
+}
+
+bool SeekableZstdReader::walk_frames(std::uint64_t file_size)
+{
+  // A file still being written has no seek table yet.
+  frames_.clear();
+  size_ = 0;
+  in_.clear();
+  in_.seekg(0);
+  // A sliding window over the file, as in SeekableZstdWriter::recover(); frames are bounded
+  // by the flush buffer size, so memory does not grow with the file.
+  std::string window;
+  std::uint64_t window_offset = 0;
+  std::uint64_t offset = 0;
+  while (offset < file_size)
+  {
+    const std::size_t skip = static_cast<std::size_t>(offset - window_offset);
+    const char *frame = window.data() + skip;
+    const std::size_t available = window.size() - skip;
+    const std::size_t frame_size = available ? ZSTD_findFrameCompressedSize(frame, available) : 0;
+    if (available && ZSTD_isError(frame_size) && ZSTD_getErrorCode(frame_size) != ZSTD_error_srcSize_wrong)
+      break;
+    if (!available || ZSTD_isError(frame_size))
+    {
+      // The frame continues past the window.
+      if (window_offset + window.size() >= file_size)
+        break; // torn last frame
+      window.erase(0, skip);
+      window_offset = offset;
+      const std::size_t chunk = std::max<std::size_t>(window.size(), 1 << 20);
+      const std::size_t old_size = window.size();
+      window.resize(old_size + chunk);
+      in_.read(window.data() + old_size, static_cast<std::streamsize>(chunk));
+      window.resize(old_size + static_cast<std::size_t>(in_.gcount()));
+      if (window.size() == old_size)
+        return false;
+      continue;
+    }
+    std::uint32_t content = 0;
+    if ((get_le32(frame) & ZSTD_MAGIC_SKIPPABLE_MASK) != ZSTD_MAGIC_SKIPPABLE_START)
+    {
+      const unsigned long long size = ZSTD_getFrameContentSize(frame, frame_size);
+      if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+        return false;
+      content = static_cast<std::uint32_t>(size);
+    }
+    add_frame(offset, static_cast<std::uint32_t>(frame_size), content);
+    offset += frame_size;
+  }
+  in_.clear();
+  return true;
+}
+
+void SeekableZstdReader::add_frame(std::uint64_t compressed_offset, std::uint32_t compressed_size, std::uint32_t size)
+{
+  // Skippable frames hold no text.
+  if (size > 0)
+    frames_.push_back({compressed_offset, compressed_size, size_, size});
+  size_ += size;
+}
+
+bool SeekableZstdReader::read(std::uint64_t offset, std::uint64_t length, std::string &out)
+{
+  const std::uint64_t end = std::min(offset + length, size_);
+  auto frame = std::upper_bound(frames_.begin(), frames_.end(), offset, [](std::uint64_t value, const Frame &f)
+                                { return value < f.offset + f.size; });
+  for (; frame != frames_.end() && frame->offset < end; ++frame)
+  {
+    compressed_.resize(frame->compressed_size);
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(frame->compressed_offset));
+    if (!in_.read(compressed_.data(), static_cast<std::streamsize>(compressed_.size())))
+      return false;
+    frame_.resize(frame->size);
+    const std::size_t size = ZSTD_decompressDCtx(dctx_, frame_.data(), frame_.size(), compressed_.data(),
+                                                 compressed_.size());
+    if (ZSTD_isError(size) || size != frame->size)
+      return false;
+    const std::uint64_t from = std::max(offset, frame->offset) - frame->offset;
+    const std::uint64_t to = std::min(end, frame->offset + frame->size) - frame->offset;
+    out.append(frame_, static_cast<std::size_t>(from), static_cast<std::size_t>(to - from));
+  }
+  return true;
+}
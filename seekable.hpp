@@ -0,0 +1,118 @@
+#pragma once
+
+/*! \file Writer and reader for the zstd seekable format: independent frames followed by a seek table. */
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+//! Compresses data into independent zstd frames and keeps the seek table for them.
+class SeekableZstdWriter
+{
+public:
+  explicit SeekableZstdWriter(int level);
+  ~SeekableZstdWriter();
+
+  SeekableZstdWriter(const SeekableZstdWriter &) = delete;
+  SeekableZstdWriter &operator=(const SeekableZstdWriter &) = delete;
+
+  /**
+   * @brief Prepare an existing file for appending.
+   *
+   * Loads the frame list, drops a trailing seek table and truncates a torn last frame,
+   * so that at most the frame being written during a crash is lost.
+   *
+   * @return the length of the file after recovery.
+   */
+  std::uint64_t recover(const std::filesystem::path &path);
+
+  /**
+   * @brief Compress data as one independent frame.
+   *
+   * @param data uncompressed bytes
+   * @param out receives the frame, replacing its contents
+   * @return false on compression failure.
+   */
+  bool compress_frame(std::string_view data, std::string &out);
+
+  //! Uncompressed size of the frames written so far.
+  std::uint64_t content_size() const;
+
+  /**
+   * @brief Serialize the seek table of all frames written so far and start a new file.
+   *
+   * @param out receives the skippable seek-table frame, replacing its contents
+   */
+  void finish(std::string &out);
+
+private:
+  struct Entry
+  {
+    std::uint32_t compressed_size;
+    std::uint32_t decompressed_size;
+  };
+
+  //! Reused compression context.
+  ZSTD_CCtx_s *cctx_;
+  //! Frames of the current file, in order.
+  std::vector<Entry> entries_;
+};
+
+//! Reads byte ranges of a seekable zstd file, decompressing only the frames they touch.
+class SeekableZstdReader
+{
+public:
+  SeekableZstdReader();
+  ~SeekableZstdReader();
+
+  SeekableZstdReader(const SeekableZstdReader &) = delete;
+  SeekableZstdReader &operator=(const SeekableZstdReader &) = delete;
+
+  /**
+   * @brief Load the frame list from the seek table, or by walking the frames of a file still being written.
+   *
+   * @return false if the file cannot be read or has frames of unknown size, e.g. from streaming compression.
+   */
+  bool open(const std::filesystem::path &path);
+
+  //! Uncompressed size of the file.
+  std::uint64_t size() const { return size_; }
+
+  /**
+   * @brief Append uncompressed bytes to out; a range past the end is cut short.
+   *
+   * @return false on a read or decompression error.
+   */
+  bool read(std::uint64_t offset, std::uint64_t length, std::string &out);
+
+private:
+  struct Frame
+  {
+    std::uint64_t compressed_offset;
+    std::uint32_t compressed_size;
+    //! Uncompressed offset and size.
+    std::uint64_t offset;
+    std::uint32_t size;
+  };
+
+  //! Read the seek table at the end of the file; false if there is none.
+  bool load_seek_table(std::uint64_t file_size);
+  //! Find the frames by parsing the whole file, a window at a time.
+  bool walk_frames(std::uint64_t file_size);
+  //! Add a frame of the given sizes after the last one.
+  void add_frame(std::uint64_t compressed_offset, std::uint32_t compressed_size, std::uint32_t size);
+
+  std::ifstream in_;
+  ZSTD_DCtx_s *dctx_;
+  std::vector<Frame> frames_;
+  std::uint64_t size_ = 0;
+  //! Scratch buffers for one frame.
+  std::string compressed_;
+  std::string frame_;
+};
@@ -0,0 +1,109 @@
+#include "stats.hpp"
+
+#include <bit>
+
+#include "binary_format.hpp"
+
+namespace
+{
+  constexpr std::size_t bucket_count = std::tuple_size_v<decltype(LatencyHistogram::buckets)>;
+
+  std::size_t latency_bucket(std::chrono::steady_clock::duration elapsed)
+  {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (ns <= 0)
+      return 0;
+    const auto width = static_cast<std::size_t>(std::bit_width(static_cast<std::uint64_t>(ns)));
+    return width < bucket_count ? width : bucket_count - 1;
+  }
+}
+
+std::size_t stats_shard()
+{
+  return binlog::thread_number();
+}
+
+// ---------------------------------------------------------------------------
+// Snapshots
+// ---------------------------------------------------------------------------
+
+std::uint64_t LatencyHistogram::samples() const
+{
+  std::uint64_t total = 0;
+  for (const std::uint64_t count : buckets)
+    total += count;
+  return total;
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double quantile) const
+{
+  const std::uint64_t total = samples();
+  if (total == 0)
+    return std::chrono::nanoseconds(0);
+  const auto rank = static_cast<std::uint64_t>(quantile * static_cast<double>(total - 1)) + 1;
+  std::uint64_t seen = 0;
+  for (std::size_t bucket = 0; bucket < buckets.size(); ++bucket)
+  {
+    seen += buckets[bucket];
+    if (seen >= rank)
+      return std::chrono::nanoseconds(bucket == 0 ? 0 : std::uint64_t{1} << bucket);
+  }
+  return std::chrono::nanoseconds(std::uint64_t{1} << (buckets.size() - 1));
+}
+
+double SinkStats::compression_ratio() const
+{
+  if (compression_output_bytes == 0)
+    return 0.0;
+  return static_cast<double>(compression_input_bytes) / static_cast<double>(compression_output_bytes);
+}
+
+void SinkCounters::add_to(SinkStats &stats) const
+{
+  stats.bytes_written += bytes_written.get();
+  stats.flushes += flushes.get();
+  stats.syscalls += syscalls.get();
+  stats.write_errors += write_errors.get();
+  stats.rotations += rotations.get();
+  stats.rotation_time += std::chrono::nanoseconds(rotation_ns.get());
+  stats.compression_input_bytes += compression_input_bytes.get();
+  stats.compression_output_bytes += compression_output_bytes.get();
+  stats.compression_time += std::chrono::nanoseconds(compression_ns.get());
+}
+
+// ---------------------------------------------------------------------------
+// CallStats
+// ---------------------------------------------------------------------------
+
+void CallStats::Scope::begin(CallStats &stats, std::size_t slot)
+{
+  stats.messages_.add(slot);
+  const std::uint32_t every = stats.sample_every_.load(std::memory_order_relaxed);
+  if (every == 0)
+    return;
+  thread_local std::uint32_t countdown = 0;
+  if (countdown-- > 0)
+    return;
+  countdown = every - 1;
+  stats_ = &stats;
+  start_ = std::chrono::steady_clock::now();
+}
+
+void CallStats::Scope::end()
+{
+  stats_->latency_.add(latency_bucket(std::chrono::steady_clock::now() - start_));
+}
+
+void CallStats::enable(bool enabled, std::uint32_t sample_every)
+{
+  sample_every_.store(sample_every, std::memory_order_relaxed);
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void CallStats::snapshot(LogStats &stats) const
+{
+  for (std::size_t slot = 0; slot < stats.messages.size(); ++slot)
+    stats.messages[slot] = messages_.sum(slot);
+  for (std::size_t bucket = 0; bucket < bucket_count; ++bucket)
+    stats.latency.buckets[bucket] = latency_.sum(bucket);
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+/*! \file Logger self-metrics: cheap counters on the logging paths and the Log::stats() snapshot. */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "overflow_queue.hpp"
+
+//! Calls per latency bucket; buckets[i] counts calls that took [2^(i-1), 2^i) ns, the last one everything longer.
+struct LatencyHistogram
+{
+  std::array<std::uint64_t, 40> buckets{};
+
+  //! Number of sampled calls.
+  std::uint64_t samples() const;
+  //! Upper bound of the bucket holding the given quantile in [0, 1]; 0 without samples.
+  std::chrono::nanoseconds percentile(double quantile) const;
+};
+
+//! Counters of one output device, see Tracer::collect_stats().
+struct SinkStats
+{
+  //! File path, or the kind of device, e.g. "console".
+  std::string name;
+  //! Bytes handed to the OS, compressed bytes when compressing live.
+  std::uint64_t bytes_written = 0;
+  //! Times buffered data was handed to the OS.
+  std::uint64_t flushes = 0;
+  //! write, fsync and msync calls.
+  std::uint64_t syscalls = 0;
+  //! Writes the OS cut short or refused, e.g. on ENOSPC or EIO; their data is lost.
+  std::uint64_t write_errors = 0;
+  std::uint64_t rotations = 0;
+  //! Time the logging path spent rotating (close, rename, reopen); backups are shifted in the background.
+  std::chrono::nanoseconds rotation_time{0};
+  //! Bytes before and after zstd compression, live or of rotated files.
+  std::uint64_t compression_input_bytes = 0;
+  std::uint64_t compression_output_bytes = 0;
+  std::chrono::nanoseconds compression_time{0};
+  //! The sink writes from a queue; the fields below are valid.
+  bool queued = false;
+  //! Records waiting when the snapshot was taken.
+  std::uint64_t queue_depth = 0;
+  //! Most records found waiting by the writer.
+  std::uint64_t queue_high_water = 0;
+  //! Records dropped by the overflow policy, indexed by severity_slot().
+  DropCounts dropped{};
+
+  //! Input over output bytes; 0 if nothing was compressed.
+  double compression_ratio() const;
+};
+
+//! A snapshot returned by Log::stats().
+struct LogStats
+{
+  //! Messages accepted per severity, indexed by severity_slot(); counted while Log::set_stats() is on.
+  std::array<std::uint64_t, 8> messages{};
+  //! Every output device of the active tracer.
+  std::vector<SinkStats> sinks;
+  //! Sampled Log::log() call latency, when Log::set_stats() asks for it.
+  LatencyHistogram latency;
+};
+
+/**
+ * @brief A counter with a single writer at a time, e.g. one updated under a tracer's lock.
+ *
+ * Updates are plain loads and stores; readers on other threads see a recent value.
+ */
+class StatCounter
+{
+public:
+  void add(std::uint64_t n = 1) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+  //! Raise the value to at least n.
+  void raise(std::uint64_t n)
+  {
+    if (n > value_.load(std::memory_order_relaxed))
+      value_.store(n, std::memory_order_relaxed);
+  }
+  std::uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<std::uint64_t> value_{0};
+};
+
+//! Counters of a file-like sink, updated by the thread holding the sink's lock.
+struct SinkCounters
+{
+  StatCounter bytes_written;
+  StatCounter flushes;
+  StatCounter syscalls;
+  StatCounter write_errors;
+  StatCounter rotations;
+  StatCounter rotation_ns;
+  StatCounter compression_input_bytes;
+  StatCounter compression_output_bytes;
+  StatCounter compression_ns;
+
+  //! Add the counters to a snapshot.
+  void add_to(SinkStats &stats) const;
+};
+
+/**
+ * @brief Counters updated by any number of threads.
+ *
+ * Each thread adds to one of a few cache-line aligned shards, so threads rarely
+ * share a line; reading sums all shards.
+ */
+template <std::size_t N>
+class ShardedCounters
+{
+public:
+  void add(std::size_t index, std::uint64_t n = 1)
+  {
+    shards_[shard()].values[index].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  std::uint64_t sum(std::size_t index) const
+  {
+    std::uint64_t total = 0;
+    for (const Shard &shard : shards_)
+      total += shard.values[index].load(std::memory_order_relaxed);
+    return total;
+  }
+
+private:
+  static constexpr std::size_t shard_count = 16;
+
+  struct alignas(64) Shard
+  {
+    std::atomic<std::uint64_t> values[N] = {};
+  };
+
+  //! Shard of the calling thread.
+  static std::size_t shard();
+
+  Shard shards_[shard_count];
+};
+
+//! Number of the calling thread's shard in every ShardedCounters.
+std::size_t stats_shard();
+
+template <std::size_t N>
+std::size_t ShardedCounters<N>::shard()
+{
+  return stats_shard() % shard_count;
+}
+
+/**
+ * @brief Per-severity call counts and the sampled call-latency histogram of Log.
+ *
+ * Disabled, a call costs one relaxed load.
+ */
+class CallStats
+{
+public:
+  /**
+   * @brief Counts one call and, if it is sampled, times it until destroyed.
+   */
+  class Scope
+  {
+  public:
+    Scope(CallStats &stats, std::size_t slot)
+    {
+      if (stats.enabled_.load(std::memory_order_relaxed))
+        begin(stats, slot);
+    }
+    ~Scope()
+    {
+      if (stats_)
+        end();
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    void begin(CallStats &stats, std::size_t slot);
+    void end();
+
+    //! Set for sampled calls only.
+    CallStats *stats_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  //! Count calls; time one call in sample_every per thread (0 = none).
+  void enable(bool enabled, std::uint32_t sample_every);
+  //! Fill in the message counts and the latency histogram.
+  void snapshot(LogStats &stats) const;
+
+private:
+  std::atomic<bool> enabled_{false};
+  std::atomic<std::uint32_t> sample_every_{0};
+  ShardedCounters<8> messages_;
+  ShardedCounters<std::tuple_size_v<decltype(LatencyHistogram::buckets)>> latency_;
+};
@@ -0,0 +1,442 @@
+#include "structured.hpp"
+#include "timestamp.hpp"
+
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TINYLOG_HAVE_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TINYLOG_HAVE_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+  std::atomic<OutputFormat> current_format{OutputFormat::text};
+
+  //! Characters that end a bare logfmt value.
+  constexpr bool is_logfmt_break(unsigned char c)
+  {
+    return c == ' ' || c == '=';
+  }
+
+  //! Characters that need escaping inside a JSON string.
+  constexpr bool is_json_special(unsigned char c)
+  {
+    return c < 0x20 || c == '"' || c == '\\';
+  }
+
+  //! Index of the lowest set bit of a non-zero mask.
+  std::size_t first_bit(unsigned mask)
+  {
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return bit;
+#else
+    return static_cast<std::size_t>(__builtin_ctz(mask));
+#endif
+  }
+
+  /**
+   * @brief Length of the prefix of text free of characters that need escaping.
+   *
+   * @param logfmt also stop at the characters that force quoting a logfmt value
+   */
+  std::size_t clean_prefix(const char *text, std::size_t size, bool logfmt)
+  {
+    std::size_t i = 0;
+#if defined(TINYLOG_HAVE_AVX2)
+    {
+      const __m256i control = _mm256_set1_epi8(0x1f);
+      const __m256i quote = _mm256_set1_epi8('"');
+      const __m256i backslash = _mm256_set1_epi8('\\');
+      const __m256i space = _mm256_set1_epi8(logfmt ? ' ' : '"');
+      const __m256i equals = _mm256_set1_epi8(logfmt ? '=' : '"');
+      for (; i + 32 <= size; i += 32)
+      {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+        // Unsigned c <= 0x1f  <=>  max(c, 0x1f) == 0x1f.
+        __m256i hits = _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, control), control);
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, quote));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, backslash));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, space));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, equals));
+        const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask)
+          return i + first_bit(mask);
+      }
+    }
+#endif
+#if defined(TINYLOG_HAVE_SSE2)
+    {
+      const __m128i control = _mm_set1_epi8(0x1f);
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      const __m128i space = _mm_set1_epi8(logfmt ? ' ' : '"');
+      const __m128i equals = _mm_set1_epi8(logfmt ? '=' : '"');
+      for (; i + 16 <= size; i += 16)
+      {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        __m128i hits = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control);
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, quote));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, backslash));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, space));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, equals));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask)
+          return i + first_bit(mask);
+      }
+    }
+#endif
+    for (; i < size; ++i)
+    {
+      const auto c = static_cast<unsigned char>(text[i]);
+      if (is_json_special(c) || (logfmt && is_logfmt_break(c)))
+        break;
+    }
+    return i;
+  }
+
+  void append_escaped_char(std::string &out, char c)
+  {
+    static constexpr char hex[] = "0123456789abcdef";
+    switch (c)
+    {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+    {
+      const auto byte = static_cast<unsigned char>(c);
+      const char unicode[] = {'\\', 'u', '0', '0', hex[byte >> 4], hex[byte & 0xf]};
+      out.append(unicode, sizeof(unicode));
+      break;
+    }
+    }
+  }
+
+  //! A logfmt value: bare when possible, otherwise quoted and escaped.
+  void append_logfmt_string(std::string &out, std::string_view text)
+  {
+    if (!text.empty() && clean_prefix(text.data(), text.size(), true) == text.size())
+    {
+      out.append(text);
+      return;
+    }
+    out.push_back('"');
+    append_json_escaped(out, text);
+    out.push_back('"');
+  }
+
+  void append_json_string(std::string &out, std::string_view text)
+  {
+    out.push_back('"');
+    append_json_escaped(out, text);
+    out.push_back('"');
+  }
+
+  template <typename T>
+  void append_number(std::string &out, T value)
+  {
+    char digits[32];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+  }
+
+  //! Render a value; strings are handed to append_string, everything else is bare.
+  template <typename AppendString>
+  void append_value(std::string &out, const FieldValue &value, AppendString append_string)
+  {
+    switch (value.type)
+    {
+    case PackedType::boolean:
+      out += value.boolean ? "true" : "false";
+      break;
+    case PackedType::character:
+      append_string(out, std::string_view(&value.character, 1));
+      break;
+    case PackedType::signed_integer:
+      append_number(out, value.signed_integer);
+      break;
+    case PackedType::unsigned_integer:
+      append_number(out, value.unsigned_integer);
+      break;
+    case PackedType::single_float:
+    case PackedType::double_float:
+    {
+      const double number = value.type == PackedType::single_float ? value.single_float : value.double_float;
+      if (std::isfinite(number))
+      {
+        if (value.type == PackedType::single_float)
+          append_number(out, value.single_float);
+        else
+          append_number(out, value.double_float);
+      }
+      else
+      {
+        // Not representable as a JSON number.
+        append_string(out, std::isnan(number) ? "nan" : number > 0 ? "inf" : "-inf");
+      }
+      break;
+    }
+    case PackedType::pointer:
+    {
+      char digits[2 + 2 * sizeof(void *)] = {'0', 'x'};
+      const auto result = std::to_chars(digits + 2, digits + sizeof(digits),
+                                        reinterpret_cast<std::uintptr_t>(value.pointer), 16);
+      append_string(out, std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+      break;
+    }
+    default:
+      append_string(out, value.string);
+      break;
+    }
+  }
+
+  //! The timestamp without the brackets and trailing space of the text prefix.
+  std::string_view bare_timestamp(char *buffer, std::int64_t when)
+  {
+    std::string_view stamp(buffer, format_timestamp(buffer, when));
+    if (stamp.starts_with('['))
+      stamp.remove_prefix(1);
+    if (stamp.ends_with("] "))
+      stamp.remove_suffix(2);
+    return stamp;
+  }
+
+  //! Level name for a severity header.
+  const char *level_name(const char *header)
+  {
+    switch (header[0])
+    {
+    case 'D':
+      return "debug";
+    case 'W':
+      return "warning";
+    case 'E':
+      return "error";
+    case 'C':
+      return "critical";
+    case '*':
+      return "fatal";
+    default:
+      return "info";
+    }
+  }
+
+  std::string_view without_newline(std::string_view message)
+  {
+    while (!message.empty() && (message.back() == '\n' || message.back() == '\r'))
+      message.remove_suffix(1);
+    return message;
+  }
+
+  //! A logfmt key: parsers take keys bare, so characters that would end one become '_'.
+  void append_logfmt_key(std::string &out, std::string_view key)
+  {
+    if (key.empty())
+    {
+      out.push_back('_');
+      return;
+    }
+    std::size_t clean = clean_prefix(key.data(), key.size(), true);
+    out.append(key.data(), clean);
+    for (; clean < key.size(); ++clean)
+    {
+      const auto c = static_cast<unsigned char>(key[clean]);
+      out.push_back(is_json_special(c) || is_logfmt_break(c) ? '_' : key[clean]);
+    }
+  }
+
+  void pack_size(std::string &out, std::size_t size)
+  {
+    out.append(reinterpret_cast<const char *>(&size), sizeof(size));
+  }
+
+  //! Take a length-prefixed string off the front of packed.
+  bool unpack_string(std::string_view &packed, std::string_view &out)
+  {
+    std::size_t size;
+    if (packed.size() < sizeof(size))
+      return false;
+    std::memcpy(&size, packed.data(), sizeof(size));
+    packed.remove_prefix(sizeof(size));
+    if (packed.size() < size)
+      return false;
+    out = packed.substr(0, size);
+    packed.remove_prefix(size);
+    return true;
+  }
+
+  void append_pairs(std::string &out, const Field *fields, std::size_t count)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      out.push_back(' ');
+      append_logfmt_key(out, fields[i].key);
+      out.push_back('=');
+      append_value(out, fields[i].value, append_logfmt_string);
+    }
+  }
+
+  void render(std::string &out, OutputFormat format, std::int64_t when, const char *header,
+              std::string_view message, const Field *fields, std::size_t count)
+  {
+    char buffer[max_timestamp_length];
+    if (format == OutputFormat::json)
+    {
+      out += "{\"ts\":";
+      append_json_string(out, bare_timestamp(buffer, when));
+      out += ",\"level\":\"";
+      out += level_name(header);
+      out += "\",\"msg\":";
+      append_json_string(out, message);
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        out.push_back(',');
+        append_json_string(out, fields[i].key);
+        out.push_back(':');
+        append_value(out, fields[i].value, append_json_string);
+      }
+      out += "}\n";
+    }
+    else
+    {
+      out += "ts=";
+      append_logfmt_string(out, bare_timestamp(buffer, when));
+      out += " level=";
+      out += level_name(header);
+      out += " msg=";
+      append_logfmt_string(out, message);
+      append_pairs(out, fields, count);
+      out.push_back('\n');
+    }
+  }
+}
+
+void set_output_format(OutputFormat format)
+{
+  current_format.store(format, std::memory_order_relaxed);
+}
+
+OutputFormat output_format()
+{
+  return current_format.load(std::memory_order_relaxed);
+}
+
+void append_json_escaped(std::string &out, std::string_view text)
+{
+  while (!text.empty())
+  {
+    const std::size_t clean = clean_prefix(text.data(), text.size(), false);
+    out.append(text.data(), clean);
+    if (clean == text.size())
+      break;
+    append_escaped_char(out, text[clean]);
+    text.remove_prefix(clean + 1);
+  }
+}
+
+void render_message(std::string &out, OutputFormat format, std::int64_t when, const char *header,
+                    std::string_view message)
+{
+  if (format == OutputFormat::text)
+  {
+    char prefix[max_timestamp_length];
+    out.append(prefix, format_timestamp(prefix, when));
+    out += header;
+    out.append(message);
+    return;
+  }
+  render(out, format, when, header, without_newline(message), nullptr, 0);
+}
+
+void render_structured(std::string &out, OutputFormat format, std::int64_t when, const char *header,
+                       std::string_view message, const Field *fields, std::size_t count)
+{
+  if (format == OutputFormat::text)
+  {
+    char prefix[max_timestamp_length];
+    out.append(prefix, format_timestamp(prefix, when));
+    out += header;
+    render_fields(out, message, fields, count);
+    return;
+  }
+  render(out, format, when, header, message, fields, count);
+}
+
+void render_fields(std::string &out, std::string_view message, const Field *fields, std::size_t count)
+{
+  out.append(message);
+  append_pairs(out, fields, count);
+  out.push_back('\n');
+}
+
+void pack_fields(std::string &out, const Field *fields, std::size_t count)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const FieldValue &value = fields[i].value;
+    pack_size(out, fields[i].key.size());
+    out.append(fields[i].key);
+    out.push_back(static_cast<char>(value.type));
+    if (value.type == PackedType::string)
+    {
+      pack_size(out, value.string.size());
+      out.append(value.string);
+    }
+    else
+    {
+      // Every other type fits in the 8 bytes of the union.
+      out.append(reinterpret_cast<const char *>(&value.unsigned_integer), sizeof(value.unsigned_integer));
+    }
+  }
+}
+
+bool unpack_fields(std::string_view packed, std::vector<Field> &out)
+{
+  out.clear();
+  while (!packed.empty())
+  {
+    Field field{};
+    if (!unpack_string(packed, field.key) || packed.empty())
+      return false;
+    field.value.type = static_cast<PackedType>(packed.front());
+    packed.remove_prefix(1);
+    if (field.value.type == PackedType::string)
+    {
+      if (!unpack_string(packed, field.value.string))
+        return false;
+    }
+    else
+    {
+      if (packed.size() < sizeof(field.value.unsigned_integer))
+        return false;
+      std::memcpy(&field.value.unsigned_integer, packed.data(), sizeof(field.value.unsigned_integer));
+      packed.remove_prefix(sizeof(field.value.unsigned_integer));
+    }
+    out.push_back(field);
+  }
+  return true;
+}
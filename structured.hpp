@@ -0,0 +1,152 @@
+#pragma once
+
+/*! \file Key-value records and their text, JSON Lines and logfmt renderings. */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "packed_args.hpp"
+
+//! Line layout of the text tracers.
+enum class OutputFormat
+{
+  //! "[timestamp] Header: message", fields appended as key=value.
+  text,
+  //! One JSON object per line: {"ts":...,"level":...,"msg":...,fields...}.
+  json,
+  //! ts=... level=... msg=... followed by the fields, one record per line.
+  logfmt,
+};
+
+//! Apply an output format process-wide.
+void set_output_format(OutputFormat format);
+
+//! Current output format.
+OutputFormat output_format();
+
+//! The value of a structured field. Strings refer to the caller's data.
+struct FieldValue
+{
+  PackedType type;
+  union
+  {
+    bool boolean;
+    char character;
+    std::int64_t signed_integer;
+    std::uint64_t unsigned_integer;
+    float single_float;
+    double double_float;
+    const void *pointer;
+  };
+  std::string_view string;
+};
+
+//! One key-value pair of a structured record.
+struct Field
+{
+  std::string_view key;
+  FieldValue value;
+};
+
+//! Capture a field value; accepts the argument types PackedArgs accepts.
+template <typename T>
+FieldValue make_field_value(const T &value)
+{
+  using D = std::decay_t<T>;
+  static_assert(packed_detail::is_packable_v<D>, "field values must be arithmetic, pointer or string types");
+  FieldValue field{};
+  if constexpr (std::is_same_v<D, bool>)
+  {
+    field.type = PackedType::boolean;
+    field.boolean = value;
+  }
+  else if constexpr (std::is_same_v<D, char>)
+  {
+    field.type = PackedType::character;
+    field.character = value;
+  }
+  else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>)
+  {
+    field.type = PackedType::signed_integer;
+    field.signed_integer = value;
+  }
+  else if constexpr (std::is_integral_v<D>)
+  {
+    field.type = PackedType::unsigned_integer;
+    field.unsigned_integer = value;
+  }
+  else if constexpr (std::is_same_v<D, float>)
+  {
+    field.type = PackedType::single_float;
+    field.single_float = value;
+  }
+  else if constexpr (std::is_same_v<D, double>)
+  {
+    field.type = PackedType::double_float;
+    field.double_float = value;
+  }
+  else if constexpr (packed_detail::is_pointer_v<D>)
+  {
+    field.type = PackedType::pointer;
+    field.pointer = value;
+  }
+  else if constexpr (std::is_array_v<T>)
+  {
+    field.type = PackedType::string;
+    field.string = std::string_view(value);
+  }
+  else if constexpr (std::is_same_v<D, const char *> || std::is_same_v<D, char *>)
+  {
+    field.type = PackedType::string;
+    field.string = value ? std::string_view(value) : std::string_view();
+  }
+  else
+  {
+    field.type = PackedType::string;
+    field.string = std::string_view(value);
+  }
+  return field;
+}
+
+/**
+ * @brief Append text with JSON string escaping, without the surrounding quotes.
+ *
+ * Scans 16 or 32 bytes at a time (SSE2 / AVX2) for characters that need escaping,
+ * so text without any is copied in one go.
+ */
+void append_json_escaped(std::string &out, std::string_view text);
+
+/**
+ * @brief Append a plain message as one line in the given format.
+ *
+ * The text format reproduces the classic layout byte for byte; the others drop the
+ * message's trailing newline and end the record with their own.
+ *
+ * @param header severity header as used by the text tracers, e.g. "Debug: "
+ */
+void render_message(std::string &out, OutputFormat format, std::int64_t when, const char *header,
+                    std::string_view message);
+
+//! Append a structured record as one line in the given format.
+void render_structured(std::string &out, OutputFormat format, std::int64_t when, const char *header,
+                       std::string_view message, const Field *fields, std::size_t count);
+
+//! Append "message key=value ...\n", the body of a structured record in the text format.
+void render_fields(std::string &out, std::string_view message, const Field *fields, std::size_t count);
+
+/**
+ * @brief Append fields in a compact form that owns copies of the keys and string values,
+ * for a record handed to another thread.
+ */
+void pack_fields(std::string &out, const Field *fields, std::size_t count);
+
+/**
+ * @brief Read fields written by pack_fields(); their strings point into packed.
+ *
+ * @return false if packed was cut short; out holds the fields read up to there.
+ */
+bool unpack_fields(std::string_view packed, std::vector<Field> &out);
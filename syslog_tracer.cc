@@ -0,0 +1,358 @@
+#include "log.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#include <stdlib.h>
+#endif
+
+namespace
+{
+  //! Syslog severities, RFC 5424 section 6.2.1.
+  constexpr int syslog_alert = 1;
+  constexpr int syslog_warning = 4;
+
+  int syslog_severity(TraceSeverity severity)
+  {
+    switch (severity)
+    {
+    case TraceSeverity::critical:
+      return 2;
+    case TraceSeverity::error:
+      return 3;
+    case TraceSeverity::warning:
+      return syslog_warning;
+    case TraceSeverity::info:
+      return 6;
+    default:
+      return 7;
+    }
+  }
+
+  void append_number(std::string &out, std::uint64_t value, int width = 0)
+  {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    for (int pad = width - static_cast<int>(result.ptr - digits); pad > 0; --pad)
+      out += '0';
+    out.append(digits, result.ptr);
+  }
+
+  //! A header field: printable US-ASCII without spaces, at most max_length characters, "-" if empty.
+  void append_field(std::string &out, std::string_view value, std::size_t max_length)
+  {
+    if (value.empty())
+    {
+      out += '-';
+      return;
+    }
+    for (const char c : value.substr(0, max_length))
+      out += c > ' ' && c < '\x7f' ? c : '_';
+  }
+
+  std::string default_app_name()
+  {
+#if defined(__linux__)
+    return program_invocation_short_name;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    return getprogname();
+#else
+    return {};
+#endif
+  }
+
+  std::string default_hostname()
+  {
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) != 0)
+      return {};
+    return name;
+  }
+
+  //! A socket that is not inherited by exec'd children.
+  int open_socket(int family, int type, int protocol)
+  {
+    const int fd = ::socket(family, type, protocol);
+    if (fd >= 0)
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+  }
+}
+
+struct SyslogTracer::Batch
+{
+  std::vector<std::string> datagrams;
+  std::vector<iovec> parts;
+#if defined(__linux__)
+  std::vector<mmsghdr> headers;
+#else
+  std::vector<msghdr> headers;
+#endif
+  //! Datagrams rendered so far.
+  std::size_t size = 0;
+};
+
+// ---------------------------------------------------------------------------
+// SyslogTracer – construction / destruction
+// ---------------------------------------------------------------------------
+
+SyslogTracer::SyslogTracer(const SyslogConfig &config)
+    : AsyncTracer(config.queue), config_(config), local_(!config.address.starts_with("udp://")),
+      batch_(std::make_unique<Batch>())
+{
+  if (config_.facility < 0 || config_.facility > 23)
+    throw std::runtime_error("Invalid syslog facility: " + std::to_string(config_.facility));
+  config_.batch_size = std::max<std::size_t>(config_.batch_size, 1);
+  // Room for the header and at least a few bytes of message.
+  config_.max_datagram = std::max<std::size_t>(config_.max_datagram, 480);
+
+  fields_ += ' ';
+  append_field(fields_, config_.hostname.empty() ? default_hostname() : config_.hostname, 255);
+  fields_ += ' ';
+  append_field(fields_, config_.app_name.empty() ? default_app_name() : config_.app_name, 48);
+  fields_ += ' ';
+  append_number(fields_, static_cast<std::uint64_t>(::getpid()));
+  // No MSGID and no STRUCTURED-DATA.
+  fields_ += " - - ";
+
+  batch_->datagrams.resize(config_.batch_size);
+  for (std::string &datagram : batch_->datagrams)
+    datagram.reserve(config_.max_datagram);
+  batch_->parts.resize(config_.batch_size);
+  batch_->headers.resize(config_.batch_size);
+
+  connect_socket();
+  start_writer();
+}
+
+SyslogTracer::~SyslogTracer()
+{
+  stop_writer();
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void SyslogTracer::connect_socket()
+{
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  if (local_)
+  {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (config_.address.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("Syslog socket path too long: " + config_.address);
+    std::memcpy(address.sun_path, config_.address.data(), config_.address.size());
+    const int fd = open_socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+      throw std::runtime_error("Failed to create syslog socket: " + std::string(std::strerror(errno)));
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+    {
+      const int error = errno;
+      ::close(fd);
+      throw std::runtime_error("Failed to connect to " + config_.address + ": " + std::strerror(error));
+    }
+    fd_ = fd;
+    return;
+  }
+
+  // "udp://host:port", "udp://[v6 address]:port"; the port defaults to 514.
+  std::string_view rest = std::string_view(config_.address).substr(6);
+  std::string host;
+  std::string port = "514";
+  if (rest.starts_with('['))
+  {
+    const std::size_t close = rest.find(']');
+    if (close == std::string_view::npos)
+      throw std::runtime_error("Invalid syslog address: " + config_.address);
+    host = rest.substr(1, close - 1);
+    rest.remove_prefix(close + 1);
+    if (rest.starts_with(':'))
+      port = rest.substr(1);
+  }
+  else if (const std::size_t colon = rest.rfind(':'); colon != std::string_view::npos)
+  {
+    host = rest.substr(0, colon);
+    port = rest.substr(colon + 1);
+  }
+  else
+  {
+    host = rest;
+  }
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *found = nullptr;
+  if (const int error = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &found); error != 0)
+    throw std::runtime_error("Failed to resolve " + config_.address + ": " + ::gai_strerror(error));
+  for (const addrinfo *candidate = found; candidate && fd_ < 0; candidate = candidate->ai_next)
+  {
+    const int fd = open_socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+    if (fd < 0)
+      continue;
+    // Connected, so the kernel looks the route up once rather than per datagram.
+    if (::connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0)
+      fd_ = fd;
+    else
+      ::close(fd);
+  }
+  ::freeaddrinfo(found);
+  if (fd_ < 0)
+    throw std::runtime_error("Failed to open syslog socket: " + config_.address);
+}
+
+// ---------------------------------------------------------------------------
+// SyslogTracer – flush / stats
+// ---------------------------------------------------------------------------
+
+void SyslogTracer::flush()
+{
+  drain();
+}
+
+void SyslogTracer::collect_stats(std::vector<SinkStats> &out)
+{
+  SinkStats stats;
+  stats.name = "syslog " + config_.address;
+  counters_.add_to(stats);
+  add_queue_stats(stats);
+  out.push_back(std::move(stats));
+}
+
+// ---------------------------------------------------------------------------
+// SyslogTracer – writer side
+// ---------------------------------------------------------------------------
+
+void SyslogTracer::render(std::int64_t when, int severity, std::string_view message)
+{
+  std::string &out = batch_->datagrams[batch_->size++];
+  out.clear();
+  out += '<';
+  append_number(out, static_cast<std::uint64_t>(config_.facility * 8 + severity));
+  out += ">1 ";
+
+  // TIMESTAMP in UTC with microseconds; the date and time are formatted once per second.
+  std::int64_t second = when / 1'000'000'000;
+  std::int64_t fraction = when % 1'000'000'000;
+  if (fraction < 0)
+  {
+    --second;
+    fraction += 1'000'000'000;
+  }
+  if (second != cached_second_)
+  {
+    const std::time_t seconds = static_cast<std::time_t>(second);
+    std::tm utc{};
+    gmtime_r(&seconds, &utc);
+    std::strftime(cached_time_, sizeof(cached_time_), "%Y-%m-%dT%H:%M:%S", &utc);
+    cached_second_ = second;
+  }
+  out += cached_time_;
+  out += '.';
+  append_number(out, static_cast<std::uint64_t>(fraction / 1000), 6);
+  out += 'Z';
+  out += fields_;
+
+  // Messages carry their line end; a datagram does not need one.
+  if (!message.empty() && message.back() == '\n')
+    message.remove_suffix(1);
+  if (out.size() < config_.max_datagram)
+    out.append(message.substr(0, config_.max_datagram - out.size()));
+}
+
+void SyslogTracer::send_batch()
+{
+  Batch &batch = *batch_;
+  const std::size_t count = batch.size;
+  batch.size = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    batch.parts[i].iov_base = batch.datagrams[i].data();
+    batch.parts[i].iov_len = batch.datagrams[i].size();
+#if defined(__linux__)
+    msghdr &header = batch.headers[i].msg_hdr;
+#else
+    msghdr &header = batch.headers[i];
+#endif
+    header = msghdr{};
+    header.msg_iov = &batch.parts[i];
+    header.msg_iovlen = 1;
+  }
+
+  std::size_t sent = 0;
+  bool retried = false;
+  bool reconnected = false;
+  while (sent < count)
+  {
+#if defined(__linux__)
+    const int result = ::sendmmsg(fd_, &batch.headers[sent], static_cast<unsigned>(count - sent), 0);
+#else
+    const int result = ::sendmsg(fd_, &batch.headers[sent], 0) >= 0 ? 1 : -1;
+#endif
+    counters_.syscalls.add();
+    if (result > 0)
+    {
+      for (std::size_t i = sent; i < sent + static_cast<std::size_t>(result); ++i)
+        counters_.bytes_written.add(batch.datagrams[i].size());
+      sent += static_cast<std::size_t>(result);
+      retried = false;
+      continue;
+    }
+    if (errno == EINTR)
+      continue;
+
+    // Retry the datagram once: a UDP socket reports an earlier ICMP error on the next send,
+    // and a Unix socket loses its peer when the syslog daemon restarts.
+    if (!retried)
+    {
+      retried = true;
+      if (local_ && !reconnected)
+      {
+        reconnected = true;
+        try
+        {
+          connect_socket();
+        }
+        catch (const std::runtime_error &)
+        {
+          // Nobody is listening; drop the batch and try again with the next one.
+          send_errors_.add(count - sent);
+          return;
+        }
+      }
+      continue;
+    }
+    send_errors_.add();
+    ++sent;
+    retried = false;
+  }
+}
+
+void SyslogTracer::write_record(const AsyncRecord &record)
+{
+  if (batch_->size == config_.batch_size)
+    send_batch();
+  render(record.when, record.fatal ? syslog_alert : syslog_severity(record.severity), text(record));
+}
+
+void SyslogTracer::end_batch()
+{
+  if (batch_->size > 0)
+    send_batch();
+}
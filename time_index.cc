@@ -0,0 +1,101 @@
+#include "time_index.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+// ---------------------------------------------------------------------------
+// timeindex – file layout
+// ---------------------------------------------------------------------------
+
+namespace timeindex
+{
+  std::filesystem::path sidecar_path(const std::filesystem::path &file)
+  {
+    auto path = file;
+    path += ".idx";
+    return path;
+  }
+
+  bool read(const std::filesystem::path &index, std::vector<Entry> &entries)
+  {
+    entries.clear();
+    std::ifstream in(index, std::ios::binary);
+    char header[header_size];
+    if (!in.read(header, sizeof(header)))
+      return false;
+    std::uint16_t byte_order = 0;
+    std::memcpy(&byte_order, header + sizeof(magic) + 1, sizeof(byte_order));
+    if (std::memcmp(header, magic, sizeof(magic)) != 0 || static_cast<std::uint8_t>(header[sizeof(magic)]) != version ||
+        byte_order != byte_order_mark)
+      return false;
+    Entry entry;
+    // A torn last entry is left out.
+    while (in.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+      entries.push_back(entry);
+    return true;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// TimeIndexWriter
+// ---------------------------------------------------------------------------
+
+TimeIndexWriter::~TimeIndexWriter()
+{
+  close();
+}
+
+void TimeIndexWriter::open(const std::filesystem::path &file, std::uint64_t content_size)
+{
+  close();
+  const auto path = timeindex::sidecar_path(file);
+  std::vector<timeindex::Entry> entries;
+  const bool existing = timeindex::read(path, entries);
+  // Text lost in a crash may have been indexed already.
+  std::size_t keep = 0;
+  while (keep < entries.size() && entries[keep].offset + entries[keep].length <= content_size)
+    ++keep;
+  if (existing)
+  {
+    std::error_code ec;
+    std::filesystem::resize_file(path, timeindex::header_size + keep * sizeof(timeindex::Entry), ec);
+  }
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  file_ = _wfopen(path.c_str(), existing ? L"ab" : L"wb");
+#else
+  file_ = std::fopen(path.c_str(), existing ? "ab" : "wb");
+#endif
+  if (!file_)
+    throw std::runtime_error("Failed to open log index: " + path.string());
+  std::setvbuf(file_, nullptr, _IONBF, 0);
+  if (!existing)
+  {
+    char header[timeindex::header_size];
+    std::memcpy(header, timeindex::magic, sizeof(timeindex::magic));
+    header[sizeof(timeindex::magic)] = static_cast<char>(timeindex::version);
+    std::memcpy(header + sizeof(timeindex::magic) + 1, &timeindex::byte_order_mark,
+                sizeof(timeindex::byte_order_mark));
+    std::fwrite(header, 1, sizeof(header), file_);
+  }
+  block_ = {};
+  offset_ = content_size;
+}
+
+void TimeIndexWriter::close()
+{
+  if (!file_)
+    return;
+  if (block_.length > 0)
+    write_entry();
+  std::fclose(file_);
+  file_ = nullptr;
+}
+
+void TimeIndexWriter::write_entry()
+{
+  if (file_)
+    std::fwrite(&block_, sizeof(block_), 1, file_);
+  block_ = {};
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+/*! \file Sidecar time index of text log files, written by FileTracer and read by tinylog-query.
+ *
+ * "<log file>.idx" sits next to the log file and follows it through rotation and
+ * compression. It splits the file's uncompressed text into blocks of about
+ * timeindex::block_size bytes, each ending at a line end:
+ *
+ *   header: magic[8] version:u8 byte_order:u16
+ *   entry:  offset:u64 length:u64 first_ns:i64 last_ns:i64 counts:u32[6]
+ *
+ * counts holds the lines of each binlog::Severity. Offsets count uncompressed bytes, so the
+ * index stays valid when the file is compressed in the zstd seekable format. Entries are
+ * written in host byte order once their block was handed to the OS; text not covered by
+ * any entry, e.g. lost with a crash, has to be scanned.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+#include "binary_format.hpp"
+
+namespace timeindex
+{
+  //! First bytes of every index.
+  inline constexpr char magic[8] = {'\x89', 'T', 'L', 'O', 'G', 'I', 'D', 'X'};
+  //! Layout version written into the header.
+  inline constexpr std::uint8_t version = 1;
+  //! Written in host byte order; a reader on another byte order sees 0x0201.
+  inline constexpr std::uint16_t byte_order_mark = 0x0102;
+  //! Size of magic + version + byte order mark.
+  inline constexpr std::size_t header_size = sizeof(magic) + 1 + sizeof(byte_order_mark);
+  //! Number of binlog::Severity values.
+  inline constexpr std::size_t severity_count = 6;
+  //! Uncompressed bytes after which a block ends at the next write.
+  inline constexpr std::uint64_t block_size = 64 * 1024;
+
+  //! One block of lines.
+  struct Entry
+  {
+    //! Uncompressed offset of the first line.
+    std::uint64_t offset = 0;
+    //! Uncompressed length of the lines.
+    std::uint64_t length = 0;
+    //! Earliest and latest timestamp, in nanoseconds since the Unix epoch.
+    std::int64_t first_ns = 0;
+    std::int64_t last_ns = 0;
+    //! Lines per binlog::Severity.
+    std::uint32_t counts[severity_count] = {};
+  };
+  static_assert(sizeof(Entry) == 56, "entries are stored as they are laid out in memory");
+
+  //! The index of a log file: "<file>.idx".
+  std::filesystem::path sidecar_path(const std::filesystem::path &file);
+
+  /**
+   * @brief Read the complete entries of an index.
+   *
+   * @return false if there is no index or it was written by another version or byte order.
+   */
+  bool read(const std::filesystem::path &index, std::vector<Entry> &entries);
+}
+
+/**
+ * @brief Keeps the sidecar index of the log file FileTracer is writing.
+ *
+ * Lines are added as they are buffered; written() ends the block once enough of them
+ * reached the file, so an entry never describes text that was not handed to the OS.
+ */
+class TimeIndexWriter
+{
+public:
+  TimeIndexWriter() = default;
+  //! Ends the current block.
+  ~TimeIndexWriter();
+
+  TimeIndexWriter(const TimeIndexWriter &) = delete;
+  TimeIndexWriter &operator=(const TimeIndexWriter &) = delete;
+
+  /**
+   * @brief Open the index of a log file for appending, ending the current one.
+   *
+   * Keeps entries that lie within the file's text and drops a torn last entry.
+   * Throws std::runtime_error on failure.
+   *
+   * @param file the log file
+   * @param content_size uncompressed length of the file's text
+   */
+  void open(const std::filesystem::path &file, std::uint64_t content_size);
+  //! End the current block and close the index.
+  void close();
+
+  //! Account for one line of the given length.
+  void add(std::int64_t when, binlog::Severity severity, std::size_t length)
+  {
+    if (block_.length == 0)
+    {
+      block_.offset = offset_;
+      block_.first_ns = block_.last_ns = when;
+    }
+    else
+    {
+      block_.first_ns = std::min(block_.first_ns, when);
+      block_.last_ns = std::max(block_.last_ns, when);
+    }
+    ++block_.counts[static_cast<std::size_t>(severity)];
+    block_.length += length;
+    offset_ += length;
+  }
+
+  //! Every line added so far was written out; ends the block if it is large enough.
+  void written()
+  {
+    if (block_.length >= timeindex::block_size)
+      write_entry();
+  }
+
+private:
+  //! Append the current block and start a new one.
+  void write_entry();
+
+  std::FILE *file_ = nullptr;
+  //! Lines added since the last entry.
+  timeindex::Entry block_;
+  //! Uncompressed length of the file's text, including block_.
+  std::uint64_t offset_ = 0;
+};
@@ -0,0 +1,273 @@
+#include "timestamp.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TINYLOG_HAVE_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define TINYLOG_HAVE_TSC 1
+#endif
+
+namespace
+{
+  //! Linear mapping from TSC ticks to wall-clock nanoseconds; immutable once published.
+  struct TscCalibration
+  {
+    std::uint64_t ticks;
+    std::int64_t nanoseconds;
+    double nanoseconds_per_tick;
+  };
+
+  //! Current configuration packed as format | precision << 8 | clock << 16.
+  std::atomic<std::uint32_t> config_word{0};
+  //! Bumped on every configuration change so per-thread caches notice.
+  std::atomic<std::uint32_t> config_generation{1};
+  //! Latest TSC calibration. Old ones are leaked on purpose: a racing reader may still use them.
+  std::atomic<const TscCalibration *> tsc_calibration{nullptr};
+
+  constexpr std::uint32_t pack(const TimestampConfig &config)
+  {
+    return static_cast<std::uint32_t>(config.format) |
+           static_cast<std::uint32_t>(config.precision) << 8 |
+           static_cast<std::uint32_t>(config.clock) << 16;
+  }
+
+  constexpr TimestampConfig unpack(std::uint32_t word)
+  {
+    return {static_cast<TimestampFormat>(word & 0xff),
+            static_cast<TimestampPrecision>((word >> 8) & 0xff),
+            static_cast<TimestampClock>((word >> 16) & 0xff)};
+  }
+
+  constexpr char digit_pairs[] =
+      "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899";
+
+  //! Write exactly `width` decimal digits of value, zero padded.
+  void write_digits(char *out, std::uint64_t value, int width)
+  {
+    char *cursor = out + width;
+    while (width >= 2)
+    {
+      cursor -= 2;
+      std::memcpy(cursor, &digit_pairs[(value % 100) * 2], 2);
+      value /= 100;
+      width -= 2;
+    }
+    if (width)
+      *--cursor = static_cast<char>('0' + value % 10);
+  }
+
+  //! Write value without padding, return the number of digits.
+  int write_unsigned(char *out, std::uint64_t value)
+  {
+    int width = 1;
+    for (std::uint64_t rest = value / 10; rest; rest /= 10)
+      ++width;
+    write_digits(out, value, width);
+    return width;
+  }
+
+  std::int64_t realtime_now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+#if defined(TINYLOG_HAVE_TSC)
+  const TscCalibration *calibrate_tsc()
+  {
+    const std::int64_t start_ns = realtime_now();
+    const std::uint64_t start_ticks = __rdtsc();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const std::int64_t end_ns = realtime_now();
+    const std::uint64_t end_ticks = __rdtsc();
+    if (end_ticks <= start_ticks || end_ns <= start_ns)
+      return nullptr;
+    return new TscCalibration{end_ticks, end_ns,
+                              static_cast<double>(end_ns - start_ns) / static_cast<double>(end_ticks - start_ticks)};
+  }
+#endif
+
+  //! Per-thread cache of the date/time part of the prefix, valid for one second.
+  struct PrefixCache
+  {
+    std::uint32_t generation = 0;
+    std::int64_t second = LLONG_MIN;
+    TimestampConfig config;
+    //! "[YYYY-MM-DD HH:MM:SS" without the fraction and the closing bracket.
+    char text[max_timestamp_length];
+    std::size_t length = 0;
+  };
+
+  thread_local PrefixCache prefix_cache;
+
+  void rebuild(PrefixCache &cache, std::int64_t second)
+  {
+    cache.second = second;
+    char *out = cache.text;
+    *out++ = '[';
+    if (cache.config.format == TimestampFormat::epoch)
+    {
+      if (second < 0)
+      {
+        *out++ = '-';
+        out += write_unsigned(out, static_cast<std::uint64_t>(-second));
+      }
+      else
+      {
+        out += write_unsigned(out, static_cast<std::uint64_t>(second));
+      }
+      cache.length = static_cast<std::size_t>(out - cache.text);
+      return;
+    }
+
+    const std::time_t seconds = static_cast<std::time_t>(second);
+    std::tm tm_snapshot{};
+    if (cache.config.format == TimestampFormat::local)
+    {
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+      localtime_s(&tm_snapshot, &seconds);
+#else
+      localtime_r(&seconds, &tm_snapshot);
+#endif
+    }
+    else
+    {
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+      gmtime_s(&tm_snapshot, &seconds);
+#else
+      gmtime_r(&seconds, &tm_snapshot);
+#endif
+    }
+    write_digits(out, static_cast<std::uint64_t>(tm_snapshot.tm_year + 1900), 4);
+    out[4] = '-';
+    write_digits(out + 5, static_cast<std::uint64_t>(tm_snapshot.tm_mon + 1), 2);
+    out[7] = '-';
+    write_digits(out + 8, static_cast<std::uint64_t>(tm_snapshot.tm_mday), 2);
+    out[10] = cache.config.format == TimestampFormat::iso8601 ? 'T' : ' ';
+    write_digits(out + 11, static_cast<std::uint64_t>(tm_snapshot.tm_hour), 2);
+    out[13] = ':';
+    write_digits(out + 14, static_cast<std::uint64_t>(tm_snapshot.tm_min), 2);
+    out[16] = ':';
+    write_digits(out + 17, static_cast<std::uint64_t>(tm_snapshot.tm_sec), 2);
+    cache.length = static_cast<std::size_t>(out + 19 - cache.text);
+  }
+}
+
+void set_timestamp_config(const TimestampConfig &config)
+{
+#if defined(TINYLOG_HAVE_TSC)
+  if (config.clock == TimestampClock::tsc)
+  {
+    if (const TscCalibration *calibration = calibrate_tsc())
+      tsc_calibration.store(calibration, std::memory_order_release);
+  }
+#endif
+  config_word.store(pack(config), std::memory_order_release);
+  config_generation.fetch_add(1, std::memory_order_release);
+}
+
+TimestampConfig timestamp_config()
+{
+  return unpack(config_word.load(std::memory_order_acquire));
+}
+
+std::int64_t timestamp_now()
+{
+  const auto clock = static_cast<TimestampClock>((config_word.load(std::memory_order_relaxed) >> 16) & 0xff);
+  switch (clock)
+  {
+  case TimestampClock::coarse:
+  {
+#if defined(CLOCK_REALTIME_COARSE)
+    timespec ts;
+    if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+      return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#endif
+    break;
+  }
+  case TimestampClock::tsc:
+  {
+#if defined(TINYLOG_HAVE_TSC)
+    if (const TscCalibration *calibration = tsc_calibration.load(std::memory_order_acquire))
+    {
+      const auto elapsed = static_cast<std::int64_t>(__rdtsc() - calibration->ticks);
+      return calibration->nanoseconds +
+             static_cast<std::int64_t>(static_cast<double>(elapsed) * calibration->nanoseconds_per_tick);
+    }
+#endif
+    break;
+  }
+  default:
+    break;
+  }
+  return realtime_now();
+}
+
+std::size_t format_timestamp(char *out, std::int64_t when)
+{
+  PrefixCache &cache = prefix_cache;
+  const std::uint32_t generation = config_generation.load(std::memory_order_acquire);
+  if (cache.generation != generation)
+  {
+    cache.generation = generation;
+    cache.config = unpack(config_word.load(std::memory_order_acquire));
+    cache.second = LLONG_MIN;
+  }
+
+  // Floor division so that pre-epoch times still get a positive fraction.
+  std::int64_t second = when / 1'000'000'000;
+  std::int64_t fraction = when % 1'000'000'000;
+  if (fraction < 0)
+  {
+    fraction += 1'000'000'000;
+    --second;
+  }
+  if (cache.second != second)
+    rebuild(cache, second);
+
+  std::memcpy(out, cache.text, cache.length);
+  char *cursor = out + cache.length;
+  switch (cache.config.precision)
+  {
+  case TimestampPrecision::milliseconds:
+    *cursor++ = '.';
+    write_digits(cursor, static_cast<std::uint64_t>(fraction / 1'000'000), 3);
+    cursor += 3;
+    break;
+  case TimestampPrecision::microseconds:
+    *cursor++ = '.';
+    write_digits(cursor, static_cast<std::uint64_t>(fraction / 1'000), 6);
+    cursor += 6;
+    break;
+  case TimestampPrecision::nanoseconds:
+    *cursor++ = '.';
+    write_digits(cursor, static_cast<std::uint64_t>(fraction), 9);
+    cursor += 9;
+    break;
+  default:
+    break;
+  }
+  if (cache.config.format == TimestampFormat::utc || cache.config.format == TimestampFormat::iso8601)
+    *cursor++ = 'Z';
+  *cursor++ = ']';
+  *cursor++ = ' ';
+  return static_cast<std::size_t>(cursor - out);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/*! \file Timestamp capture and cached prefix formatting. */
+
+#include <cstddef>
+#include <cstdint>
+
+//! Layout of the timestamp prefix.
+enum class TimestampFormat
+{
+  //! "[2024-01-31 13:45:07] " in local time.
+  local,
+  //! "[2024-01-31 13:45:07Z] " in UTC.
+  utc,
+  //! "[2024-01-31T13:45:07Z] " ISO-8601 in UTC.
+  iso8601,
+  //! "[1706708707] " seconds since the Unix epoch.
+  epoch,
+};
+
+//! Number of sub-second digits in the timestamp prefix.
+enum class TimestampPrecision
+{
+  seconds,
+  milliseconds,
+  microseconds,
+  nanoseconds,
+};
+
+//! Clock used to stamp messages.
+enum class TimestampClock
+{
+  //! The system wall clock (clock_gettime(CLOCK_REALTIME)).
+  realtime,
+  //! A cheaper tick-resolution wall clock (CLOCK_REALTIME_COARSE); falls back to realtime.
+  coarse,
+  //! The CPU time-stamp counter, calibrated against the wall clock once; falls back to realtime.
+  tsc,
+};
+
+//! Timestamp configuration.
+struct TimestampConfig
+{
+  TimestampFormat format = TimestampFormat::local;
+  TimestampPrecision precision = TimestampPrecision::seconds;
+  TimestampClock clock = TimestampClock::realtime;
+};
+
+//! Upper bound of a formatted prefix, including the trailing space.
+inline constexpr std::size_t max_timestamp_length = 48;
+
+/**
+ * @brief Apply a new timestamp configuration process-wide.
+ *
+ * Selecting TimestampClock::tsc calibrates the counter, which takes about 10 ms.
+ */
+void set_timestamp_config(const TimestampConfig &config);
+
+//! Current timestamp configuration.
+TimestampConfig timestamp_config();
+
+//! Read the configured clock, in nanoseconds since the Unix epoch.
+std::int64_t timestamp_now();
+
+/**
+ * @brief Format the prefix for a timestamp taken with timestamp_now().
+ *
+ * The date/time part is cached per thread and rebuilt only when the second changes.
+ *
+ * @param out buffer of at least max_timestamp_length bytes
+ * @param when nanoseconds since the Unix epoch
+ * @return number of bytes written
+ */
+std::size_t format_timestamp(char *out, std::int64_t when);
@@ -0,0 +1,442 @@
+/*! \file tinylog_bench: per-call latency percentiles and throughput of the tracers.
+ *
+ * Usage: tinylog_bench [--threads N] [--messages M] [--dir PATH] [--out FILE] [--only NAME]
+ *
+ * Runs every scenario with 1, 2, 4, ... N logging threads and prints one JSON document.
+ * Console output goes to the null device while the benchmark runs. Heap allocations made
+ * by the measured calls are counted; a scenario marked allocation free that allocates
+ * fails the run.
+ */
+
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+#include <io.h>
+#define tinylog_dup _dup
+#define tinylog_dup2 _dup2
+#define TINYLOG_NULL_DEVICE "NUL"
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define tinylog_dup dup
+#define tinylog_dup2 dup2
+#define TINYLOG_NULL_DEVICE "/dev/null"
+#endif
+
+namespace
+{
+  //! Set on a logging thread while it makes its measured calls.
+  thread_local bool counting_allocations = false;
+  std::atomic<std::uint64_t> allocations{0};
+}
+
+void *operator new(std::size_t size)
+{
+  if (counting_allocations)
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size ? size : 1))
+    return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+  std::free(memory);
+}
+
+namespace
+{
+  using bench_clock = std::chrono::steady_clock;
+
+  struct Options
+  {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t messages = 100000;
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "tinylog_bench";
+    std::string out;
+    std::string only;
+  };
+
+  struct Scenario
+  {
+    const char *name;
+    //! Install the tracer under test.
+    std::function<void(const std::filesystem::path &)> setup;
+    //! Log at a disabled severity instead.
+    bool disabled = false;
+    //! Reconfigure the logger from another thread while the loggers run.
+    bool reconfigure = false;
+    //! The measured calls must not allocate.
+    bool allocation_free = false;
+    //! Log through the named logger "bench.named" instead of the root.
+    bool named = false;
+  };
+
+  struct Result
+  {
+    std::string scenario;
+    unsigned threads = 0;
+    std::size_t messages = 0;
+    double seconds = 0;
+    //! Heap allocations made by the measured calls.
+    std::uint64_t allocations = 0;
+    //! Sorted per-call latencies.
+    std::vector<std::uint32_t> latencies;
+    //! Sorted configure() latencies for reconfigure scenarios.
+    std::vector<std::uint32_t> configure_latencies;
+  };
+
+  //! Releases all threads at once so they contend from the first call.
+  class StartGate
+  {
+  public:
+    void wait()
+    {
+      while (!open_.load(std::memory_order_acquire))
+        std::this_thread::yield();
+    }
+    void open() { open_.store(true, std::memory_order_release); }
+
+  private:
+    std::atomic<bool> open_{false};
+  };
+
+  std::uint32_t elapsed_ns(bench_clock::time_point from, bench_clock::time_point to)
+  {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    return static_cast<std::uint32_t>(std::min<std::int64_t>(ns, UINT32_MAX));
+  }
+
+  std::uint32_t percentile(const std::vector<std::uint32_t> &sorted, double fraction)
+  {
+    if (sorted.empty())
+      return 0;
+    const auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+  }
+
+  void log_calls(std::vector<std::uint32_t> &latencies, std::size_t count, unsigned thread, const Scenario &scenario)
+  {
+    const TraceSeverity severity = scenario.disabled ? TraceSeverity::debug : TraceSeverity::info;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const auto start = bench_clock::now();
+      if (scenario.named)
+        LOG_TO("bench.named", severity, "bench thread {} message {} value {}\n", thread, i, 0.5);
+      else if (scenario.disabled)
+        LOG_DEBUG("bench thread {} message {} value {}\n", thread, i, 0.5);
+      else
+        LOG_INFO("bench thread {} message {} value {}\n", thread, i, 0.5);
+      latencies.push_back(elapsed_ns(start, bench_clock::now()));
+    }
+  }
+
+  Result run(const Scenario &scenario, unsigned threads, const Options &options)
+  {
+    std::error_code ec;
+    std::filesystem::remove_all(options.dir, ec);
+    std::filesystem::create_directories(options.dir);
+    const auto path = options.dir / "bench.log";
+
+    Log::get().reset_levels().set_level(TraceSeverity::info);
+    Log::get().set_flight_recorder(false);
+    scenario.setup(path);
+
+    Result result;
+    result.scenario = scenario.name;
+    result.threads = threads;
+    result.messages = options.messages * threads;
+
+    std::vector<std::vector<std::uint32_t>> latencies(threads);
+    StartGate gate;
+    std::atomic<unsigned> running{threads};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&, t]
+                           {
+        auto &samples = latencies[t];
+        samples.reserve(options.messages);
+        // Warm up caches, thread slots and timestamp state outside the measurement.
+        log_calls(samples, std::min<std::size_t>(options.messages / 10, 1000), t, scenario);
+        samples.clear();
+        gate.wait();
+        counting_allocations = true;
+        log_calls(samples, options.messages, t, scenario);
+        counting_allocations = false;
+        running.fetch_sub(1, std::memory_order_release); });
+    }
+
+    std::thread reconfigurer;
+    if (scenario.reconfigure)
+    {
+      reconfigurer = std::thread([&]
+                                 {
+        gate.wait();
+        while (running.load(std::memory_order_acquire) > 0)
+        {
+          const auto start = bench_clock::now();
+          scenario.setup(path);
+          result.configure_latencies.push_back(elapsed_ns(start, bench_clock::now()));
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } });
+    }
+
+    // Give the workers time to finish warming up.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    allocations.store(0, std::memory_order_relaxed);
+    const auto start = bench_clock::now();
+    gate.open();
+    for (auto &worker : workers)
+      worker.join();
+    if (reconfigurer.joinable())
+      reconfigurer.join();
+    // Buffered tracers are done only once everything reached the device.
+    Log::get().flush();
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.allocations = allocations.load(std::memory_order_relaxed);
+
+    Log::get().configure(TraceType::devnull);
+    Log::get().set_flight_recorder(false);
+    Log::get().set_stats(false);
+    Log::get().set_callsites({}, CallsiteMode::follow);
+    for (auto &samples : latencies)
+      result.latencies.insert(result.latencies.end(), samples.begin(), samples.end());
+    std::sort(result.latencies.begin(), result.latencies.end());
+    std::sort(result.configure_latencies.begin(), result.configure_latencies.end());
+    return result;
+  }
+
+  void append_latencies(std::string &out, const std::vector<std::uint32_t> &sorted)
+  {
+    out += std::format("{{\"p50\":{},\"p99\":{},\"p999\":{},\"max\":{}}}", percentile(sorted, 0.5),
+                       percentile(sorted, 0.99), percentile(sorted, 0.999), sorted.empty() ? 0 : sorted.back());
+  }
+
+  std::string to_json(const std::vector<Result> &results, const Options &options)
+  {
+    std::string out = std::format("{{\"benchmark\":\"tinylog\",\"hardware_threads\":{},\"messages_per_thread\":{},"
+                                  "\"results\":[",
+                                  std::thread::hardware_concurrency(), options.messages);
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+      const Result &result = results[i];
+      if (i)
+        out += ",";
+      out += std::format("\n{{\"scenario\":\"{}\",\"threads\":{},\"messages\":{},\"seconds\":{:.6f},"
+                         "\"messages_per_second\":{:.0f},\"allocations_per_message\":{:.3f},\"latency_ns\":",
+                         result.scenario, result.threads, result.messages, result.seconds,
+                         static_cast<double>(result.messages) / result.seconds,
+                         static_cast<double>(result.allocations) / static_cast<double>(result.messages));
+      append_latencies(out, result.latencies);
+      if (!result.configure_latencies.empty())
+      {
+        out += std::format(",\"configure_calls\":{},\"configure_latency_ns\":", result.configure_latencies.size());
+        append_latencies(out, result.configure_latencies);
+      }
+      out += "}";
+    }
+    out += "\n]}\n";
+    return out;
+  }
+
+#if !((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+  //! A UDP socket on the loopback interface standing in for a syslog collector; returns its address.
+  //! A thread reads and discards the datagrams for the rest of the run.
+  std::string loopback_receiver()
+  {
+    static const std::string address = []
+    {
+      const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+      sockaddr_in local{};
+      local.sin_family = AF_INET;
+      local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      socklen_t length = sizeof(local);
+      if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0 ||
+          ::getsockname(fd, reinterpret_cast<sockaddr *>(&local), &length) != 0)
+        return std::string("udp://127.0.0.1:9");
+      std::thread([fd]
+                  {
+                    char datagram[65536];
+                    while (::recv(fd, datagram, sizeof(datagram), 0) >= 0)
+                    {
+                    } })
+          .detach();
+      return "udp://127.0.0.1:" + std::to_string(ntohs(local.sin_port));
+    }();
+    return address;
+  }
+#endif
+
+  std::vector<Scenario> scenarios()
+  {
+    RotationConfig rotate;
+    rotate.max_file_size = 8 * 1024 * 1024;
+    rotate.max_backup_count = 3;
+    RotationConfig rotate_zstd = rotate;
+    rotate_zstd.compress = true;
+    RotationConfig rotate_indexed = rotate_zstd;
+    rotate_indexed.time_index = true;
+    ConsoleConfig console_batched;
+    console_batched.flush.max_buffered_bytes = 64 * 1024;
+    console_batched.flush.max_delay = std::chrono::milliseconds(100);
+
+    return {
+        {"void", [](const auto &) { Log::get().configure(TraceType::devnull); }, false, false, true},
+        {"disabled_severity", [](const auto &) { Log::get().configure(TraceType::devnull); }, true, false, true},
+        {"console", [](const auto &) { Log::get().configure(TraceType::console); }, false, false, true},
+        {"console_batched", [console_batched](const auto &) { Log::get().configure(console_batched); }, false, false,
+         true},
+        {"file", [](const auto &path) { Log::get().configure(TraceType::file, path.string()); }, false, false, true},
+        {"file_rotate", [rotate](const auto &path) { Log::get().configure(TraceType::file, path.string(), rotate); }},
+        {"file_rotate_zstd",
+         [rotate_zstd](const auto &path) { Log::get().configure(TraceType::file, path.string(), rotate_zstd); }},
+        {"file_rotate_indexed",
+         [rotate_indexed](const auto &path) { Log::get().configure(TraceType::file, path.string(), rotate_indexed); }},
+        {"async_file", [](const auto &path) { Log::get().configure(TraceType::async_file, path.string()); }},
+        {"mmap_file", [](const auto &path) { Log::get().configure(TraceType::mmap_file, path.string()); }},
+        {"binary_file", [](const auto &path) { Log::get().configure(TraceType::binary_file, path.string()); }},
+        {"uring_file", [](const auto &path) { Log::get().configure(TraceType::uring_file, path.string()); }},
+        {"uring_file_rotate",
+         [rotate](const auto &path) { Log::get().configure(TraceType::uring_file, path.string(), rotate); }},
+#if !((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+        {"syslog_udp", [](const auto &) { Log::get().configure(TraceType::syslog, loopback_receiver()); }},
+#endif
+        {"flight_recorder_disabled_severity",
+         [](const auto &path)
+         {
+           Log::get().configure(TraceType::devnull);
+           Log::get().set_flight_recorder(true, {512, (path.parent_path() / "flight.bin").string(), false});
+         },
+         true},
+        {"async_file_with_stats",
+         [](const auto &path)
+         {
+           Log::get().configure(TraceType::async_file, path.string());
+           Log::get().set_stats(true, 64);
+         }},
+        {"named_logger", [](const auto &) { Log::get().configure(TraceType::devnull); }, false, false, true, true},
+        {"named_logger_disabled_severity",
+         [](const auto &)
+         {
+           Log::get().configure(TraceType::devnull);
+           // A noisy sibling has debug on; bench.named still follows the root.
+           Log::get("bench.other").set_level(TraceSeverity::debug);
+         },
+         true, false, true, true},
+        {"callsite_forced_on",
+         [](const auto &)
+         {
+           Log::get().configure(TraceType::devnull);
+           // Debug stays disabled; only the benchmark's LOG_DEBUG statement is switched on.
+           Log::get().set_callsites({.function = "log_calls", .format = "bench thread*"}, CallsiteMode::on);
+         },
+         true, false, true},
+        {"callsite_forced_off",
+         [](const auto &)
+         {
+           Log::get().configure(TraceType::devnull);
+           Log::get().set_callsites({.function = "log_calls", .format = "bench thread*"}, CallsiteMode::off);
+         },
+         false, false, true},
+        {"configure_under_load", [](const auto &path) { Log::get().configure(TraceType::file, path.string()); },
+         false, true},
+    };
+  }
+
+  bool parse(int argc, char **argv, Options &options)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string_view arg = argv[i];
+      const bool has_value = i + 1 < argc;
+      if (arg == "--threads" && has_value)
+        options.threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+      else if (arg == "--messages" && has_value)
+        options.messages = static_cast<std::size_t>(std::max(1, std::atoi(argv[++i])));
+      else if (arg == "--dir" && has_value)
+        options.dir = argv[++i];
+      else if (arg == "--out" && has_value)
+        options.out = argv[++i];
+      else if (arg == "--only" && has_value)
+        options.only = argv[++i];
+      else
+        return false;
+    }
+    return true;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parse(argc, argv, options))
+  {
+    std::fprintf(stderr, "usage: tinylog_bench [--threads N] [--messages M] [--dir PATH] [--out FILE] [--only NAME]\n");
+    return 2;
+  }
+
+  // The console scenario writes to stdout; keep the real one for the report.
+  std::fflush(stdout);
+  const int report_fd = tinylog_dup(1);
+  if (std::FILE *null_device = std::fopen(TINYLOG_NULL_DEVICE, "w"))
+    tinylog_dup2(fileno(null_device), 1);
+
+  std::vector<unsigned> thread_counts;
+  for (unsigned n = 1; n < options.threads; n *= 2)
+    thread_counts.push_back(n);
+  thread_counts.push_back(options.threads);
+
+  std::vector<Result> results;
+  bool allocated = false;
+  for (const Scenario &scenario : scenarios())
+  {
+    if (!options.only.empty() && options.only != scenario.name)
+      continue;
+    for (unsigned threads : thread_counts)
+    {
+      results.push_back(run(scenario, threads, options));
+      std::fprintf(stderr, "%-22s %3u threads: %12.0f msg/s\n", scenario.name, threads,
+                   static_cast<double>(results.back().messages) / results.back().seconds);
+      if (scenario.allocation_free && results.back().allocations > 0)
+      {
+        std::fprintf(stderr, "tinylog_bench: %s made %llu heap allocations\n", scenario.name,
+                     static_cast<unsigned long long>(results.back().allocations));
+        allocated = true;
+      }
+    }
+  }
+  std::error_code ec;
+  std::filesystem::remove_all(options.dir, ec);
+
+  std::cout.flush();
+  std::fflush(stdout);
+  tinylog_dup2(report_fd, 1);
+  const std::string report = to_json(results, options);
+  std::FILE *out = options.out.empty() ? stdout : std::fopen(options.out.c_str(), "w");
+  if (!out)
+  {
+    std::fprintf(stderr, "tinylog_bench: cannot write %s\n", options.out.c_str());
+    return 1;
+  }
+  std::fwrite(report.data(), 1, report.size(), out);
+  std::fclose(out);
+  return allocated ? 1 : 0;
+}
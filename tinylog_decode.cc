@@ -0,0 +1,307 @@
+/*! \file tinylog-decode: converts binary log files back into the text layout.
+ *
+ * Usage: tinylog-decode [options] <file>...
+ *
+ * Files written with live compression and rotated ".zst" files are decompressed on the fly.
+ */
+
+#include "binary_format.hpp"
+#include "packed_args.hpp"
+#include "timestamp.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <zstd.h>
+
+namespace
+{
+  //! Reads a file, decompressing it when it starts with a zstd frame.
+  class Input
+  {
+  public:
+    explicit Input(const char *path)
+        : in_(path, std::ios::binary)
+    {
+    }
+
+    ~Input()
+    {
+      ZSTD_freeDStream(dstream_);
+    }
+
+    bool is_open() const { return in_.is_open(); }
+
+    //! Append up to one chunk of decoded bytes to out; returns false at the end of the input.
+    bool read(std::string &out)
+    {
+      // A full output buffer may leave decoded bytes inside zstd; drain them before reading on.
+      if ((raw_.empty() || raw_pos_ == raw_.size()) && !output_full_)
+      {
+        raw_.resize(ZSTD_DStreamInSize());
+        in_.read(raw_.data(), static_cast<std::streamsize>(raw_.size()));
+        raw_.resize(static_cast<std::size_t>(in_.gcount()));
+        raw_pos_ = 0;
+        if (raw_.empty())
+          return false;
+        if (first_)
+        {
+          first_ = false;
+          std::uint32_t magic = 0;
+          if (raw_.size() >= sizeof(magic))
+            std::memcpy(&magic, raw_.data(), sizeof(magic));
+          if (magic == ZSTD_MAGICNUMBER)
+          {
+            dstream_ = ZSTD_createDStream();
+            ZSTD_initDStream(dstream_);
+          }
+        }
+      }
+      if (!dstream_)
+      {
+        out.append(raw_, raw_pos_);
+        raw_pos_ = raw_.size();
+        return true;
+      }
+      const std::size_t old_size = out.size();
+      out.resize(old_size + ZSTD_DStreamOutSize());
+      ZSTD_inBuffer input{raw_.data(), raw_.size(), raw_pos_};
+      ZSTD_outBuffer output{out.data() + old_size, out.size() - old_size, 0};
+      const std::size_t result = ZSTD_decompressStream(dstream_, &output, &input);
+      out.resize(old_size + output.pos);
+      raw_pos_ = input.pos;
+      output_full_ = output.pos == output.size;
+      if (ZSTD_isError(result))
+      {
+        std::fprintf(stderr, "tinylog-decode: %s\n", ZSTD_getErrorName(result));
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    std::ifstream in_;
+    std::string raw_;
+    std::size_t raw_pos_ = 0;
+    bool first_ = true;
+    bool output_full_ = false;
+    ZSTD_DStream *dstream_ = nullptr;
+  };
+
+  struct Options
+  {
+    bool threads = false;
+  };
+
+  //! Decoder state of one file.
+  class Decoder
+  {
+  public:
+    explicit Decoder(const Options &options)
+        : options_(options)
+    {
+    }
+
+    /**
+     * @brief Decode every complete entry at the start of data.
+     *
+     * @return number of bytes consumed, or std::string::npos on corrupt input.
+     */
+    std::size_t decode(const std::string &data)
+    {
+      const auto *begin = reinterpret_cast<const unsigned char *>(data.data());
+      const auto *end = begin + data.size();
+      const unsigned char *cursor = begin;
+      for (;;)
+      {
+        const unsigned char *entry = cursor;
+        const int result = decode_entry(cursor, end);
+        if (result < 0)
+          return std::string::npos;
+        if (result == 0)
+          return static_cast<std::size_t>(entry - begin);
+      }
+    }
+
+  private:
+    //! 1 = decoded, 0 = incomplete, -1 = corrupt.
+    int decode_entry(const unsigned char *&cursor, const unsigned char *end)
+    {
+      if (cursor == end)
+        return 0;
+      const unsigned char tag = *cursor;
+      if (tag == static_cast<unsigned char>(binlog::magic[0]))
+      {
+        if (static_cast<std::size_t>(end - cursor) < binlog::header_size)
+          return 0;
+        std::uint16_t byte_order = 0;
+        std::memcpy(&byte_order, cursor + sizeof(binlog::magic) + 1, sizeof(byte_order));
+        if (std::memcmp(cursor, binlog::magic, sizeof(binlog::magic)) != 0 ||
+            cursor[sizeof(binlog::magic)] != binlog::version || byte_order != binlog::byte_order_mark)
+          return -1;
+        cursor += binlog::header_size;
+        formats_.clear();
+        last_when_ = 0;
+        started_ = true;
+        return 1;
+      }
+      if (!started_)
+        return -1;
+
+      const unsigned char *p = cursor + 1;
+      std::uint64_t id = 0;
+      std::uint64_t length = 0;
+      if (tag == binlog::definition_tag)
+      {
+        if (!binlog::get_varint(p, end, id) || !binlog::get_varint(p, end, length))
+          return 0;
+        if (static_cast<std::uint64_t>(end - p) < length)
+          return 0;
+        formats_[id].assign(reinterpret_cast<const char *>(p), static_cast<std::size_t>(length));
+        cursor = p + length;
+        return 1;
+      }
+      if (tag < binlog::record_tag || tag > binlog::record_tag + static_cast<unsigned char>(binlog::Severity::fatal))
+        return -1;
+
+      std::uint64_t delta = 0;
+      std::uint64_t thread = 0;
+      if (!binlog::get_varint(p, end, delta) || !binlog::get_varint(p, end, thread) ||
+          !binlog::get_varint(p, end, id) || !binlog::get_varint(p, end, length))
+        return 0;
+      if (static_cast<std::uint64_t>(end - p) < length)
+        return 0;
+      const auto format = formats_.find(id);
+      if (format == formats_.end())
+        return -1;
+      last_when_ += binlog::unzigzag(delta);
+      print(static_cast<binlog::Severity>(tag - binlog::record_tag), thread, format->second, p,
+            static_cast<std::size_t>(length));
+      cursor = p + length;
+      return 1;
+    }
+
+    void print(binlog::Severity severity, std::uint64_t thread, const std::string &format,
+               const unsigned char *args, std::size_t size)
+    {
+      char prefix[max_timestamp_length];
+      line_.assign(prefix, format_timestamp(prefix, last_when_));
+      if (options_.threads)
+        line_ += "[" + std::to_string(thread) + "] ";
+      line_ += binlog::severity_header(severity);
+      expanded_.clear();
+      if (!binlog::expand_args(expanded_, args, size))
+      {
+        line_ += "<corrupt arguments> " + format;
+      }
+      else
+      {
+        try
+        {
+          format_packed(line_, format, reinterpret_cast<const unsigned char *>(expanded_.data()),
+                        expanded_.size());
+        }
+        catch (const std::format_error &e)
+        {
+          line_ += std::string("<format error: ") + e.what() + "> " + format;
+        }
+      }
+      std::fwrite(line_.data(), 1, line_.size(), stdout);
+    }
+
+    const Options &options_;
+    std::unordered_map<std::uint64_t, std::string> formats_;
+    std::int64_t last_when_ = 0;
+    bool started_ = false;
+    std::string line_;
+    std::string expanded_;
+  };
+
+  bool decode_file(const char *path, const Options &options)
+  {
+    Input input(path);
+    if (!input.is_open())
+    {
+      std::fprintf(stderr, "tinylog-decode: cannot open %s\n", path);
+      return false;
+    }
+    Decoder decoder(options);
+    std::string pending;
+    while (input.read(pending))
+    {
+      const std::size_t used = decoder.decode(pending);
+      if (used == std::string::npos)
+      {
+        std::fprintf(stderr, "tinylog-decode: %s is not a tinylog binary file or is corrupt\n", path);
+        return false;
+      }
+      pending.erase(0, used);
+    }
+    if (!pending.empty())
+      std::fprintf(stderr, "tinylog-decode: %s: ignoring %zu bytes of a torn last record\n", path, pending.size());
+    return true;
+  }
+
+  void usage()
+  {
+    std::fprintf(stderr,
+                 "usage: tinylog-decode [options] <file>...\n"
+                 "  --utc          UTC timestamps\n"
+                 "  --iso8601      ISO-8601 timestamps in UTC\n"
+                 "  --epoch        seconds since the Unix epoch\n"
+                 "  --ms|--us|--ns sub-second digits\n"
+                 "  --threads      print the writer's thread number\n");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  TimestampConfig timestamps;
+  std::vector<const char *> files;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--utc")
+      timestamps.format = TimestampFormat::utc;
+    else if (arg == "--iso8601")
+      timestamps.format = TimestampFormat::iso8601;
+    else if (arg == "--epoch")
+      timestamps.format = TimestampFormat::epoch;
+    else if (arg == "--ms")
+      timestamps.precision = TimestampPrecision::milliseconds;
+    else if (arg == "--us")
+      timestamps.precision = TimestampPrecision::microseconds;
+    else if (arg == "--ns")
+      timestamps.precision = TimestampPrecision::nanoseconds;
+    else if (arg == "--threads")
+      options.threads = true;
+    else if (arg.starts_with("-"))
+    {
+      usage();
+      return 2;
+    }
+    else
+      files.push_back(argv[i]);
+  }
+  if (files.empty())
+  {
+    usage();
+    return 2;
+  }
+
+  set_timestamp_config(timestamps);
+  int status = 0;
+  for (const char *file : files)
+  {
+    if (!decode_file(file, options))
+      status = 1;
+  }
+  return status;
+}
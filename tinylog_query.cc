@@ -0,0 +1,603 @@
+/*! \file tinylog-query: extracts a time range and severities from text log files.
+ *
+ * Usage: tinylog-query [options] <file>...
+ *
+ * Files with a time index (RotationConfig::time_index) are read only where the index says
+ * matching lines may be; seekable ".zst" files decompress just those frames. Other files,
+ * and text the index does not cover, are scanned in full. Files are searched in parallel
+ * and printed oldest first; matching text waits in temporary files, not in memory.
+ */
+
+#include "binary_format.hpp"
+#include "seekable.hpp"
+#include "time_index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <zstd.h>
+
+namespace
+{
+  //! Names of the binlog::Severity values, as in the JSON and logfmt output.
+  constexpr const char *severity_names[timeindex::severity_count] = {"info",     "debug",    "warning",
+                                                                     "error",    "critical", "fatal"};
+  constexpr unsigned all_severities = (1u << timeindex::severity_count) - 1;
+
+  //! Bytes read from a file at a time.
+  constexpr std::uint64_t read_chunk = 1 << 20;
+  //! Matching text a file keeps in memory before moving it to a temporary file.
+  constexpr std::size_t spill_size = 4 << 20;
+
+  struct Query
+  {
+    //! Inclusive range, in nanoseconds since the Unix epoch.
+    std::int64_t from = std::numeric_limits<std::int64_t>::min();
+    std::int64_t to = std::numeric_limits<std::int64_t>::max();
+    //! Bit per binlog::Severity.
+    unsigned severities = all_severities;
+
+    bool filters() const
+    {
+      return from != std::numeric_limits<std::int64_t>::min() || to != std::numeric_limits<std::int64_t>::max() ||
+             severities != all_severities;
+    }
+  };
+
+  std::size_t parse_digits(std::string_view text, std::size_t count, int &value)
+  {
+    if (text.size() < count)
+      return 0;
+    value = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (text[i] < '0' || text[i] > '9')
+        return 0;
+      value = value * 10 + (text[i] - '0');
+    }
+    return count;
+  }
+
+  //! Sub-second digits after a '.', scaled to nanoseconds.
+  std::size_t parse_fraction(std::string_view text, std::int64_t &ns)
+  {
+    ns = 0;
+    if (text.empty() || text[0] != '.')
+      return 0;
+    std::size_t length = 1;
+    std::int64_t scale = 100'000'000;
+    for (; length < text.size() && text[length] >= '0' && text[length] <= '9'; ++length)
+    {
+      ns += (text[length] - '0') * scale;
+      scale /= 10;
+    }
+    return length;
+  }
+
+  /**
+   * @brief Parse a timestamp at the start of text, in any TimestampFormat.
+   *
+   * "2024-01-31 13:45:07" is local time, "2024-01-31 13:45:07Z" and "2024-01-31T13:45:07Z"
+   * are UTC, "1706708707" is seconds since the epoch; each may carry a fraction.
+   *
+   * @return number of characters used, 0 if there is no timestamp.
+   */
+  std::size_t parse_timestamp(std::string_view text, std::int64_t &ns)
+  {
+    std::tm parts{};
+    int year = 0;
+    if (parse_digits(text, 4, year) && text.size() >= 19 && text[4] == '-' && text[7] == '-' &&
+        (text[10] == ' ' || text[10] == 'T') && text[13] == ':' && text[16] == ':' &&
+        parse_digits(text.substr(5), 2, parts.tm_mon) && parse_digits(text.substr(8), 2, parts.tm_mday) &&
+        parse_digits(text.substr(11), 2, parts.tm_hour) && parse_digits(text.substr(14), 2, parts.tm_min) &&
+        parse_digits(text.substr(17), 2, parts.tm_sec))
+    {
+      parts.tm_year = year - 1900;
+      parts.tm_mon -= 1;
+      std::int64_t fraction = 0;
+      std::size_t length = 19 + parse_fraction(text.substr(19), fraction);
+      std::time_t seconds;
+      if (length < text.size() && text[length] == 'Z')
+      {
+        ++length;
+#if ((defined(WIN32) || defined(__MINGW32__) || defined(__MINGW64__)))
+        seconds = _mkgmtime(&parts);
+#else
+        seconds = timegm(&parts);
+#endif
+      }
+      else
+      {
+        parts.tm_isdst = -1;
+        seconds = std::mktime(&parts);
+      }
+      ns = static_cast<std::int64_t>(seconds) * 1'000'000'000 + fraction;
+      return length;
+    }
+
+    std::size_t length = 0;
+    std::int64_t seconds = 0;
+    for (; length < text.size() && text[length] >= '0' && text[length] <= '9'; ++length)
+      seconds = seconds * 10 + (text[length] - '0');
+    if (length == 0)
+      return 0;
+    std::int64_t fraction = 0;
+    length += parse_fraction(text.substr(length), fraction);
+    ns = seconds * 1'000'000'000 + fraction;
+    return length;
+  }
+
+  bool parse_severity_name(std::string_view name, std::size_t &severity)
+  {
+    for (severity = 0; severity < timeindex::severity_count; ++severity)
+    {
+      if (name == severity_names[severity])
+        return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Timestamp and severity of a line in any OutputFormat.
+   *
+   * @return false for lines that do not start a message, e.g. the rest of a multi-line one.
+   */
+  bool classify(std::string_view line, std::int64_t &when, std::size_t &severity)
+  {
+    std::size_t length = 0;
+    if (line.starts_with("["))
+    {
+      // Text: "[<timestamp>] <header><message>"
+      length = parse_timestamp(line.substr(1), when);
+      if (length == 0 || line.substr(1 + length, 2) != "] ")
+        return false;
+      const std::string_view rest = line.substr(length + 3);
+      severity = static_cast<std::size_t>(binlog::Severity::info);
+      for (std::size_t i = 0; i < timeindex::severity_count; ++i)
+      {
+        const char *header = binlog::severity_header(static_cast<binlog::Severity>(i));
+        if (*header && rest.starts_with(header))
+          severity = i;
+      }
+      return true;
+    }
+
+    std::string_view level_key;
+    if (line.starts_with("{\"ts\":\""))
+    {
+      length = parse_timestamp(line.substr(7), when);
+      level_key = "\"level\":\"";
+    }
+    else if (line.starts_with("ts="))
+    {
+      const std::size_t quote = line.substr(3, 1) == "\"" ? 1 : 0;
+      length = parse_timestamp(line.substr(3 + quote), when);
+      level_key = " level=";
+    }
+    if (length == 0)
+      return false;
+    const std::size_t level = line.find(level_key);
+    if (level == std::string_view::npos)
+      return false;
+    const std::string_view rest = line.substr(level + level_key.size());
+    return parse_severity_name(rest.substr(0, rest.find_first_of("\" ")), severity);
+  }
+
+  //! Passes the lines of a query's range and severities, and whatever continues them.
+  class LineFilter
+  {
+  public:
+    LineFilter(const Query &query, std::string &out)
+        : query_(query), out_(out), keep_(!query.filters())
+    {
+    }
+
+    //! Filter the complete lines of text; a partial last line waits for the next call.
+    void feed(std::string_view text)
+    {
+      if (!partial_.empty())
+      {
+        const std::size_t end = text.find('\n');
+        partial_.append(text.substr(0, end == std::string_view::npos ? text.size() : end + 1));
+        if (end == std::string_view::npos)
+          return;
+        line(partial_);
+        partial_.clear();
+        text.remove_prefix(end + 1);
+      }
+      for (std::size_t end; (end = text.find('\n')) != std::string_view::npos; text.remove_prefix(end + 1))
+        line(text.substr(0, end + 1));
+      partial_.append(text);
+    }
+
+    //! Filter a last line without a line end.
+    void finish()
+    {
+      if (!partial_.empty())
+        line(partial_);
+      partial_.clear();
+    }
+
+    //! Timestamp of the first line passed, if any was.
+    std::int64_t first() const { return first_; }
+
+  private:
+    void line(std::string_view text)
+    {
+      std::int64_t when = 0;
+      std::size_t severity = 0;
+      if (classify(text, when, severity))
+      {
+        keep_ = when >= query_.from && when <= query_.to && (query_.severities & (1u << severity));
+        if (keep_)
+          first_ = std::min(first_, when);
+      }
+      if (keep_)
+        out_.append(text);
+    }
+
+    const Query &query_;
+    std::string &out_;
+    std::string partial_;
+    //! The previous message passed; lines that continue it follow.
+    bool keep_;
+    std::int64_t first_ = std::numeric_limits<std::int64_t>::max();
+  };
+
+  //! A range of uncompressed text to scan.
+  struct Range
+  {
+    std::uint64_t offset;
+    std::uint64_t length;
+  };
+
+  //! Ranges that may hold matching lines: selected index blocks and text no entry covers.
+  std::vector<Range> select_ranges(const std::vector<timeindex::Entry> &entries, std::uint64_t size,
+                                   const Query &query, std::size_t &selected)
+  {
+    std::vector<Range> ranges;
+    const auto add = [&ranges](std::uint64_t offset, std::uint64_t end)
+    {
+      if (end <= offset)
+        return;
+      if (!ranges.empty() && ranges.back().offset + ranges.back().length == offset)
+        ranges.back().length += end - offset;
+      else
+        ranges.push_back({offset, end - offset});
+    };
+    std::uint64_t covered = 0;
+    selected = 0;
+    for (const timeindex::Entry &entry : entries)
+    {
+      if (entry.offset < covered || entry.offset >= size)
+        continue;
+      add(covered, entry.offset);
+      covered = std::min(entry.offset + entry.length, size);
+      unsigned severities = 0;
+      for (std::size_t i = 0; i < timeindex::severity_count; ++i)
+      {
+        if (entry.counts[i] > 0)
+          severities |= 1u << i;
+      }
+      if (entry.last_ns >= query.from && entry.first_ns <= query.to && (severities & query.severities))
+      {
+        add(entry.offset, covered);
+        ++selected;
+      }
+    }
+    add(covered, size);
+    return ranges;
+  }
+
+  struct FileResult
+  {
+    //! Matching text not moved to spilled yet.
+    std::string text;
+    //! Earlier matching text; files are printed only once all are searched, so this keeps memory bounded.
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> spilled{nullptr, &std::fclose};
+    //! Bytes of spilled that hold complete copies of text.
+    std::uint64_t spilled_bytes = 0;
+    //! Creating or writing the temporary file failed; text keeps the rest.
+    bool spill_failed = false;
+    std::int64_t first = std::numeric_limits<std::int64_t>::max();
+    bool ok = true;
+    std::string error;
+    bool indexed = false;
+    std::size_t blocks = 0;
+    std::size_t selected_blocks = 0;
+    std::uint64_t scanned_bytes = 0;
+    std::uint64_t total_bytes = 0;
+
+    //! Move text to the temporary file once it outgrew spill_size. If that fails, spilling
+    //! stops for this file and the rest of its text stays in memory.
+    void spill_if_large()
+    {
+      if (text.size() < spill_size || spill_failed)
+        return;
+      if (!spilled)
+        spilled.reset(std::tmpfile());
+      if (spilled && std::fwrite(text.data(), 1, text.size(), spilled.get()) == text.size())
+      {
+        spilled_bytes += text.size();
+        text.clear();
+        return;
+      }
+      // print() copies only spilled_bytes, so a partial copy of text is never printed twice.
+      spill_failed = true;
+    }
+
+    //! Print the matching text, spilled and in memory.
+    void print(std::FILE *out)
+    {
+      if (spilled)
+      {
+        std::rewind(spilled.get());
+        std::string buffer(read_chunk, '\0');
+        for (std::uint64_t left = spilled_bytes; left > 0;)
+        {
+          const std::size_t read =
+              std::fread(buffer.data(), 1, static_cast<std::size_t>(std::min<std::uint64_t>(left, buffer.size())),
+                         spilled.get());
+          if (read == 0)
+            break;
+          std::fwrite(buffer.data(), 1, read, out);
+          left -= read;
+        }
+        spilled.reset();
+      }
+      std::fwrite(text.data(), 1, text.size(), out);
+      std::string().swap(text);
+    }
+  };
+
+  //! Decompress a whole zstd file of any kind through the filter.
+  bool scan_stream(std::ifstream &in, LineFilter &filter, FileResult &result)
+  {
+    ZSTD_DStream *dstream = ZSTD_createDStream();
+    if (!dstream)
+      return false;
+    ZSTD_initDStream(dstream);
+    std::string raw(ZSTD_DStreamInSize(), '\0');
+    std::string text(ZSTD_DStreamOutSize(), '\0');
+    bool ok = true;
+    in.clear();
+    in.seekg(0);
+    while (ok && in.read(raw.data(), static_cast<std::streamsize>(raw.size())).gcount() > 0)
+    {
+      ZSTD_inBuffer input{raw.data(), static_cast<std::size_t>(in.gcount()), 0};
+      while (input.pos < input.size)
+      {
+        ZSTD_outBuffer output{text.data(), text.size(), 0};
+        if (ZSTD_isError(ZSTD_decompressStream(dstream, &output, &input)))
+        {
+          ok = false;
+          break;
+        }
+        filter.feed(std::string_view(text.data(), output.pos));
+        result.spill_if_large();
+        result.scanned_bytes += output.pos;
+      }
+    }
+    ZSTD_freeDStream(dstream);
+    result.total_bytes = result.scanned_bytes;
+    return ok;
+  }
+
+  void query_file(const std::string &path, const Query &query, FileResult &result)
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+    {
+      result.ok = false;
+      result.error = "cannot open " + path;
+      return;
+    }
+    std::uint32_t magic = 0;
+    in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    const bool compressed = in.gcount() == sizeof(magic) && magic == ZSTD_MAGICNUMBER;
+
+    LineFilter filter(query, result.text);
+    SeekableZstdReader seekable;
+    std::uint64_t size = 0;
+    if (compressed)
+    {
+      if (!seekable.open(path))
+      {
+        // Streaming compression: no frames to pick from.
+        if (!scan_stream(in, filter, result))
+        {
+          result.ok = false;
+          result.error = path + " is not a valid zstd file";
+        }
+        filter.finish();
+        result.first = filter.first();
+        return;
+      }
+      size = seekable.size();
+    }
+    else
+    {
+      std::error_code ec;
+      size = std::filesystem::file_size(path, ec);
+    }
+
+    std::vector<timeindex::Entry> entries;
+    result.indexed = timeindex::read(timeindex::sidecar_path(path), entries);
+    result.blocks = entries.size();
+    result.total_bytes = size;
+    std::vector<Range> ranges = select_ranges(entries, size, query, result.selected_blocks);
+
+    std::string chunk;
+    for (const Range &range : ranges)
+    {
+      for (std::uint64_t done = 0; done < range.length;)
+      {
+        const std::uint64_t length = std::min(read_chunk, range.length - done);
+        chunk.clear();
+        if (compressed)
+        {
+          if (!seekable.read(range.offset + done, length, chunk))
+          {
+            result.ok = false;
+            result.error = path + ": cannot decompress frame";
+            return;
+          }
+        }
+        else
+        {
+          chunk.resize(static_cast<std::size_t>(length));
+          in.clear();
+          in.seekg(static_cast<std::streamoff>(range.offset + done));
+          in.read(chunk.data(), static_cast<std::streamsize>(length));
+          chunk.resize(static_cast<std::size_t>(in.gcount()));
+        }
+        if (chunk.empty())
+          break;
+        filter.feed(chunk);
+        result.spill_if_large();
+        done += chunk.size();
+        result.scanned_bytes += chunk.size();
+      }
+      // Ranges end at line ends.
+      filter.finish();
+    }
+    result.first = filter.first();
+  }
+
+  bool parse_time_argument(const char *text, std::int64_t &ns)
+  {
+    const std::size_t length = parse_timestamp(text, ns);
+    return length > 0 && length == std::strlen(text);
+  }
+
+  bool parse_severities(std::string_view list, unsigned &severities)
+  {
+    severities = 0;
+    while (!list.empty())
+    {
+      const std::size_t comma = list.find(',');
+      std::size_t severity = 0;
+      if (!parse_severity_name(list.substr(0, comma), severity))
+        return false;
+      severities |= 1u << severity;
+      list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+    }
+    return severities != 0;
+  }
+
+  void usage()
+  {
+    std::fprintf(stderr,
+                 "usage: tinylog-query [options] <file>...\n"
+                 "  --from TIME       skip messages before TIME\n"
+                 "  --to TIME         skip messages after TIME\n"
+                 "  --severity LIST   comma-separated: info,debug,warning,error,critical,fatal\n"
+                 "  --threads N       files searched in parallel (default: one per core)\n"
+                 "  --stats           print the blocks and bytes scanned per file to stderr\n"
+                 "TIME is \"2024-01-31 13:45:07\" in local time, \"2024-01-31T13:45:07Z\" in UTC,\n"
+                 "or seconds since the Unix epoch, each with an optional fraction.\n"
+                 "Index files (*.idx) among the arguments are skipped.\n");
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Query query;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  bool stats = false;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--from" && has_value)
+    {
+      if (!parse_time_argument(argv[++i], query.from))
+      {
+        std::fprintf(stderr, "tinylog-query: bad time %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (arg == "--to" && has_value)
+    {
+      if (!parse_time_argument(argv[++i], query.to))
+      {
+        std::fprintf(stderr, "tinylog-query: bad time %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (arg == "--severity" && has_value)
+    {
+      if (!parse_severities(argv[++i], query.severities))
+      {
+        std::fprintf(stderr, "tinylog-query: bad severity list %s\n", argv[i]);
+        return 2;
+      }
+    }
+    else if (arg == "--threads" && has_value)
+      threads = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--stats")
+      stats = true;
+    else if (arg.starts_with("-"))
+    {
+      usage();
+      return 2;
+    }
+    else if (!arg.ends_with(".idx"))
+      files.emplace_back(arg);
+  }
+  if (files.empty())
+  {
+    usage();
+    return 2;
+  }
+
+  std::vector<FileResult> results(files.size());
+  std::atomic<std::size_t> next{0};
+  const auto worker = [&]
+  {
+    for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < files.size();)
+      query_file(files[i], query, results[i]);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < std::min<std::size_t>(threads, files.size()); ++i)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &thread : pool)
+    thread.join();
+
+  // Backups and the active file in the order they were written.
+  std::vector<std::size_t> order(files.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&results](std::size_t a, std::size_t b)
+                   { return results[a].first < results[b].first; });
+  int status = 0;
+  for (const std::size_t i : order)
+  {
+    FileResult &result = results[i];
+    result.print(stdout);
+    if (!result.ok)
+    {
+      std::fprintf(stderr, "tinylog-query: %s\n", result.error.c_str());
+      status = 1;
+    }
+    if (stats)
+      std::fprintf(stderr, "%s: %s, %zu of %zu blocks, %llu of %llu bytes scanned\n", files[i].c_str(),
+                   result.indexed ? "indexed" : "no index", result.selected_blocks, result.blocks,
+                   static_cast<unsigned long long>(result.scanned_bytes),
+                   static_cast<unsigned long long>(result.total_bytes));
+  }
+  return status;
+}
@@ -0,0 +1,380 @@
+#include "uring_writer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace
+{
+  //! user_data of fdatasync requests; writes carry their buffer index.
+  constexpr std::uint64_t sync_request = ~std::uint64_t{0};
+
+  template <typename T>
+  T *ring_field(void *ring, std::uint32_t offset)
+  {
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+  }
+
+  int io_uring_setup(unsigned entries, io_uring_params &params)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  }
+
+  int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+  }
+
+  int io_uring_register(int ring_fd, unsigned opcode, const void *arg, unsigned count)
+  {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, count));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// UringWriter – construction / destruction
+// ---------------------------------------------------------------------------
+
+UringWriter::UringWriter(std::size_t buffer_size, unsigned buffer_count, SinkCounters &counters)
+    : counters_(counters), buffer_size_(std::max<std::size_t>(buffer_size, 4096))
+{
+  buffer_count = std::max(buffer_count, 1u);
+  storage_.resize(buffer_size_ * buffer_count);
+  buffers_.resize(buffer_count);
+  for (std::size_t i = 0; i < buffers_.size(); ++i)
+    buffers_[i].data = storage_.data() + i * buffer_size_;
+  // Every write may carry a linked fdatasync.
+  setup_ring(2 * buffer_count);
+}
+
+UringWriter::~UringWriter()
+{
+  close();
+  teardown_ring();
+}
+
+void UringWriter::setup_ring(unsigned entries)
+{
+  io_uring_params params{};
+  ring_fd_ = io_uring_setup(entries, params);
+  if (ring_fd_ < 0)
+  {
+    ring_fd_ = -1;
+    return;
+  }
+  sq_entries_ = params.sq_entries;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                  IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED)
+    sq_ring_ = nullptr;
+  if (single_mmap)
+    cq_ring_ = sq_ring_;
+  else if ((cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_CQ_RING)) == MAP_FAILED)
+    cq_ring_ = nullptr;
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED)
+    sqes_ = nullptr;
+  if (!sq_ring_ || !cq_ring_ || !sqes_)
+  {
+    teardown_ring();
+    return;
+  }
+
+  sq_tail_ = ring_field<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = ring_field<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = ring_field<unsigned>(sq_ring_, params.sq_off.array);
+  cq_head_ = ring_field<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = ring_field<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = ring_field<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = ring_field<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+  // Registered buffers spare the kernel pinning the pages on every write; plain writes work too.
+  std::vector<iovec> iovecs(buffers_.size());
+  for (std::size_t i = 0; i < buffers_.size(); ++i)
+    iovecs[i] = {buffers_[i].data, buffer_size_};
+  fixed_buffers_ = io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, iovecs.data(),
+                                     static_cast<unsigned>(iovecs.size())) == 0;
+}
+
+void UringWriter::teardown_ring()
+{
+  if (sqes_)
+    munmap(sqes_, sqes_size_);
+  if (cq_ring_ && cq_ring_ != sq_ring_)
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_)
+    munmap(sq_ring_, sq_ring_size_);
+  sqes_ = sq_ring_ = cq_ring_ = nullptr;
+  // Closing the ring also drops the buffer registration.
+  if (ring_fd_ >= 0)
+    ::close(ring_fd_);
+  ring_fd_ = -1;
+  fixed_buffers_ = false;
+}
+
+// ---------------------------------------------------------------------------
+// UringWriter – file
+// ---------------------------------------------------------------------------
+
+void UringWriter::open(const std::filesystem::path &path)
+{
+  close();
+  // Not O_APPEND: that would ignore the offsets and let concurrent writes land out of order.
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    throw std::runtime_error("Failed to open log file: " + path.string());
+  struct stat info;
+  offset_ = fstat(fd_, &info) == 0 ? static_cast<std::uint64_t>(info.st_size) : 0;
+}
+
+void UringWriter::close()
+{
+  if (fd_ < 0)
+    return;
+  wait();
+  ::close(fd_);
+  fd_ = -1;
+}
+
+// ---------------------------------------------------------------------------
+// UringWriter – requests
+// ---------------------------------------------------------------------------
+
+void UringWriter::write(std::string_view bytes, bool sync)
+{
+  if (fd_ < 0)
+    return;
+  if (!uses_ring())
+  {
+    write_direct(bytes.data(), bytes.size(), offset_);
+    offset_ += bytes.size();
+    if (sync)
+      sync_direct();
+    return;
+  }
+  if (bytes.empty())
+  {
+    if (sync)
+      this->sync();
+    return;
+  }
+  while (!bytes.empty() && uses_ring())
+  {
+    const bool last = bytes.size() <= buffer_size_;
+    const bool linked = sync && last;
+    reserve(linked ? 2 : 1);
+    Buffer &buffer = acquire();
+    const auto index = static_cast<std::size_t>(&buffer - buffers_.data());
+    buffer.length = std::min(bytes.size(), buffer_size_);
+    buffer.offset = offset_;
+    std::memcpy(buffer.data, bytes.data(), buffer.length);
+    offset_ += buffer.length;
+    bytes.remove_prefix(buffer.length);
+
+    io_uring_sqe &sqe = next_sqe();
+    sqe.opcode = fixed_buffers_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe.fd = fd_;
+    sqe.addr = reinterpret_cast<std::uint64_t>(buffer.data);
+    sqe.len = static_cast<std::uint32_t>(buffer.length);
+    sqe.off = buffer.offset;
+    sqe.buf_index = static_cast<std::uint16_t>(fixed_buffers_ ? index : 0);
+    sqe.user_data = index;
+    buffer.in_flight = true;
+    ++pending_;
+    if (linked)
+    {
+      // The write waits for everything before it, and the fdatasync for the write.
+      sqe.flags = IOSQE_IO_DRAIN | IOSQE_IO_LINK;
+      io_uring_sqe &fsync = next_sqe();
+      fsync.opcode = IORING_OP_FSYNC;
+      fsync.fd = fd_;
+      fsync.fsync_flags = IORING_FSYNC_DATASYNC;
+      fsync.user_data = sync_request;
+      ++pending_;
+    }
+    submit();
+  }
+  // The ring failed halfway through.
+  if (!bytes.empty())
+    this->write(bytes, sync);
+}
+
+void UringWriter::sync()
+{
+  if (fd_ < 0)
+    return;
+  if (!uses_ring())
+  {
+    sync_direct();
+    return;
+  }
+  reserve(1);
+  io_uring_sqe &fsync = next_sqe();
+  fsync.opcode = IORING_OP_FSYNC;
+  fsync.flags = IOSQE_IO_DRAIN;
+  fsync.fd = fd_;
+  fsync.fsync_flags = IORING_FSYNC_DATASYNC;
+  fsync.user_data = sync_request;
+  ++pending_;
+  submit();
+}
+
+void UringWriter::wait()
+{
+  while (pending_ > 0 && uses_ring())
+    reap(true);
+}
+
+UringWriter::Buffer &UringWriter::acquire()
+{
+  for (;;)
+  {
+    for (std::size_t tried = 0; tried < buffers_.size(); ++tried)
+    {
+      Buffer &buffer = buffers_[next_buffer_];
+      next_buffer_ = (next_buffer_ + 1) % buffers_.size();
+      if (!buffer.in_flight)
+        return buffer;
+    }
+    reap(true);
+  }
+}
+
+void UringWriter::reserve(unsigned count)
+{
+  while (pending_ + count > sq_entries_ && uses_ring())
+    reap(true);
+}
+
+io_uring_sqe &UringWriter::next_sqe()
+{
+  const unsigned index = (*sq_tail_ + unsubmitted_) & *sq_mask_;
+  auto &sqe = static_cast<io_uring_sqe *>(sqes_)[index];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sq_array_[index] = index;
+  ++unsubmitted_;
+  return sqe;
+}
+
+void UringWriter::submit()
+{
+  // Only this thread moves the tail; the kernel reads it.
+  std::atomic_ref<unsigned> tail(*sq_tail_);
+  tail.store(tail.load(std::memory_order_relaxed) + unsubmitted_, std::memory_order_release);
+  while (unsubmitted_ > 0)
+  {
+    const int submitted = io_uring_enter(ring_fd_, unsubmitted_, 0, 0);
+    counters_.syscalls.add();
+    if (submitted >= 0)
+      unsubmitted_ -= std::min(static_cast<unsigned>(submitted), unsubmitted_);
+    else if (errno == EAGAIN || errno == EBUSY)
+      reap(false);
+    else if (errno != EINTR)
+    {
+      abandon_ring();
+      return;
+    }
+  }
+}
+
+void UringWriter::reap(bool block)
+{
+  std::atomic_ref<unsigned> head_ref(*cq_head_);
+  std::atomic_ref<unsigned> tail_ref(*cq_tail_);
+  unsigned head = head_ref.load(std::memory_order_relaxed);
+  unsigned tail = tail_ref.load(std::memory_order_acquire);
+  if (head == tail && block)
+  {
+    const int result = io_uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS);
+    counters_.syscalls.add();
+    if (result < 0 && errno != EINTR)
+    {
+      abandon_ring();
+      return;
+    }
+    tail = tail_ref.load(std::memory_order_acquire);
+  }
+  for (; head != tail; ++head)
+  {
+    const io_uring_cqe &cqe = static_cast<const io_uring_cqe *>(cqes_)[head & *cq_mask_];
+    --pending_;
+    if (cqe.user_data == sync_request)
+    {
+      // Canceled with a failed write, or not supported: sync directly.
+      if (cqe.res < 0)
+        sync_direct();
+      continue;
+    }
+    Buffer &buffer = buffers_[cqe.user_data];
+    const std::size_t done = cqe.res > 0 ? std::min(static_cast<std::size_t>(cqe.res), buffer.length) : 0;
+    counters_.bytes_written.add(done);
+    if (done < buffer.length)
+      write_direct(buffer.data + done, buffer.length - done, buffer.offset + done);
+    buffer.in_flight = false;
+  }
+  head_ref.store(head, std::memory_order_release);
+}
+
+void UringWriter::abandon_ring()
+{
+  // Rewriting a request the kernel may still complete is harmless: same bytes, same offset.
+  for (Buffer &buffer : buffers_)
+  {
+    if (buffer.in_flight)
+      write_direct(buffer.data, buffer.length, buffer.offset);
+    buffer.in_flight = false;
+  }
+  if (pending_ > 0)
+    sync_direct();
+  pending_ = 0;
+  unsubmitted_ = 0;
+  teardown_ring();
+}
+
+// ---------------------------------------------------------------------------
+// UringWriter – write(2) fallback
+// ---------------------------------------------------------------------------
+
+void UringWriter::write_direct(const char *data, std::size_t length, std::uint64_t offset)
+{
+  while (length > 0)
+  {
+    const ssize_t written = pwrite(fd_, data, length, static_cast<off_t>(offset));
+    counters_.syscalls.add();
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+    {
+      counters_.write_errors.add();
+      return;
+    }
+    counters_.bytes_written.add(static_cast<std::uint64_t>(written));
+    data += written;
+    length -= static_cast<std::size_t>(written);
+    offset += static_cast<std::uint64_t>(written);
+  }
+}
+
+void UringWriter::sync_direct()
+{
+  fdatasync(fd_);
+  counters_.syscalls.add();
+}
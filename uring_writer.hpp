@@ -0,0 +1,124 @@
+#pragma once
+
+/*! \file Appends to a file through io_uring with several writes in flight (Linux only). */
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "stats.hpp"
+
+struct io_uring_sqe;
+
+/**
+ * @brief Appends to one file at a time through an io_uring, without waiting for the writes.
+ *
+ * Data is copied into one of a few buffers registered with the kernel and submitted as a
+ * positioned write, so the caller returns once the request is queued; it waits only when
+ * every buffer is still in flight. Writes carry explicit offsets, so they may complete in
+ * any order and the file still ends up in submission order.
+ *
+ * The ring is set up with raw syscalls. Where io_uring is unavailable (old kernels,
+ * seccomp filters) every operation falls back to pwrite(2) and fdatasync(2).
+ */
+class UringWriter
+{
+public:
+  /**
+   * @param buffer_size bytes per registered buffer; larger writes are split
+   * @param buffer_count writes that may be in flight at once
+   * @param counters io_uring_enter, pwrite and fdatasync calls are added to syscalls, completed bytes
+   * to bytes_written and failed writes to write_errors
+   */
+  UringWriter(std::size_t buffer_size, unsigned buffer_count, SinkCounters &counters);
+  //! Waits for pending writes and closes the file.
+  ~UringWriter();
+
+  UringWriter(const UringWriter &) = delete;
+  UringWriter &operator=(const UringWriter &) = delete;
+
+  //! Open a file for appending, closing the previous one. Throws std::runtime_error on failure.
+  void open(const std::filesystem::path &path);
+  //! Wait for pending writes and close the file.
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+  //! Size of the file when it was opened plus every byte submitted since.
+  std::uint64_t size() const { return offset_; }
+  //! The ring is in use; false means writes go through pwrite(2).
+  bool uses_ring() const { return ring_fd_ >= 0; }
+
+  /**
+   * @brief Queue bytes for appending; they are copied, so the caller may reuse its buffer.
+   *
+   * @param sync link an fdatasync to the write; it runs once all earlier writes are done
+   */
+  void write(std::string_view bytes, bool sync = false);
+  //! Queue an fdatasync that runs once all earlier writes are done.
+  void sync();
+  //! Block until every queued request completed.
+  void wait();
+
+private:
+  struct Buffer
+  {
+    char *data = nullptr;
+    std::size_t length = 0;
+    std::uint64_t offset = 0;
+    bool in_flight = false;
+  };
+
+  //! Set up the ring and register the buffers; leaves ring_fd_ at -1 on failure.
+  void setup_ring(unsigned entries);
+  void teardown_ring();
+  //! A free buffer, reaping completions until one is.
+  Buffer &acquire();
+  //! Make room for count more requests, reaping completions as needed.
+  void reserve(unsigned count);
+  //! A cleared submission queue entry; published by submit().
+  struct io_uring_sqe &next_sqe();
+  //! Hand the entries filled since the last call to the kernel.
+  void submit();
+  //! Process available completions; if block is set and there were none, wait for one.
+  void reap(bool block);
+  //! Finish in-flight writes with pwrite(2) and stop using a ring that failed.
+  void abandon_ring();
+  //! pwrite(2) loop, used without a ring and to finish short writes.
+  void write_direct(const char *data, std::size_t length, std::uint64_t offset);
+  //! fdatasync(2) the open file.
+  void sync_direct();
+
+  SinkCounters &counters_;
+  std::size_t buffer_size_;
+  //! Backing store of the registered buffers, one block of buffer_size_ per entry.
+  std::vector<char> storage_;
+  std::vector<Buffer> buffers_;
+  //! Next buffer to try, buffers are used round robin.
+  std::size_t next_buffer_ = 0;
+  //! Requests submitted and not yet completed.
+  unsigned pending_ = 0;
+  //! Entries filled but not yet handed to the kernel.
+  unsigned unsubmitted_ = 0;
+  //! The buffers are registered, so writes use IORING_OP_WRITE_FIXED.
+  bool fixed_buffers_ = false;
+
+  int fd_ = -1;
+  std::uint64_t offset_ = 0;
+
+  int ring_fd_ = -1;
+  unsigned sq_entries_ = 0;
+  void *sq_ring_ = nullptr;
+  std::size_t sq_ring_size_ = 0;
+  void *cq_ring_ = nullptr;
+  std::size_t cq_ring_size_ = 0;
+  void *sqes_ = nullptr;
+  std::size_t sqes_size_ = 0;
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_mask_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned *cq_mask_ = nullptr;
+  void *cqes_ = nullptr;
+};